@@ -9,6 +9,31 @@ fi
 
 alignment=${alignment:-0}
 dec_mode=${dec_mode:-1}
+recv_batch=${recv_batch:-0}
+ingest=${ingest:-0}
+socket_filter=${socket_filter:-0}
+native_depay=${native_depay:-0}
+reorder_us=${reorder_us:-0}
+diversity_ports=${diversity_ports:-}
+appsink_cb=${appsink_cb:-0}
+appsink_max=${appsink_max:-0}
+busy_poll_us=${busy_poll_us:-0}
+reader_cpu=${reader_cpu:--1}
+loss_policy=${loss_policy:-0}
+fec_pt=${fec_pt:-0}
+keyframe_target=${keyframe_target:-}
+keyframe_format=${keyframe_format:-0}
+keyframe_interval_ms=${keyframe_interval_ms:-200}
+rtcp_target=${rtcp_target:-}
+rtcp_interval_ms=${rtcp_interval_ms:-1000}
+bitrate_hints=${bitrate_hints:-}
+bitrate_range=${bitrate_range:-2000,20000}
+impairment=${impairment:-}
+capture=${capture:-5,16}
+replay=${replay:-}
+routes=${routes:-}
+clock_sync=${clock_sync:-}
+capture_ext=${capture_ext:-0}
 
 if [ -f /storage/streamer/AMLDigitalFPV.new ]; then
 	mv /storage/streamer/AMLDigitalFPV.new /storage/streamer/AMLDigitalFPV
@@ -28,7 +53,10 @@ if [ ! -f /tmp/added_vfm ] ; then
 	touch /tmp/added_vfm
 fi
 
-if [ "$bad_frame" != "0" ]; then
+# With a loss policy the decoder only ever sees complete access units.
+if [ "$loss_policy" != "0" ]; then
+	echo "[+]Error policy: receiver drops damaged frames (loss_policy=${loss_policy})"
+elif [ "$bad_frame" != "0" ]; then
 	echo "[+]Error policy: Ignore ERROR"
 	echo 1 > /sys/module/amvdec_h265/parameters/hacked_lowlatency
 	#echo 0 >/sys/module/amvdec_h265/parameters/nal_skip_policy
@@ -38,4 +66,4 @@ else
 	echo "[+]Error policy: Drop FRAME"
 fi
 
-/storage/streamer/AMLDigitalFPV -w ${video_width} -h ${video_height} -p 120 -a ${sound} -l ${buf_level} -g ${alignment} -m ${dec_mode}
+/storage/streamer/AMLDigitalFPV -w ${video_width} -h ${video_height} -p 120 -a ${sound} -l ${buf_level} -g ${alignment} -m ${dec_mode} -b ${recv_batch} -i ${ingest} -F ${socket_filter} -n ${native_depay} -j ${reorder_us} -c ${appsink_cb} -q ${appsink_max} -B ${busy_poll_us} -C ${reader_cpu} -L ${loss_policy} -e ${fec_pt} -P ${keyframe_format} -R ${keyframe_interval_ms} -T ${rtcp_interval_ms} -W ${capture} -E ${capture_ext} ${keyframe_target:+-K ${keyframe_target}} ${rtcp_target:+-r ${rtcp_target}} ${bitrate_hints:+-H ${bitrate_hints} -M ${bitrate_range}} ${diversity_ports:+-D ${diversity_ports}} ${impairment:+-X ${impairment}} ${replay:+-Y ${replay}} ${routes:+-U ${routes}} ${clock_sync:+-S ${clock_sync}}
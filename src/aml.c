@@ -405,6 +405,17 @@ int aml_submit_decode_unit(uint8_t *decodeUnit, size_t length)
   return api;
 }
 
+// Decoder input -> display delay as the driver reports it, -1 when unavailable.
+int aml_get_video_delay_ms()
+{
+  int delay_ms = 0;
+  if (codecParam.handle < 0 || codec_get_video_cur_delay_ms(&codecParam, &delay_ms) != 0)
+  {
+    return -1;
+  }
+  return delay_ms;
+}
+
 void measure_latency_breakdown()
 {
   struct timespec ts;
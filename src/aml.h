@@ -48,6 +48,7 @@ extern "C"
     int aml_setup(int videoFormat, int width, int height, int redrawRate, void *context, int drFlags, int framePath, int streamType, int bufLevel, int decMode);
     void aml_cleanup();
     int aml_submit_decode_unit(uint8_t *decodeUnit, size_t size);
+    int aml_get_video_delay_ms();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,257 @@
+#include "clock_sync.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "frame_timing.h"
+#include "udp_target.h"
+
+namespace {
+constexpr int64_t kRestartJumpNs = 1000000000; // offset jump that means the air clock restarted
+constexpr double kMaxDriftPpm = 1000.0;        // beyond any crystal: a fit on noise
+constexpr uint64_t kMinDriftSpanNs = 2000000000;
+constexpr uint32_t kMaxReplyAge = 16;           // requests a reply may lag behind
+constexpr uint64_t kLogIntervalNs = 10000000000;
+} // namespace
+
+bool clock_sync::rtp_capture_time(const uint8_t *packet, size_t size, uint8_t id, uint64_t &air_ns)
+{
+    if (size < 16 || (packet[0] & 0xc0) != 0x80 || !(packet[0] & 0x10)) {
+        return false;
+    }
+    const size_t ext = 12 + static_cast<size_t>(packet[0] & 0x0f) * 4;
+    if (size < ext + 4) {
+        return false;
+    }
+    const uint16_t profile = static_cast<uint16_t>(packet[ext] << 8 | packet[ext + 1]);
+    const size_t end = ext + 4 + static_cast<size_t>(packet[ext + 2] << 8 | packet[ext + 3]) * 4;
+    const bool one_byte = profile == 0xbede;
+    if (end > size || (!one_byte && (profile & 0xfff0) != 0x1000)) {
+        return false;
+    }
+    size_t pos = ext + 4;
+    while (pos < end) {
+        if (packet[pos] == 0) { // padding
+            ++pos;
+            continue;
+        }
+        uint8_t element_id;
+        size_t length;
+        if (one_byte) {
+            element_id = packet[pos] >> 4;
+            length = static_cast<size_t>(packet[pos] & 0x0f) + 1;
+            if (element_id == 15) { // reserved: stop parsing
+                return false;
+            }
+            pos += 1;
+        } else {
+            if (pos + 2 > end) {
+                return false;
+            }
+            element_id = packet[pos];
+            length = packet[pos + 1];
+            pos += 2;
+        }
+        if (pos + length > end) {
+            return false;
+        }
+        if (element_id == id && length >= 8) {
+            air_ns = q32_to_ns(read_u64(packet + pos));
+            return true;
+        }
+        pos += length;
+    }
+    return false;
+}
+
+bool ClockOffsetEstimator::add(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+{
+    const int64_t rtt = static_cast<int64_t>(t4 - t1) - static_cast<int64_t>(t3 - t2);
+    if (rtt < 0 || t4 < t1) {
+        return false;
+    }
+    const Sample sample{t1 + (t4 - t1) / 2,
+                        (static_cast<int64_t>(t2 - t1) + static_cast<int64_t>(t3 - t4)) / 2,
+                        static_cast<uint64_t>(rtt)};
+    if (estimate_.valid) {
+        const int64_t error = static_cast<int64_t>(to_ground_ns(estimate_, sample.local_ns + sample.offset_ns) -
+                                                   sample.local_ns);
+        if (std::llabs(error) > kRestartJumpNs) {
+            samples_.clear();
+            ++estimate_.restarts;
+        }
+    }
+    samples_.push_back(sample);
+    while (samples_.size() > window_) {
+        samples_.pop_front();
+    }
+    refit();
+    return true;
+}
+
+void ClockOffsetEstimator::refit()
+{
+    std::vector<const Sample *> best;
+    best.reserve(samples_.size());
+    for (const auto &s : samples_) {
+        best.push_back(&s);
+    }
+    std::sort(best.begin(), best.end(), [](const Sample *a, const Sample *b) { return a->rtt_ns < b->rtt_ns; });
+    best.resize(std::min(best.size(), std::max<size_t>(4, best.size() / 4)));
+
+    // Least squares of offset over local time, relative to the newest sample.
+    const uint64_t ref = samples_.back().local_ns;
+    const int64_t base = best.front()->offset_ns;
+    double sx = 0, sy = 0;
+    uint64_t oldest = ref;
+    for (const Sample *s : best) {
+        sx += -static_cast<double>(ref - s->local_ns);
+        sy += static_cast<double>(s->offset_ns - base);
+        oldest = std::min(oldest, s->local_ns);
+    }
+    const double n = static_cast<double>(best.size());
+    const double mx = sx / n, my = sy / n;
+    double slope = 0.0;
+    if (best.size() >= 2 && ref - oldest >= kMinDriftSpanNs) {
+        double sxx = 0, sxy = 0;
+        for (const Sample *s : best) {
+            const double dx = -static_cast<double>(ref - s->local_ns) - mx;
+            sxx += dx * dx;
+            sxy += dx * (static_cast<double>(s->offset_ns - base) - my);
+        }
+        slope = sxx > 0 ? std::clamp(sxy / sxx, -kMaxDriftPpm * 1e-6, kMaxDriftPpm * 1e-6) : 0.0;
+    }
+
+    estimate_.valid = true;
+    estimate_.ref_ns = ref;
+    estimate_.offset_ns = base + static_cast<int64_t>(std::llround(my - slope * mx));
+    estimate_.drift_ppm = slope * 1e6;
+    estimate_.rtt_ns = best.front()->rtt_ns;
+    estimate_.samples = static_cast<uint32_t>(samples_.size());
+}
+
+uint64_t ClockOffsetEstimator::to_ground_ns(const Estimate &estimate, uint64_t air_ns)
+{
+    // air = ground + offset + drift * (ground - ref), solved for ground.
+    const int64_t rel = static_cast<int64_t>(air_ns - static_cast<uint64_t>(estimate.offset_ns) - estimate.ref_ns);
+    return estimate.ref_ns + static_cast<uint64_t>(std::llround(rel / (1.0 + estimate.drift_ppm * 1e-6)));
+}
+
+ClockSyncClient::ClockSyncClient(uint32_t interval_ms)
+    : interval_ns_(static_cast<uint64_t>(std::max<uint32_t>(interval_ms, 10)) * 1000000)
+{
+}
+
+ClockSyncClient::~ClockSyncClient()
+{
+    stop();
+}
+
+bool ClockSyncClient::start(const std::string &destination)
+{
+    fd_ = connect_udp_target(destination, "Clock sync");
+    if (fd_ < 0) {
+        return false;
+    }
+    destination_ = destination;
+    running_ = true;
+    thread_ = std::thread(&ClockSyncClient::run, this);
+    return true;
+}
+
+void ClockSyncClient::stop()
+{
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+ClockOffsetEstimator::Estimate ClockSyncClient::estimate() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return estimate_;
+}
+
+bool ClockSyncClient::to_ground_ns(uint64_t air_ns, uint64_t &ground_ns) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!estimate_.valid) {
+        return false;
+    }
+    ground_ns = ClockOffsetEstimator::to_ground_ns(estimate_, air_ns);
+    return true;
+}
+
+void ClockSyncClient::drain(uint32_t seq)
+{
+    uint8_t buf[64];
+    ssize_t n;
+    while ((n = recv(fd_, buf, sizeof(buf), 0)) > 0) {
+        const uint64_t t4 = monotonic_ns();
+        if (static_cast<size_t>(n) < clock_sync::kReplySize || std::memcmp(buf, "CLK!", 4) != 0) {
+            continue;
+        }
+        const uint32_t reply_seq = static_cast<uint32_t>(buf[4]) << 24 | static_cast<uint32_t>(buf[5]) << 16 |
+                                   static_cast<uint32_t>(buf[6]) << 8 | buf[7];
+        if (seq - reply_seq > kMaxReplyAge) {
+            continue;
+        }
+        const uint64_t t1 = clock_sync::read_u64(buf + 8);
+        const uint64_t t2 = clock_sync::q32_to_ns(clock_sync::read_u64(buf + 16));
+        const uint64_t t3 = clock_sync::q32_to_ns(clock_sync::read_u64(buf + 24));
+        std::lock_guard<std::mutex> lock(mutex_);
+        const bool had_estimate = estimate_.valid;
+        const uint32_t restarts = estimate_.restarts;
+        if (!estimator_.add(t1, t2, t3, t4)) {
+            continue;
+        }
+        estimate_ = estimator_.estimate();
+        if (!had_estimate) {
+            spdlog::info("Clock sync with {}: offset {:.3f} ms, rtt {:.2f} ms", destination_,
+                         estimate_.offset_ns / 1e6, estimate_.rtt_ns / 1e6);
+        } else if (estimate_.restarts != restarts) {
+            spdlog::warn("Clock sync: air clock jumped, estimate restarted");
+        }
+    }
+}
+
+void ClockSyncClient::run()
+{
+    uint32_t seq = 0;
+    uint64_t next_request = 0;
+    uint64_t next_log = monotonic_ns() + kLogIntervalNs;
+    while (running_) {
+        uint64_t now = monotonic_ns();
+        if (now >= next_request) {
+            uint8_t request[clock_sync::kRequestSize];
+            clock_sync::write_request(request, ++seq, now);
+            send(fd_, request, sizeof(request), 0);
+            next_request = now + interval_ns_;
+        }
+        pollfd pfd{fd_, POLLIN, 0};
+        const int timeout_ms = static_cast<int>((next_request - now) / 1000000) + 1;
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            drain(seq);
+        }
+        now = monotonic_ns();
+        if (now >= next_log) {
+            next_log = now + kLogIntervalNs;
+            const auto e = estimate();
+            if (e.valid) {
+                spdlog::debug("[clock] offset {:.3f} ms drift {:.1f} ppm rtt {:.2f} ms samples {}", e.offset_ns / 1e6,
+                              e.drift_ppm, e.rtt_ns / 1e6, e.samples);
+            } else {
+                spdlog::debug("[clock] no replies from {}", destination_);
+            }
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Air-to-ground clock exchange, NTP style. The ground sends a request stamped with its
+// CLOCK_MONOTONIC (t1); the air unit stamps its receive (t2) and send (t3) times in its
+// capture clock and echoes t1; the ground stamps the reply's arrival (t4). All fields
+// big-endian:
+//   request, ground -> air, 16 bytes: "CLK?" | seq (u32) | t1 (u64 ns, opaque to the air)
+//   reply,   air -> ground, 32 bytes: "CLK!" | seq (u32) | t1 (echoed) | t2 | t3
+// t2/t3 are 64-bit NTP format (Q32.32 seconds) of the clock the air unit stamps frames
+// with, the same as the capture time in the RTP header extension below. The air clock's
+// epoch does not matter, only that it is the one used for both.
+namespace clock_sync {
+
+constexpr size_t kRequestSize = 16;
+constexpr size_t kReplySize = 32;
+
+inline uint64_t read_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+inline void write_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; --i) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+inline uint64_t q32_to_ns(uint64_t q32)
+{
+    return (q32 >> 32) * 1000000000ull + (((q32 & 0xffffffffull) * 1000000000ull) >> 32);
+}
+
+inline uint64_t ns_to_q32(uint64_t ns)
+{
+    return (ns / 1000000000ull) << 32 | (((ns % 1000000000ull) << 32) / 1000000000ull);
+}
+
+inline void write_request(uint8_t *out, uint32_t seq, uint64_t t1_ns)
+{
+    std::memcpy(out, "CLK?", 4);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = static_cast<uint8_t>(seq >> (24 - 8 * i));
+    }
+    write_u64(out + 8, t1_ns);
+}
+
+// Air side: turns a request into its reply; false for anything that is not a request.
+// t3 should be taken as late as possible before the reply goes out.
+inline bool answer_request(const uint8_t *request, size_t size, uint64_t t2_ns, uint64_t t3_ns, uint8_t *reply)
+{
+    if (size < kRequestSize || std::memcmp(request, "CLK?", 4) != 0) {
+        return false;
+    }
+    std::memcpy(reply, "CLK!", 4);
+    std::memcpy(reply + 4, request + 4, 12);
+    write_u64(reply + 16, ns_to_q32(t2_ns));
+    write_u64(reply + 24, ns_to_q32(t3_ns));
+    return true;
+}
+
+// Capture time of the frame a video RTP packet belongs to, from an RFC 8285 header
+// extension element `id` (one- or two-byte form) laid out like abs-capture-time: the
+// first 8 bytes are the air unit's capture time in Q32.32 seconds. False when the packet
+// carries no such element.
+bool rtp_capture_time(const uint8_t *packet, size_t size, uint8_t id, uint64_t &air_ns);
+
+// Air side: the one-byte-form extension block (profile 0xBEDE, 16 bytes) carrying
+// `air_ns` as element `id` (1..14); goes right after the 12-byte header, with the X bit set.
+inline void write_capture_extension(uint8_t *out, uint8_t id, uint64_t air_ns)
+{
+    std::memset(out, 0, 16);
+    out[0] = 0xbe;
+    out[1] = 0xde;
+    out[3] = 3; // 32-bit words after this header
+    out[4] = static_cast<uint8_t>(id << 4 | (8 - 1));
+    write_u64(out + 5, ns_to_q32(air_ns));
+}
+
+} // namespace clock_sync
+
+// Offset and drift of the air unit's clock against ours from clock exchange samples.
+// The offset of a sample is off by at most half its round trip, so only the samples
+// with the shortest round trips in the window count: their offsets, fitted against
+// local time by least squares, give the drift, and the fit at the newest sample the
+// offset. An offset jump of more than a second (air unit rebooted) starts over.
+class ClockOffsetEstimator {
+public:
+    struct Estimate {
+        bool valid = false;
+        int64_t offset_ns = 0;  // air - ground at ref_ns
+        uint64_t ref_ns = 0;    // ground clock
+        double drift_ppm = 0.0; // air runs this much faster than ground
+        uint64_t rtt_ns = 0;    // shortest round trip in the window
+        uint32_t samples = 0;   // in the window
+        uint32_t restarts = 0;
+    };
+
+    explicit ClockOffsetEstimator(size_t window = 256) : window_(window < 4 ? 4 : window) {}
+
+    // t1/t4: ground clock, t2/t3: air clock, all ns. False for a sample that cannot be
+    // right (negative round trip).
+    bool add(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+    const Estimate &estimate() const { return estimate_; }
+
+    // Air time -> ground time; meaningless unless estimate.valid.
+    static uint64_t to_ground_ns(const Estimate &estimate, uint64_t air_ns);
+
+private:
+    struct Sample {
+        uint64_t local_ns; // midpoint of t1..t4
+        int64_t offset_ns;
+        uint64_t rtt_ns;
+    };
+
+    void refit();
+
+    size_t window_;
+    std::deque<Sample> samples_;
+    Estimate estimate_;
+};
+
+// Ground side of the exchange: a thread that sends a request every interval to the air
+// unit's "host:port" and feeds the replies to a ClockOffsetEstimator. Readable from any
+// thread.
+class ClockSyncClient {
+public:
+    explicit ClockSyncClient(uint32_t interval_ms = 250);
+    ~ClockSyncClient();
+    ClockSyncClient(const ClockSyncClient &) = delete;
+    ClockSyncClient &operator=(const ClockSyncClient &) = delete;
+
+    bool start(const std::string &destination);
+    void stop();
+    const std::string &destination() const { return destination_; }
+
+    ClockOffsetEstimator::Estimate estimate() const;
+    // Air capture time -> ground CLOCK_MONOTONIC; false while there is no estimate.
+    bool to_ground_ns(uint64_t air_ns, uint64_t &ground_ns) const;
+
+private:
+    void run();
+    void drain(uint32_t seq);
+
+    uint64_t interval_ns_;
+    int fd_{-1};
+    std::string destination_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    ClockOffsetEstimator estimator_;
+    ClockOffsetEstimator::Estimate estimate_;
+};
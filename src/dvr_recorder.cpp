@@ -84,7 +84,7 @@ void DvrRecorder::update_frame_rate(double fps)
     frame_duration_.store(duration, std::memory_order_relaxed);
 }
 
-void DvrRecorder::enqueue_frame(const std::shared_ptr<std::vector<uint8_t>> &frame)
+void DvrRecorder::enqueue_frame(const VideoFramePtr &frame)
 {
     if (!frame || !running_.load()) {
         return;
@@ -185,9 +185,16 @@ void DvrRecorder::worker_loop()
                 auto frame = ring_buffer_.pop();
                 if (!frame)
                     break;
-                auto duration = frame_duration_.load(std::memory_order_relaxed);
-                if (duration == 0)
-                    duration = kDefaultFrameDuration;
+                // A file starts at a keyframe: what comes before references pictures it does not have.
+                if (awaiting_keyframe_ && !frame->keyframe()) {
+                    ++skipped_before_keyframe_;
+                    continue;
+                }
+                if (awaiting_keyframe_) {
+                    awaiting_keyframe_ = false;
+                    spdlog::info("DVR file starts at a keyframe, {} frames skipped", skipped_before_keyframe_);
+                }
+                const uint32_t duration = sample_duration(*frame);
                 const int res = mp4_h26x_write_nal(writer_,
                                                    frame->data(),
                                                    static_cast<int>(frame->size()),
@@ -197,6 +204,7 @@ void DvrRecorder::worker_loop()
                     stop_requested_.store(true, std::memory_order_relaxed);
                     break;
                 }
+                frame->mark(VideoFrame::Stage::RECORDED);
                 if (rotate_requested_.load(std::memory_order_relaxed)) {
                     rotate_requested_.store(false, std::memory_order_relaxed);
                     if (!rotate_recording_file()) {
@@ -317,6 +325,8 @@ bool DvrRecorder::open_writer(bool mark_recording)
 
     mux_ = mux;
     writer_ready_ = true;
+    awaiting_keyframe_ = true;
+    skipped_before_keyframe_ = 0;
     current_file_bytes_.store(0, std::memory_order_relaxed);
     rotate_requested_.store(false, std::memory_order_relaxed);
     if (mark_recording) {
@@ -481,4 +491,40 @@ void DvrRecorder::reset_warmup_state()
     warmup_done_.store(false, std::memory_order_relaxed);
     warmup_start_ms_ = 0;
     warmup_frame_count_ = 0;
+    last_rx_ns_ = 0;
+    have_rtp_ts_ = false;
+}
+
+uint32_t DvrRecorder::sample_duration(const VideoFrame &frame)
+{
+    uint32_t duration = frame_duration_.load(std::memory_order_relaxed);
+    if (duration == 0)
+        duration = kDefaultFrameDuration;
+    const FrameMeta &meta = frame.meta();
+    if (meta.rtp_valid) {
+        // The sender's own 90 kHz clock: exact capture cadence, and a lost frame or a
+        // stalled link still shows up as a gap.
+        const uint32_t previous = last_rtp_ts_;
+        const bool have_previous = have_rtp_ts_;
+        last_rtp_ts_ = meta.rtp_timestamp;
+        have_rtp_ts_ = true;
+        const int32_t ticks = static_cast<int32_t>(meta.rtp_timestamp - previous);
+        if (!have_previous || ticks <= 0)
+            return duration;
+        return static_cast<uint32_t>(std::clamp<int32_t>(ticks, 375, 90000)); // 240fps..1fps
+    }
+    have_rtp_ts_ = false;
+    const FrameTiming &timing = meta.timing;
+    if (!timing.kernel) {
+        last_rx_ns_ = 0;
+        return duration;
+    }
+    // The gap to the previous frame's first packet, in 90 kHz ticks: free of decoder and
+    // recorder scheduling delays, and a stalled link shows up as a stall in the file.
+    const uint64_t previous = last_rx_ns_;
+    last_rx_ns_ = timing.first_rx_ns;
+    if (previous == 0 || timing.first_rx_ns <= previous)
+        return duration;
+    const uint64_t ticks = (timing.first_rx_ns - previous) * 9 / 100000;
+    return static_cast<uint32_t>(std::clamp<uint64_t>(ticks, 375, 90000)); // 240fps..1fps
 }
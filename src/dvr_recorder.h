@@ -25,7 +25,10 @@ public:
     void set_override_path(const std::string &path);
     void update_frame_rate(double fps);
 
-    void enqueue_frame(const std::shared_ptr<std::vector<uint8_t>> &frame);
+    // Sample durations follow the frames' RTP timestamps when the frame has them, else
+    // their arrival cadence with kernel timestamps, else the averaged frame rate. Every
+    // file starts at a keyframe.
+    void enqueue_frame(const VideoFramePtr &frame);
 
     void start_recording();
     void stop_recording();
@@ -46,12 +49,13 @@ private:
 
     struct Command {
         CommandType type;
-        std::shared_ptr<std::vector<uint8_t>> frame;
+        VideoFramePtr frame;
     };
 
     void worker_loop();
     void push_command(const Command &cmd);
     void reset_warmup_state();
+    uint32_t sample_duration(const VideoFrame &frame);
 
     bool open_writer(bool mark_recording);
     void close_writer(bool clear_recording);
@@ -75,6 +79,11 @@ private:
     uint32_t video_height_{0};
     uint32_t video_fps_hint_{0};
     std::atomic<uint32_t> frame_duration_{1500};
+    uint64_t last_rx_ns_{0}; // worker thread only
+    uint32_t last_rtp_ts_{0};
+    bool have_rtp_ts_{false};
+    bool awaiting_keyframe_{true};
+    uint64_t skipped_before_keyframe_{0};
     VideoCodec codec_{VideoCodec::H265};
     std::filesystem::path override_path_;
 
@@ -5,12 +5,14 @@
 #include <condition_variable>
 #include <vector>
 
+#include "video_frame.h"
+
 class FrameRingBuffer {
 public:
     explicit FrameRingBuffer(size_t capacity)
         : capacity_(capacity), buffer_(capacity) {}
 
-    void push(const std::shared_ptr<std::vector<uint8_t>> &frame)
+    void push(const VideoFramePtr &frame)
     {
         std::unique_lock<std::mutex> lock(mutex_);
         if (capacity_ == 0)
@@ -25,11 +27,11 @@ public:
         cv_.notify_one();
     }
 
-    std::shared_ptr<std::vector<uint8_t>> pop()
+    VideoFramePtr pop()
     {
         std::unique_lock<std::mutex> lock(mutex_);
         cv_.wait(lock, [&]{ return size_ > 0; });
-        auto frame = buffer_[head_];
+        auto frame = std::move(buffer_[head_]);
         head_ = (head_ + 1) % capacity_;
         --size_;
         return frame;
@@ -50,7 +52,7 @@ public:
 
 private:
     size_t capacity_;
-    std::vector<std::shared_ptr<std::vector<uint8_t>>> buffer_;
+    std::vector<VideoFramePtr> buffer_;
     size_t head_ = 0;
     size_t size_ = 0;
     mutable std::mutex mutex_;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <sys/socket.h>
+
+// When the packets of one frame reached this host, in CLOCK_REALTIME nanoseconds (the
+// clock SO_TIMESTAMPNS and TPACKET_V3 report in). With `kernel` set, first/last are the
+// kernel receive times of the earliest and latest packet; otherwise the ingest path had
+// no kernel timestamps and both are the time the frame left the receiver.
+struct FrameTiming {
+    uint64_t first_rx_ns = 0;
+    uint64_t last_rx_ns = 0;
+    uint64_t complete_ns = 0; // frame handed to the frame callback
+    bool kernel = false;
+    // When the air unit captured the frame, in its own clock (see clock_sync.h); 0 when
+    // the packets carry no capture time extension.
+    uint64_t capture_ns = 0;
+
+    void add_packet(uint64_t rx_ns)
+    {
+        if (rx_ns == 0) {
+            return;
+        }
+        if (!kernel || rx_ns < first_rx_ns) {
+            first_rx_ns = rx_ns;
+        }
+        if (!kernel || rx_ns > last_rx_ns) {
+            last_rx_ns = rx_ns;
+        }
+        kernel = true;
+    }
+
+    void add_capture(uint64_t air_ns)
+    {
+        if (air_ns && (!capture_ns || air_ns < capture_ns)) {
+            capture_ns = air_ns;
+        }
+    }
+};
+
+inline uint64_t realtime_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// The clock air-to-ground clock sync maps the air unit's capture times into.
+inline uint64_t monotonic_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Room for the SCM_TIMESTAMPNS control message in a recvmsg()/recvmmsg() msghdr.
+constexpr size_t kRxTimestampControlLen = CMSG_SPACE(sizeof(timespec));
+
+// Asks the kernel to stamp every datagram queued on `fd`.
+inline bool enable_rx_timestamps(int fd)
+{
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+// Kernel receive time of a message read with a kRxTimestampControlLen control buffer,
+// 0 when it carries none.
+inline uint64_t rx_timestamp_ns(const msghdr &msg)
+{
+    auto &m = const_cast<msghdr &>(msg);
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&m); cmsg; cmsg = CMSG_NXTHDR(&m, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts{};
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+        }
+    }
+    return 0;
+}
@@ -4,7 +4,22 @@
 //
 
 #include "gstrtpreceiver.h"
-#include "gst/gstparse.h"
+#include "uring_receiver.h"
+#include "packet_ring_receiver.h"
+#include "rtp_socket_filter.h"
+#include "rtp_depacketizer.h"
+#include "rtp_reorder_buffer.h"
+#include "rtp_diversity.h"
+#include "rtp_fec.h"
+#include "keyframe_requester.h"
+#include "rtcp_reporter.h"
+#include "rtp_impairment.h"
+#include "rtp_capture_ring.h"
+#include "rtp_router.h"
+#include "clock_sync.h"
+#include "scheduling_helper.hpp"
+#include "shm_packet_ring.h"
+#include "pcap_replay.h"
 #include "gst/gstpipeline.h"
 #include "gst/app/gstappsink.h"
 #include "gst/app/gstappsrc.h"
@@ -20,15 +35,72 @@
 #include <chrono>
 #include <cerrno>
 #include <array>
+#include <algorithm>
+#include <deque>
+#include <mutex>
 #include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <sys/un.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <netinet/in.h>
+#include <linux/filter.h>
 
 namespace pipeline
 {
+    // Every element factory the receivers use, looked up and loaded once after gst_init():
+    // the registry walk and plugin loading then happen at startup, not on each (re)start.
+    // The references are held for the life of the process.
+    static constexpr const char *kFactoryNames[] = {"udpsrc", "appsrc", "rtph264depay", "rtph265depay", "h264parse",
+                                                    "h265parse", "capsfilter", "appsink", "filesrc", "qtdemux"};
+    static GstElementFactory *g_factories[std::size(kFactoryNames)] = {};
+
+    static void preload_factories()
+    {
+        for (size_t i = 0; i < std::size(kFactoryNames); ++i)
+        {
+            GstElementFactory *factory = gst_element_factory_find(kFactoryNames[i]);
+            if (!factory)
+            {
+                spdlog::warn("GStreamer element '{}' not available", kFactoryNames[i]);
+                continue;
+            }
+            GstPluginFeature *loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(factory));
+            gst_object_unref(factory);
+            g_factories[i] = loaded ? GST_ELEMENT_FACTORY(loaded) : nullptr;
+        }
+    }
+
+    static GstElement *make(const char *factory_name, const char *name)
+    {
+        for (size_t i = 0; i < std::size(kFactoryNames); ++i)
+        {
+            if (g_factories[i] && !strcmp(kFactoryNames[i], factory_name))
+                return gst_element_factory_create(g_factories[i], name);
+        }
+        spdlog::error("Cannot create GStreamer element '{}'", factory_name);
+        return nullptr;
+    }
+
+    static GstCaps *rtp_caps(const VideoCodec &codec)
+    {
+        return gst_caps_from_string(codec == VideoCodec::H264
+                                        ? "application/x-rtp, media=(string)video, encoding-name=(string)H264, payload=(int)96"
+                                        : "application/x-rtp, media=(string)video, encoding-name=(string)H265, payload=(int)97, clock-rate=(int)90000");
+    }
+
+    static GstCaps *out_caps(const VideoCodec &codec, int alignment)
+    {
+        GstCaps *caps = gst_caps_from_string(codec == VideoCodec::H264 ? "video/x-h264, stream-format=(string)byte-stream"
+                                                                       : "video/x-h265, stream-format=(string)byte-stream");
+        gst_caps_set_simple(caps, "alignment", G_TYPE_STRING, alignment == 1 ? "nal" : "au", NULL);
+        return caps;
+    }
+
+    // The functions below give the gst-launch equivalent of what the builders link up,
+    // for the log and for reproducing a pipeline by hand.
     static std::string gst_create_rtp_caps(const VideoCodec &videoCodec)
     {
         std::stringstream ss;
@@ -93,12 +165,99 @@ static void initGstreamerOrThrow()
         g_error_free(error);
         throw std::runtime_error("GStreamer initialization failed");
     }
+    static std::once_flag factories_loaded;
+    std::call_once(factories_loaded, pipeline::preload_factories);
+}
+
+/* Where audio payloads go. Attached and detached while the readers run (sound=1/0), so
+ * audio comes and goes without touching the video path: readers only take the lock for
+ * audio packets, and set() returns once none of them is inside the previous callback. */
+class AudioTap
+{
+public:
+    void set(GstRtpReceiver::AUDIO_PAYLOAD_CALLBACK cb)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cb = std::move(cb);
+        m_active.store(static_cast<bool>(m_cb), std::memory_order_release);
+    }
+
+    bool active() const { return m_active.load(std::memory_order_acquire); }
+
+    // RTP packet in; its payload goes to the callback, if one is attached.
+    void deliver(const uint8_t *packet, size_t size) const
+    {
+        size_t offset = 0, payload_size = 0;
+        if (!active() || !rtp_payload(packet, size, offset, payload_size))
+            return;
+        auto payload = std::make_shared<std::vector<uint8_t>>(packet + offset, packet + offset + payload_size);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cb)
+            m_cb(payload);
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    GstRtpReceiver::AUDIO_PAYLOAD_CALLBACK m_cb;
+    std::atomic<bool> m_active{false};
+};
+
+/* A stream or file playback pipeline built from the cached factories and linked by hand.
+ * It outlives stop_receiving(): going to NULL closes the sockets and resets depayloader,
+ * parser and appsink, while the elements, links, probes and the appsrc buffer pool stay,
+ * so the next start is a state change rather than a parse and build. It is rebuilt only
+ * when its shape changes. */
+class CachedPipeline
+{
+public:
+    struct Shape
+    {
+        VideoCodec codec = VideoCodec::UNKNOWN;
+        bool file = false;
+        bool appsrc = false;
+        int port = 0;
+        int alignment = 0;
+        bool appsink_drop = true;
+        int appsink_max_buffers = 0;
+        bool appsink_callbacks = false;
+        int recv_batch = 0;
+        RtpCaptureRing *capture = nullptr;
+
+        bool operator==(const Shape &o) const
+        {
+            return codec == o.codec && file == o.file && appsrc == o.appsrc && port == o.port &&
+                   alignment == o.alignment && appsink_drop == o.appsink_drop &&
+                   appsink_max_buffers == o.appsink_max_buffers && appsink_callbacks == o.appsink_callbacks &&
+                   recv_batch == o.recv_batch && capture == o.capture;
+        }
+    };
+
+    explicit CachedPipeline(const Shape &shape);
+    ~CachedPipeline();
+    CachedPipeline(const CachedPipeline &) = delete;
+    CachedPipeline &operator=(const CachedPipeline &) = delete;
+
+    const Shape shape;
+    GstElement *pipeline = nullptr;
+    GstElement *source = nullptr; // udpsrc, appsrc or filesrc
+    GstElement *appsink = nullptr;
+    std::unique_ptr<AppsinkHandoffStats> handoff;
+};
+
+static std::unique_ptr<RtpRouter> make_default_router(VideoCodec codec)
+{
+    auto router = std::make_unique<RtpRouter>();
+    std::string error;
+    router->apply(codec == VideoCodec::H264 ? "96=video,98=audio" : "97=video,98=audio", error);
+    return router;
 }
 
 GstRtpReceiver::GstRtpReceiver(int udp_port, const VideoCodec &codec)
 {
     m_port = udp_port;
     m_video_codec = codec;
+    m_router = make_default_router(codec);
+    m_audio_tap = std::make_unique<AudioTap>();
     initGstreamerOrThrow();
 }
 
@@ -106,6 +265,8 @@ GstRtpReceiver::GstRtpReceiver(const char *s, const VideoCodec &codec)
 {
     unix_socket = strdup(s);
     m_video_codec = codec;
+    m_router = make_default_router(codec);
+    m_audio_tap = std::make_unique<AudioTap>();
     initGstreamerOrThrow();
 
     spdlog::debug("Creating receiver socket on {}", unix_socket);
@@ -146,6 +307,13 @@ GstRtpReceiver::~GstRtpReceiver()
     }
 }
 
+static uint64_t monotonic_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 static uint64_t monotonic_ms()
 {
     return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -155,27 +323,332 @@ static uint64_t monotonic_ms()
 
 static std::atomic<uint64_t> g_sample_counter{0};
 
-static std::shared_ptr<std::vector<uint8_t>> gst_copy_buffer(GstBuffer *buffer)
+static GstCaps *unix_time_caps()
+{
+    static GstCaps *caps = gst_caps_new_empty_simple("timestamp/x-unix");
+    return caps;
+}
+
+/* Kernel receive time of an appsrc packet, as a reference timestamp meta: rtph26Xdepay
+ * and h26Xparse carry untagged metas over to the access unit that reaches the appsink. */
+static void stamp_rx_time(GstBuffer *buffer, uint64_t rx_ns)
+{
+    if (rx_ns)
+        gst_buffer_add_reference_timestamp_meta(buffer, unix_time_caps(), rx_ns, GST_CLOCK_TIME_NONE);
+}
+
+static GstCaps *air_capture_caps()
+{
+    static GstCaps *caps = gst_caps_new_empty_simple("timestamp/x-air-capture");
+    return caps;
+}
+
+/* Capture time from the packet's header extension (air unit clock), carried the same way. */
+static void stamp_capture_time(GstBuffer *buffer, uint64_t capture_ns)
+{
+    if (capture_ns)
+        gst_buffer_add_reference_timestamp_meta(buffer, air_capture_caps(), capture_ns, GST_CLOCK_TIME_NONE);
+}
+
+/* udpsrc path: the appsrc readers record in ingress(); here a probe on udpsrc's output
+ * does it, on the streaming thread, with the time it saw the buffer. */
+static void attach_capture_probe(GstElement *udpsrc, RtpCaptureRing *ring)
+{
+    GstPad *pad = gst_element_get_static_pad(udpsrc, "src");
+    if (!pad)
+        return;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *, GstPadProbeInfo *info, gpointer user_data) -> GstPadProbeReturn
+                      {
+        GstMapInfo map;
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            static_cast<RtpCaptureRing *>(user_data)->record(map.data, map.size, 0);
+            gst_buffer_unmap(buffer, &map);
+        }
+        return GST_PAD_PROBE_OK; }, ring, nullptr);
+    gst_object_unref(pad);
+}
+
+/* udpsrc path: while an audio tap is attached, a probe on udpsrc's output takes the
+ * packets routed to audio out before the depayloader. It is there from the start, so
+ * sound=1/0 never touches the pipeline; without a tap it returns before mapping. */
+static void attach_audio_probe(GstElement *udpsrc, const RtpRouter &router, const AudioTap &audio_tap)
+{
+    struct Context
+    {
+        const RtpRouter &router;
+        const AudioTap &audio_tap;
+    };
+    GstPad *pad = gst_element_get_static_pad(udpsrc, "src");
+    if (!pad)
+        return;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *, GstPadProbeInfo *info, gpointer user_data) -> GstPadProbeReturn
+                      {
+        const auto *context = static_cast<const Context *>(user_data);
+        if (!context->audio_tap.active())
+            return GST_PAD_PROBE_OK;
+        GstMapInfo map;
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+            return GST_PAD_PROBE_OK;
+        bool audio;
+        {
+            const RtpRouter::ReadSection section(context->router);
+            audio = context->router.route(map.data, map.size).route == RtpRoute::AUDIO;
+        }
+        if (audio)
+            context->audio_tap.deliver(map.data, map.size);
+        gst_buffer_unmap(buffer, &map);
+        return audio ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK; },
+                      new Context{router, audio_tap}, [](gpointer data)
+                      { delete static_cast<Context *>(data); });
+    gst_object_unref(pad);
+}
+
+static FrameTiming sample_timing(GstBuffer *buffer)
+{
+    FrameTiming timing;
+    gpointer state = nullptr;
+    while (GstMeta *meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_REFERENCE_TIMESTAMP_META_API_TYPE))
+    {
+        const auto *ref = reinterpret_cast<GstReferenceTimestampMeta *>(meta);
+        if (gst_caps_is_equal(ref->reference, unix_time_caps()))
+            timing.add_packet(ref->timestamp);
+        else if (gst_caps_is_equal(ref->reference, air_capture_caps()))
+            timing.add_capture(ref->timestamp);
+    }
+    timing.complete_ns = realtime_ns();
+    if (!timing.kernel)
+        timing.first_rx_ns = timing.last_rx_ns = timing.complete_ns;
+    return timing;
+}
+
+/* appsink hand-off latency: time from a frame reaching the appsink's sink pad to the
+ * frame callback, i.e. what the pull thread (or the new-sample callback) adds. */
+class AppsinkHandoffStats
+{
+public:
+    explicit AppsinkHandoffStats(const char *mode) : m_mode(mode), m_window_start_us(monotonic_us()) {}
+
+    void attach(GstElement *appsink)
+    {
+        GstPad *pad = gst_element_get_static_pad(appsink, "sink");
+        if (!pad)
+            return;
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, [](GstPad *, GstPadProbeInfo *info, gpointer user_data) -> GstPadProbeReturn
+                          {
+            static_cast<AppsinkHandoffStats *>(user_data)->on_arrival(GST_PAD_PROBE_INFO_BUFFER(info));
+            return GST_PAD_PROBE_OK; }, this, nullptr);
+        gst_object_unref(pad);
+    }
+
+    void on_delivery(GstBuffer *buffer)
+    {
+        const uint64_t now = monotonic_us();
+        uint64_t arrival_us = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Frames dropped by a leaky appsink never show up here; skip past them.
+            while (!m_arrivals.empty())
+            {
+                const auto arrival = m_arrivals.front();
+                m_arrivals.pop_front();
+                if (arrival.first == buffer)
+                {
+                    arrival_us = arrival.second;
+                    break;
+                }
+            }
+        }
+        if (arrival_us)
+        {
+            const uint64_t delay = now - arrival_us;
+            m_sum_us += delay;
+            m_max_us = std::max(m_max_us, delay);
+            ++m_frames;
+        }
+        if (now - m_window_start_us < 1000000)
+            return;
+        if (m_frames)
+            spdlog::debug("[appsink] {} hand-off (sink pad -> frame callback) avg {} us max {} us over {} frames",
+                          m_mode, m_sum_us / m_frames, m_max_us, m_frames);
+        m_window_start_us = now;
+        m_sum_us = 0;
+        m_max_us = 0;
+        m_frames = 0;
+    }
+
+private:
+    void on_arrival(GstBuffer *buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_arrivals.size() >= 64)
+            m_arrivals.pop_front();
+        m_arrivals.emplace_back(buffer, monotonic_us());
+    }
+
+    const char *m_mode;
+    std::mutex m_mutex;
+    std::deque<std::pair<GstBuffer *, uint64_t>> m_arrivals;
+    uint64_t m_window_start_us;
+    uint64_t m_sum_us = 0;
+    uint64_t m_max_us = 0;
+    uint64_t m_frames = 0;
+};
+
+CachedPipeline::CachedPipeline(const Shape &shape) : shape(shape) {}
+
+CachedPipeline::~CachedPipeline()
+{
+    if (!pipeline)
+        return;
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+}
+
+/* Adds `elements` to a new pipeline; nullptr (with every element released) when one of
+ * them could not be created. */
+static GstElement *assemble_pipeline(const char *name, std::initializer_list<GstElement *> elements)
+{
+    const bool complete = std::find(elements.begin(), elements.end(), nullptr) == elements.end();
+    if (!complete)
+    {
+        for (GstElement *element : elements)
+        {
+            if (element)
+                gst_object_unref(gst_object_ref_sink(element));
+        }
+        return nullptr;
+    }
+    GstElement *pipeline = gst_pipeline_new(name);
+    for (GstElement *element : elements)
+        gst_bin_add(GST_BIN(pipeline), element);
+    return pipeline;
+}
+
+static void set_caps_property(GstElement *element, GstCaps *caps)
+{
+    g_object_set(element, "caps", caps, NULL);
+    gst_caps_unref(caps);
+}
+
+static void setup_appsrc_buffer_pool(GstElement *appsrc, VideoCodec video_codec, int recv_batch);
+
+/* udpsrc|appsrc ! rtph26Xdepay ! h26Xparse ! capsfilter ! appsink, with the udpsrc probes
+ * (capture ring, audio tap) or the appsrc buffer pool in place. */
+static std::unique_ptr<CachedPipeline> build_stream_pipeline(const CachedPipeline::Shape &shape,
+                                                             const RtpRouter &router, const AudioTap &audio_tap)
+{
+    constexpr int kUdpSocketBuffer = 5 * 1024 * 1024; // match Digi's 5MB buffer
+    const bool h264 = shape.codec == VideoCodec::H264;
+    GstElement *source = pipeline::make(shape.appsrc ? "appsrc" : "udpsrc", shape.appsrc ? "appsrc" : "udpsrc");
+    GstElement *depay = pipeline::make(h264 ? "rtph264depay" : "rtph265depay", "depay");
+    GstElement *parse = pipeline::make(h264 ? "h264parse" : "h265parse", "parse");
+    GstElement *capsfilter = pipeline::make("capsfilter", "out_caps");
+    GstElement *appsink = pipeline::make("appsink", "out_appsink");
+    auto built = std::make_unique<CachedPipeline>(shape);
+    built->pipeline = assemble_pipeline("stream", {source, depay, parse, capsfilter, appsink});
+    if (!built->pipeline)
+        return nullptr;
+    built->source = source;
+    built->appsink = appsink;
+
+    set_caps_property(source, pipeline::rtp_caps(shape.codec));
+    if (shape.appsrc)
+    {
+        g_object_set(source,
+                     "stream-type", 0,
+                     "is-live", TRUE,
+                     "format", GST_FORMAT_TIME,
+                     "block", FALSE,
+                     "do-timestamp", TRUE,
+                     NULL);
+        setup_appsrc_buffer_pool(source, shape.codec, shape.recv_batch);
+    }
+    else
+    {
+        g_object_set(source, "buffer-size", kUdpSocketBuffer, "port", shape.port, NULL);
+    }
+    // config-interval=-1 = makes 100% sure each keyframe has SPS and PPS
+    g_object_set(parse, "config-interval", -1, NULL);
+    set_caps_property(capsfilter, pipeline::out_caps(shape.codec, shape.alignment));
+    g_object_set(appsink, "drop", shape.appsink_drop ? TRUE : FALSE, NULL);
+    if (shape.appsink_max_buffers > 0)
+        g_object_set(appsink, "max-buffers", static_cast<guint>(shape.appsink_max_buffers), NULL);
+
+    if (!gst_element_link_many(source, depay, parse, capsfilter, appsink, NULL))
+    {
+        spdlog::error("Cannot link the stream pipeline");
+        return nullptr;
+    }
+    if (!shape.appsrc)
+    {
+        if (shape.capture)
+            attach_capture_probe(source, shape.capture);
+        attach_audio_probe(source, router, audio_tap);
+    }
+    built->handoff = std::make_unique<AppsinkHandoffStats>(shape.appsink_callbacks ? "callback" : "pull");
+    built->handoff->attach(appsink);
+    return built;
+}
+
+/* qtdemux exposes its pads once it has read the file header; the video one goes to the parser. */
+static void on_demux_pad_added(GstElement *, GstPad *pad, gpointer parse)
+{
+    gchar *name = gst_pad_get_name(pad);
+    const bool video = g_str_has_prefix(name, "video_");
+    g_free(name);
+    if (!video)
+        return;
+    GstPad *sink = gst_element_get_static_pad(GST_ELEMENT(parse), "sink");
+    if (sink && !gst_pad_is_linked(sink) && gst_pad_link(pad, sink) != GST_PAD_LINK_OK)
+        spdlog::warn("Cannot link the recording's video track to the parser");
+    if (sink)
+        gst_object_unref(sink);
+}
+
+/* filesrc ! qtdemux ! h26Xparse ! capsfilter ! appsink; the location is set per playback. */
+static std::unique_ptr<CachedPipeline> build_file_pipeline(const CachedPipeline::Shape &shape)
 {
-    assert(buffer);
-    const auto buff_size = gst_buffer_get_size(buffer);
-    auto ret = std::make_shared<std::vector<uint8_t>>(buff_size);
-    GstMapInfo map;
-    gst_buffer_map(buffer, &map, GST_MAP_READ);
-    assert(map.size == buff_size);
-    std::memcpy(ret->data(), map.data, buff_size);
-    gst_buffer_unmap(buffer, &map);
-    return ret;
+    const bool h264 = shape.codec == VideoCodec::H264;
+    GstElement *source = pipeline::make("filesrc", "filesrc");
+    GstElement *demux = pipeline::make("qtdemux", "demux");
+    GstElement *parse = pipeline::make(h264 ? "h264parse" : "h265parse", "parse");
+    GstElement *capsfilter = pipeline::make("capsfilter", "out_caps");
+    GstElement *appsink = pipeline::make("appsink", "out_appsink");
+    auto built = std::make_unique<CachedPipeline>(shape);
+    built->pipeline = assemble_pipeline("file-playback", {source, demux, parse, capsfilter, appsink});
+    if (!built->pipeline)
+        return nullptr;
+    built->source = source;
+    built->appsink = appsink;
+
+    g_object_set(parse, "config-interval", -1, NULL);
+    set_caps_property(capsfilter, pipeline::out_caps(shape.codec, shape.alignment));
+    g_object_set(appsink, "drop", TRUE, NULL);
+    if (!gst_element_link(source, demux) || !gst_element_link_many(parse, capsfilter, appsink, NULL))
+    {
+        spdlog::error("Cannot link the file playback pipeline");
+        return nullptr;
+    }
+    g_signal_connect(demux, "pad-added", G_CALLBACK(on_demux_pad_added), parse);
+    return built;
 }
 
-static void loop_pull_appsink_samples(bool &keep_looping, GstElement *app_sink_element,
-                                      const GstRtpReceiver::NEW_FRAME_CALLBACK out_cb)
+static void loop_pull_appsink_samples(bool &keep_looping, GstElement *app_sink_element, VideoCodec codec,
+                                      const GstRtpReceiver::VIDEO_FRAME_CALLBACK out_cb,
+                                      AppsinkHandoffStats *handoff)
 {
     assert(app_sink_element);
     assert(out_cb);
     const uint64_t timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::milliseconds(100)).count();
     auto last_sample_time = std::chrono::steady_clock::now();
     auto last_idle_log = last_sample_time;
+    auto copy_window_start = last_sample_time;
+    uint64_t window_frames = 0;
+    uint64_t window_bytes = 0;
+    uint64_t copied_start = VideoFrame::bytes_copied();
     while (keep_looping)
     {
         // GstSample* sample = nullptr;
@@ -193,10 +666,27 @@ static void loop_pull_appsink_samples(bool &keep_looping, GstElement *app_sink_e
                 last_sample_time = now;
 
                 last_idle_log = now;
-                auto buff_copy = gst_copy_buffer(buffer);
+                // The frame holds its own reference on the mapped buffer: no copy here.
+                auto frame = VideoFrame::wrap(buffer, codec, sample_timing(buffer));
                 spdlog::debug("[appsink] seq={} size={} bytes  delta={} ms",
                               seq, raw_size, delta_ms);
-                out_cb(buff_copy);
+                if (handoff)
+                    handoff->on_delivery(buffer);
+                if (frame)
+                    out_cb(std::move(frame));
+                ++window_frames;
+                window_bytes += raw_size;
+                if (now - copy_window_start >= std::chrono::seconds(1))
+                {
+                    // Copies left are the ones made for NEW_FRAME_CALLBACK consumers.
+                    const uint64_t copied = VideoFrame::bytes_copied() - copied_start;
+                    spdlog::debug("[appsink] frames/s {} avg frame {} bytes, copied {} bytes/frame",
+                                  window_frames, window_bytes / window_frames, copied / window_frames);
+                    copy_window_start = now;
+                    window_frames = 0;
+                    window_bytes = 0;
+                    copied_start = VideoFrame::bytes_copied();
+                }
             }
             gst_sample_unref(sample);
         }
@@ -247,17 +737,48 @@ static int create_udp_socket(int port, int rcvbuf, bool reuse, uint8_t payload_t
         return -1;
     }
 
+    if (!enable_rx_timestamps(fd))
+        spdlog::debug("SO_TIMESTAMPNS unavailable on UDP {}: {}", port, strerror(errno));
+
     (void)payload_type;
     return fd;
 }
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+/* SO_BUSY_POLL: blocking and non-blocking reads poll the NIC queue for up to `us` before
+ * sleeping; SO_PREFER_BUSY_POLL (5.11+) keeps softirq processing off this queue while we do.
+ * Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN. */
+static void enable_busy_poll(int fd, uint32_t us)
+{
+    const int busy_us = static_cast<int>(std::min<uint32_t>(us, 100000));
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_us, sizeof(busy_us)) < 0)
+        spdlog::warn("SO_BUSY_POLL {} us failed: {}", busy_us, strerror(errno));
+    const int prefer = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0)
+        spdlog::warn("SO_PREFER_BUSY_POLL failed: {}", strerror(errno));
+    spdlog::info("Busy poll: spin up to {} us before blocking", us);
+}
+
+static void drop_all_datagrams(int fd)
+{
+    sock_filter drop_all[] = {{BPF_RET | BPF_K, 0, 0, 0}};
+    sock_fprog prog{};
+    prog.len = 1;
+    prog.filter = drop_all;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+        spdlog::warn("SO_ATTACH_FILTER on UDP socket failed: {}", strerror(errno));
+}
+
 std::string GstRtpReceiver::construct_gstreamer_pipeline()
 {
     std::stringstream ss;
-    if (!unix_socket && !m_udp_appsrc)
+    if (!uses_appsrc())
     {
         constexpr int kUdpSocketBuffer = 5 * 1024 * 1024; // match Digi's 5MB buffer
-        ss << "udpsrc buffer-size=" << kUdpSocketBuffer << " port=" << m_port << " "
+        ss << "udpsrc name=udpsrc buffer-size=" << kUdpSocketBuffer << " port=" << m_port << " "
            << pipeline::gst_create_rtp_caps(m_video_codec) << " ! ";
     }
     else
@@ -265,7 +786,10 @@ std::string GstRtpReceiver::construct_gstreamer_pipeline()
     ss << pipeline::create_rtp_depacketize_for_codec(m_video_codec);
     ss << pipeline::create_parse_for_codec(m_video_codec);
     ss << pipeline::create_out_caps(m_video_codec, m_alignment);
-    ss << " appsink drop=true name=out_appsink";
+    ss << " appsink drop=" << (m_appsink_drop ? "true" : "false");
+    if (m_appsink_max_buffers > 0)
+        ss << " max-buffers=" << m_appsink_max_buffers;
+    ss << " name=out_appsink";
     return ss.str();
 }
 
@@ -276,7 +800,10 @@ void GstRtpReceiver::set_udp_appsrc(bool enable)
 
 void GstRtpReceiver::set_audio_payload_callback(AUDIO_PAYLOAD_CALLBACK cb)
 {
-    m_audio_cb = std::move(cb);
+    const bool enable = static_cast<bool>(cb);
+    m_audio_tap->set(std::move(cb));
+    if (m_streaming)
+        spdlog::info("Audio tap {} on the running stream", enable ? "attached" : "detached");
 }
 
 void GstRtpReceiver::set_alignment(int alignment)
@@ -284,22 +811,278 @@ void GstRtpReceiver::set_alignment(int alignment)
     m_alignment = alignment;
 }
 
+void GstRtpReceiver::set_ingest_backend(IngestBackend backend)
+{
+    m_ingest_backend = backend;
+}
+
+void GstRtpReceiver::set_packet_ring_interface(const std::string &iface)
+{
+    m_packet_ring_iface = iface;
+}
+
+void GstRtpReceiver::set_shm_ring_name(const std::string &name)
+{
+    m_shm_ring_name = name;
+}
+
+void GstRtpReceiver::set_replay_source(const std::string &path, double speed, uint32_t loops)
+{
+    m_replay_path = path;
+    m_replay_speed = std::max(speed, 0.0);
+    m_replay_loops = loops;
+}
+
+void GstRtpReceiver::set_busy_poll(uint32_t spin_us, int reader_cpu)
+{
+    m_busy_poll_us = spin_us;
+    m_reader_cpu = reader_cpu;
+}
+
+void GstRtpReceiver::set_loss_policy(LossPolicy policy)
+{
+    m_loss_policy = policy;
+}
+
+void GstRtpReceiver::set_keyframe_requests(const std::string &destination, KeyframeRequestFormat format,
+                                           uint32_t min_interval_ms)
+{
+    m_keyframe_requester.reset();
+    if (destination.empty())
+        return;
+    auto requester = std::make_unique<KeyframeRequester>(format, min_interval_ms);
+    if (!requester->open(destination))
+        return;
+    spdlog::info("Keyframe requests ({}) to {}, at most every {} ms",
+                 format == KeyframeRequestFormat::TEXT ? "text" : "RTCP PLI", destination, min_interval_ms);
+    m_keyframe_requester = std::move(requester);
+}
+
+void GstRtpReceiver::set_receiver_reports(const std::string &destination, uint32_t interval_ms)
+{
+    m_rtcp_reporter.reset();
+    m_rtcp_interval_ms = interval_ms;
+    if (destination.empty())
+        return;
+    auto reporter = std::make_unique<RtcpReporter>(90000, interval_ms, m_report_cb);
+    if (!reporter->open(destination))
+        return;
+    spdlog::info("RTCP receiver reports to {} every {} ms", destination, interval_ms);
+    m_rtcp_reporter = std::move(reporter);
+}
+
+void GstRtpReceiver::set_reception_report_callback(RECEPTION_REPORT_CALLBACK cb)
+{
+    m_report_cb = cb;
+    const std::string destination = m_rtcp_reporter ? m_rtcp_reporter->destination() : std::string();
+    m_rtcp_reporter.reset();
+    if (!destination.empty())
+    {
+        set_receiver_reports(destination, m_rtcp_interval_ms);
+        return;
+    }
+    // Statistics only, nothing goes on the wire.
+    if (m_report_cb)
+        m_rtcp_reporter = std::make_unique<RtcpReporter>(90000, m_rtcp_interval_ms, m_report_cb);
+}
+
+void GstRtpReceiver::set_capture_ring(RtpCaptureRing *ring)
+{
+    m_capture_ring = ring;
+}
+
+bool GstRtpReceiver::set_routes(const std::string &spec)
+{
+    if (spec.empty())
+        return true;
+    const auto filtered = m_router->payload_types();
+    const bool udpsrc_running = m_streaming && !uses_appsrc() && !m_native_depay;
+    std::string error;
+    if (!m_router->apply(spec, error))
+    {
+        spdlog::error("Bad route spec '{}': {}", spec, error);
+        return false;
+    }
+    m_custom_routes = true;
+    spdlog::info("RTP routes: {}", m_router->describe());
+    if (udpsrc_running)
+        spdlog::warn("udpsrc pipeline running, routes apply once the stream restarts on the socket reader");
+    else if (m_video_filter && m_video_filter->attached() && m_router->payload_types() != filtered)
+        spdlog::warn("The kernel RTP filter keeps its payload types until the stream restarts");
+    return true;
+}
+
+std::string GstRtpReceiver::describe_routes() const
+{
+    return m_router->describe();
+}
+
+void GstRtpReceiver::set_telemetry_callback(TELEMETRY_CALLBACK cb)
+{
+    // The reader calls it without a lock; swapping it under a running reader is a data race.
+    if (m_read_socket_thread)
+    {
+        spdlog::warn("Telemetry callback can only be set before start_receiving(), ignored");
+        return;
+    }
+    m_router->set_telemetry_callback(std::move(cb));
+}
+
+bool GstRtpReceiver::set_impairment(const std::string &spec)
+{
+    m_impairment.reset();
+    if (spec.empty())
+        return true;
+    auto config = std::make_unique<ImpairmentConfig>();
+    if (!ImpairmentConfig::parse(spec, *config))
+    {
+        spdlog::error("Bad impairment spec '{}'", spec);
+        return false;
+    }
+    if (!config->enabled())
+        return true;
+    spdlog::warn("Network impairment enabled on ingest: {}", config->describe());
+    m_impairment = std::move(config);
+    return true;
+}
+
+void GstRtpReceiver::prepare_reader_thread()
+{
+    pthread_setname_np(pthread_self(), "socket-reader");
+    if (m_reader_cpu >= 0)
+        SchedulingHelper::set_thread_affinity("socket-reader", m_reader_cpu);
+}
+
+void GstRtpReceiver::set_socket_filter(SocketFilterMode mode)
+{
+    m_socket_filter = mode;
+}
+
+void GstRtpReceiver::set_native_depacketizer(bool enable)
+{
+    m_native_depay = enable;
+}
+
+void GstRtpReceiver::set_reorder_window_us(uint32_t window_us)
+{
+    m_reorder_window_us = window_us;
+}
+
+void GstRtpReceiver::set_diversity_ports(const std::vector<int> &ports)
+{
+    m_diversity_ports.clear();
+    for (int port : ports)
+    {
+        if (port != m_port && m_diversity_ports.size() + 1 < RtpDiversityMerger::kMaxInputs)
+            m_diversity_ports.push_back(port);
+    }
+}
+
+void GstRtpReceiver::set_fec_payload_type(int pt)
+{
+    m_fec_pt = static_cast<uint8_t>(std::clamp(pt, 0, 127));
+    m_router->reserve_payload_type(m_fec_pt);
+}
+
+void GstRtpReceiver::check_fec_payload_type()
+{
+    // Routes win over the FEC stage: parity on a routed payload type would reach that
+    // handler (video: the depayloader) as media.
+    if (m_fec_pt == 0)
+        return;
+    const RtpRoute route = m_router->pt_route(m_fec_pt);
+    if (route == RtpRoute::DROP)
+        return;
+    spdlog::error("FEC payload type {} is routed to {}, FEC disabled", m_fec_pt, RtpRouter::route_name(route));
+    m_fec_pt = 0;
+    m_router->reserve_payload_type(0);
+}
+
+void GstRtpReceiver::set_capture_time_extension(int id)
+{
+    if (id < 0 || id > 14)
+    {
+        spdlog::warn("Capture time extension id {} out of range (1..14, 0 = off), ignored", id);
+        id = 0;
+    }
+    m_capture_ext_id = static_cast<uint8_t>(id);
+}
+
+bool GstRtpReceiver::uses_appsrc() const
+{
+    return unix_socket || m_udp_appsrc || m_ingest_backend != IngestBackend::UDPSRC ||
+           m_socket_filter != SocketFilterMode::OFF || m_reorder_window_us > 0 ||
+           !m_diversity_ports.empty() || m_busy_poll_us > 0 || m_fec_pt != 0 || m_rtcp_reporter || m_impairment ||
+           m_custom_routes || m_capture_ext_id != 0;
+}
+
+void GstRtpReceiver::set_appsink_callbacks(bool enable)
+{
+    m_appsink_callbacks = enable;
+}
+
+void GstRtpReceiver::set_appsink_queue(int max_buffers, bool drop)
+{
+    m_appsink_max_buffers = std::max(0, max_buffers);
+    m_appsink_drop = drop;
+}
+
+void GstRtpReceiver::set_recv_batch(int batch)
+{
+    m_recv_batch = std::clamp(batch, 0, MAX_RECV_BATCH);
+}
+
 void GstRtpReceiver::loop_pull_samples()
 {
     assert(m_app_sink_element);
-    auto cb = [this](std::shared_ptr<std::vector<uint8_t>> sample)
+    auto cb = [this](VideoFramePtr frame)
     {
-        this->on_new_sample(sample);
+        this->on_new_sample(std::move(frame));
     };
-    loop_pull_appsink_samples(m_pull_samples_run, m_app_sink_element, cb);
+    loop_pull_appsink_samples(m_pull_samples_run, m_app_sink_element, m_video_codec, cb, m_handoff_stats);
+}
+
+void GstRtpReceiver::mark_restart()
+{
+    m_start_us = monotonic_us();
+    m_first_frame_pending = true;
 }
 
-void GstRtpReceiver::on_new_sample(std::shared_ptr<std::vector<uint8_t>> sample)
+void GstRtpReceiver::on_new_sample(VideoFramePtr frame)
 {
+    const uint64_t now = monotonic_us();
+    if (m_first_frame_pending.exchange(false))
+        spdlog::info("First frame {:.1f} ms after the (re)start ({} pipeline)", (now - m_start_us) / 1000.0, m_start_kind);
+    if (m_keyframe_requester && m_streaming)
+        m_keyframe_requester->on_frame(*frame, now);
+    const bool admit = m_loss_gate.admit(frame->incomplete(), frame->keyframe(), now);
+    if (now - m_loss_window_start_us >= 1000000)
+    {
+        const auto s = m_loss_gate.take_stats();
+        if (s.incomplete || s.dropped_until_irap || s.recoveries)
+            spdlog::debug("[loss] policy {} frames {} incomplete {} forwarded partial {} dropped frame {} "
+                          "dropped until IRAP {} recoveries {} avg {} ms max {} ms",
+                          loss_policy_name(m_loss_gate.policy()), s.frames, s.incomplete, s.forwarded_partial,
+                          s.dropped_frame, s.dropped_until_irap, s.recoveries,
+                          s.recoveries ? s.recovery_us_sum / s.recoveries / 1000 : 0, s.recovery_us_max / 1000);
+        if (m_keyframe_requester)
+        {
+            const auto k = m_keyframe_requester->take_stats();
+            if (k.requests || k.turnarounds)
+                spdlog::debug("[keyframe] requests to {} {} suppressed {} request -> IDR {} avg {} ms max {} ms",
+                              m_keyframe_requester->destination(), k.requests, k.suppressed, k.turnarounds,
+                              k.turnarounds ? k.turnaround_us_sum / k.turnarounds / 1000 : 0,
+                              k.turnaround_us_max / 1000);
+        }
+        m_loss_window_start_us = now;
+    }
+    // Empty frames only report an access unit the depacketizer lost completely.
+    if (!admit || frame->size() == 0)
+        return;
     if (m_cb)
     {
         // debug_sample(sample);
-        m_cb(sample);
+        m_cb(std::move(frame));
     }
     else
     {
@@ -308,8 +1091,11 @@ void GstRtpReceiver::on_new_sample(std::shared_ptr<std::vector<uint8_t>> sample)
 
 /* socket → appsrc */
 static constexpr int SOCKET_POLL_TIMEOUT_MS = 100;
+// Sender reports muxed on the RTP port (RFC 5761) as the socket filters see them:
+// packet type 200 reads as marker + payload type 72.
+static constexpr uint8_t kRtcpSrFilterPt = 200 & 0x7f;
 
-static void setup_appsrc_buffer_pool(GstElement *appsrc, VideoCodec video_codec)
+static void setup_appsrc_buffer_pool(GstElement *appsrc, VideoCodec video_codec, int recv_batch)
 {
     GstBufferPool *pool = gst_buffer_pool_new();
     GstStructure *config = gst_buffer_pool_get_config(pool);
@@ -320,7 +1106,10 @@ static void setup_appsrc_buffer_pool(GstElement *appsrc, VideoCodec video_codec)
                                         (video_codec == VideoCodec::H264) ? "H264" : "H265",
                                         NULL);
 
-    gst_buffer_pool_config_set_params(config, caps, MAX_PACKET_SIZE, 10, 20);
+    // A batched reader keeps a full batch mapped while the previous one is still queued downstream.
+    const guint min_buffers = std::max(10, recv_batch);
+    const guint max_buffers = std::max(20, recv_batch * 4);
+    gst_buffer_pool_config_set_params(config, caps, MAX_PACKET_SIZE, min_buffers, max_buffers);
     gst_buffer_pool_set_config(pool, config);
     gst_caps_unref(caps);
 
@@ -330,100 +1119,1330 @@ static void setup_appsrc_buffer_pool(GstElement *appsrc, VideoCodec video_codec)
         gst_object_unref(pool);
         return;
     }
-    g_object_set_data(G_OBJECT(appsrc), "buffer-pool", pool);
+    // Lives as long as the appsrc, which a cached pipeline keeps across restarts.
+    g_object_set_data_full(G_OBJECT(appsrc), "buffer-pool", pool, [](gpointer data)
+                           {
+        gst_buffer_pool_set_active(GST_BUFFER_POOL(data), FALSE);
+        gst_object_unref(data); });
 }
 
-static void loop_read_socket(bool &keep_looping, int sock_fd, GstAppSrc *appsrc,
-                             uint8_t video_pt,
-                             const GstRtpReceiver::AUDIO_PAYLOAD_CALLBACK &audio_cb)
+// Per-second ingest accounting shared by the select/recv and recvmmsg readers.
+// CPU is the reader thread's own user+sys time, which includes the softirq work
+// the kernel charges to the receiving syscall.
+class SocketReadStats
+{
+public:
+    explicit SocketReadStats(const char *tag, const RtpSocketFilter *filter = nullptr)
+        : m_tag(tag), m_filter(filter && filter->attached() ? filter : nullptr)
+    {
+        reset(std::chrono::steady_clock::now());
+        if (m_filter)
+            m_filter_last = m_filter->counters();
+    }
+
+    void on_syscall(uint64_t count = 1) { m_syscalls += count; }
+    // rx_ns: kernel receive time; feeds the wakeup histogram (kernel queue -> user space).
+    void on_packet(size_t bytes, uint64_t rx_ns = 0)
+    {
+        ++m_packets;
+        m_bytes += bytes;
+        if (rx_ns)
+            add_wakeup_latency(realtime_ns() - rx_ns);
+    }
+    // Busy-poll mode: one spin phase before a blocking wait, and whether data showed up in it.
+    void on_spin(bool hit) { ++(hit ? m_spin_hits : m_spin_misses); }
+
+    // Returns true when a report was emitted, so callers can piggyback their own counters.
+    bool maybe_report()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - m_window_start < std::chrono::seconds(1))
+            return false;
+        const uint64_t cpu_us = thread_cpu_us() - m_cpu_start_us;
+        const double mbit = static_cast<double>(m_bytes) * 8.0 / 1e6;
+        spdlog::debug("[{}] pkts/s {} syscalls/s {} pkts/syscall {:.2f} cpu {:.1f} ms/s {:.1f} us/Mbit",
+                      m_tag, m_packets, m_syscalls,
+                      m_syscalls ? static_cast<double>(m_packets) / m_syscalls : 0.0,
+                      cpu_us / 1000.0,
+                      mbit > 0.0 ? cpu_us / mbit : 0.0);
+        if (m_filter)
+            report_filter();
+        report_wakeup_latency();
+        reset(now);
+        return true;
+    }
+
+private:
+    static uint64_t thread_cpu_us()
+    {
+        rusage usage{};
+        if (getrusage(RUSAGE_THREAD, &usage) != 0)
+            return 0;
+        return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+               usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    }
+
+    void report_filter()
+    {
+        const auto c = m_filter->counters();
+        const auto &l = m_filter_last;
+        if (c.exact)
+            spdlog::debug("[{}] kernel filter accepted/s {} dropped/s short {} bad-version {} unknown-pt {} (socket drops {})",
+                          m_tag, c.accepted - l.accepted, c.short_packets - l.short_packets,
+                          c.bad_version - l.bad_version, c.unknown_pt - l.unknown_pt, c.dropped - l.dropped);
+        else
+            spdlog::debug("[{}] kernel drops/s {} (filter + overflow)", m_tag, c.dropped - l.dropped);
+        m_filter_last = c;
+    }
+
+    // Buckets: < 8 us, < 16 us, ... < 1024 us, >= 1024 us.
+    static constexpr size_t kWakeupBuckets = 9;
+
+    void add_wakeup_latency(uint64_t ns)
+    {
+        const uint64_t us = ns / 1000;
+        size_t bucket = 0;
+        while (bucket + 1 < kWakeupBuckets && us >= (8ULL << bucket))
+            ++bucket;
+        ++m_wakeup_hist[bucket];
+        m_wakeup_max_us = std::max(m_wakeup_max_us, us);
+    }
+
+    void report_wakeup_latency()
+    {
+        uint64_t total = 0;
+        for (uint64_t count : m_wakeup_hist)
+            total += count;
+        if (total == 0)
+            return;
+        std::string hist;
+        for (size_t i = 0; i < kWakeupBuckets; ++i)
+        {
+            if (i + 1 < kWakeupBuckets)
+                hist += fmt::format(" <{}:{}", 8u << i, m_wakeup_hist[i]);
+            else
+                hist += fmt::format(" >={}:{}", 8u << (i - 1), m_wakeup_hist[i]);
+        }
+        spdlog::debug("[{}] kernel rx -> recv us{} max {}", m_tag, hist, m_wakeup_max_us);
+        if (m_spin_hits + m_spin_misses)
+            spdlog::debug("[{}] busy poll spins {} found data {} ({:.0f}%)", m_tag, m_spin_hits + m_spin_misses,
+                          m_spin_hits, 100.0 * static_cast<double>(m_spin_hits) / static_cast<double>(m_spin_hits + m_spin_misses));
+    }
+
+    void reset(std::chrono::steady_clock::time_point now)
+    {
+        m_window_start = now;
+        m_cpu_start_us = thread_cpu_us();
+        m_packets = 0;
+        m_syscalls = 0;
+        m_bytes = 0;
+        m_wakeup_hist.fill(0);
+        m_wakeup_max_us = 0;
+        m_spin_hits = 0;
+        m_spin_misses = 0;
+    }
+
+    const char *m_tag;
+    const RtpSocketFilter *m_filter;
+    RtpSocketFilter::Counters m_filter_last;
+    std::chrono::steady_clock::time_point m_window_start;
+    uint64_t m_cpu_start_us = 0;
+    uint64_t m_packets = 0;
+    uint64_t m_syscalls = 0;
+    uint64_t m_bytes = 0;
+    std::array<uint64_t, kWakeupBuckets> m_wakeup_hist{};
+    uint64_t m_wakeup_max_us = 0;
+    uint64_t m_spin_hits = 0;
+    uint64_t m_spin_misses = 0;
+};
+
+/* Busy-poll mode: before blocking, spin on non-blocking MSG_PEEK reads for up to budget_us
+ * (with SO_BUSY_POLL set each of them also polls the NIC queue). Burns the core the reader
+ * is pinned to in exchange for the scheduler wakeup. True when a datagram is waiting. */
+static bool spin_until_readable(int sock_fd, uint32_t budget_us, SocketReadStats &stats)
+{
+    if (budget_us == 0)
+        return false;
+    const uint64_t deadline = monotonic_us() + budget_us;
+    uint8_t byte;
+    do
+    {
+        stats.on_syscall();
+        if (recv(sock_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) >= 0)
+        {
+            stats.on_spin(true);
+            return true;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            break;
+    } while (monotonic_us() < deadline);
+    stats.on_spin(false);
+    return false;
+}
+
+/* Everything the router sends somewhere other than the depayloader. */
+static void deliver_routed(const RtpRouter &router, RtpRouter::Decision decision, const uint8_t *packet,
+                           size_t size, const AudioTap &audio_tap)
+{
+    if (decision.route == RtpRoute::AUDIO)
+    {
+        audio_tap.deliver(packet, size);
+        return;
+    }
+    router.deliver(decision, packet, size);
+}
+
+static uint16_t rtp_seq(const uint8_t *packet)
+{
+    return static_cast<uint16_t>((packet[2] << 8) | packet[3]);
+}
+
+template <typename Packet>
+static void log_reorder_stats(const char *tag, RtpReorderBuffer<Packet> &reorder)
+{
+    const auto r = reorder.take_stats();
+    spdlog::debug("[{}] reorder window {} us: reordered {} late {} lost {} held max {}",
+                  tag, reorder.window_us(), r.reordered, r.late, r.lost, r.held_max);
+}
+
+static void log_fec_stats(const char *tag, RtpFecDecoder &fec)
+{
+    const auto f = fec.take_stats();
+    spdlog::debug("[{}] fec: media {} parity {} recovered {} unrecoverable {} duplicates {}",
+                  tag, f.media, f.parity, f.recovered, f.unrecoverable, f.duplicates);
+}
+
+/* Sends a receiver report when one is due and logs what it said. */
+static void send_rtcp_report(RtcpReporter &rtcp)
+{
+    if (!rtcp.maybe_send(monotonic_us()))
+        return;
+    const auto &r = rtcp.last_report();
+    const std::string to = rtcp.destination().empty() ? "(not sent)" : rtcp.destination();
+    if (!r.has_block)
+    {
+        spdlog::debug("[rtcp] RR to {}: no video since the last report", to);
+        return;
+    }
+    spdlog::debug("[rtcp] RR to {}: ssrc {:08x} fraction lost {:.1f}% cumulative {} highest seq {} jitter {:.2f} ms lsr {:08x} dlsr {} ms",
+                  to, r.media_ssrc, r.fraction_lost * 100.0 / 256.0, r.cumulative_lost,
+                  r.extended_highest_seq, r.jitter_ms, r.lsr, static_cast<uint64_t>(r.dlsr) * 1000 / 65536);
+}
+
+static void log_impairment_stats(const char *tag, RtpImpairment &impairment)
+{
+    const auto i = impairment.take_stats();
+    spdlog::debug("[{}] impairment: packets {} lost {} rate dropped {} reordered {} duplicated {} delay avg {} us max {} us held max {}",
+                  tag, i.packets, i.lost, i.rate_dropped, i.reordered, i.duplicated,
+                  i.packets > i.lost + i.rate_dropped ? i.delay_us_sum / (i.packets - i.lost - i.rate_dropped) : 0,
+                  i.delay_us_max, i.held_max);
+}
+
+/* The optional stages between the socket and the depayloader, the same for every reader. */
+struct IngestStages
+{
+    uint32_t reorder_window_us = 0;
+    uint8_t fec_pt = 0;
+    RtcpReporter *rtcp = nullptr;
+    const ImpairmentConfig *impairment = nullptr;
+    RtpCaptureRing *capture = nullptr;
+    const RtpRouter *router = nullptr;
+    uint8_t capture_ext_id = 0; // header extension with the air unit's capture time, 0 = none
+};
+
+/* Video packets of one reader iteration, pushed to appsrc as a single GstBufferList.
+ * With a reorder window they pass through RtpReorderBuffer first, so the depayloader
+ * always sees them in sequence order. The readers hand every packet to route(): video
+ * goes through admit() -- RTCP reception statistics, then RtpFecDecoder -- FEC parity and
+ * muxed sender reports through add_control(), and the rest to its RtpRouter handler;
+ * recovered packets join the queue like received ones.
+ * Every datagram is first offered to ingress(), which records it into the capture ring
+ * and, with an impairment stage configured, takes it; what comes out of the impairment
+ * later goes through the reader's copy path. */
+class AppsrcVideoQueue
+{
+public:
+    AppsrcVideoQueue(GstAppSrc *appsrc, const IngestStages &stages)
+        : m_appsrc(appsrc), m_fec_pt(stages.fec_pt), m_rtcp(stages.rtcp), m_capture(stages.capture),
+          m_router(*stages.router), m_capture_ext_id(stages.capture_ext_id)
+    {
+        if (stages.reorder_window_us > 0)
+            m_reorder = std::make_unique<RtpReorderBuffer<BufferPtr>>(
+                stages.reorder_window_us, [this](BufferPtr &&buffer)
+                { append(buffer.release()); });
+        if (stages.impairment)
+            m_impairment = std::make_unique<RtpImpairment>(*stages.impairment, [this](const uint8_t *packet, size_t size, uint64_t rx_ns)
+                                                           { m_impaired_out(packet, size, rx_ns); });
+        if (m_fec_pt != 0)
+            m_fec = std::make_unique<RtpFecDecoder>([this](const uint8_t *packet, size_t size)
+                                                    {
+                                                        GstBuffer *buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+                                                        gst_buffer_fill(buffer, 0, packet, size);
+                                                        stamp_capture_time(buffer, capture_time(packet, size));
+                                                        add(buffer, rtp_seq(packet)); });
+    }
+
+    ~AppsrcVideoQueue()
+    {
+        m_impairment.reset();
+        m_fec.reset();
+        m_reorder.reset();
+        if (m_list)
+            gst_buffer_list_unref(m_list);
+    }
+
+    // Where packets leaving the impairment stage go; the reader's copying path.
+    void set_impaired_output(RtpImpairment::Output out)
+    {
+        m_impaired_out = std::move(out);
+    }
+
+    // Every datagram off the socket goes here first: into the capture ring, then the
+    // impairment stage. True when the impairment took it (it keeps a copy if it delays it).
+    bool ingress(const uint8_t *packet, size_t size, uint64_t rx_ns)
+    {
+        if (m_capture)
+            m_capture->record(packet, size, rx_ns);
+        if (!m_impairment)
+            return false;
+        m_impairment->push(packet, size, rx_ns, monotonic_us());
+        return true;
+    }
+
+    // False when the packet was already rebuilt from parity; the caller drops it.
+    bool admit(const uint8_t *packet, size_t size, uint64_t rx_ns)
+    {
+        if (m_rtcp)
+            m_rtcp->on_rtp(packet, size, rx_ns);
+        return !m_fec || m_fec->on_media(packet, size);
+    }
+
+    // True when the packet is FEC parity or RTCP from the sender, i.e. it was consumed.
+    bool add_control(uint8_t pt, const uint8_t *packet, size_t size, uint64_t rx_ns)
+    {
+        if (m_fec && pt == m_fec_pt)
+        {
+            m_fec->on_parity(packet, size);
+            return true;
+        }
+        if (m_rtcp && RtcpReporter::is_rtcp(packet, size))
+        {
+            m_rtcp->on_rtcp(packet, size, rx_ns);
+            return true;
+        }
+        return false;
+    }
+
+    // True when the packet is video the caller queues with add(); anything else is handed
+    // to its handler here (or dropped) and the caller is done with it.
+    bool route(const uint8_t *packet, size_t size, uint64_t rx_ns,
+               const AudioTap &audio_tap)
+    {
+        {
+            const RtpRouter::ReadSection section(m_router);
+            const auto decision = m_router.route(packet, size);
+            if (decision.route != RtpRoute::VIDEO)
+            {
+                if (!add_control(static_cast<uint8_t>(packet[1] & 0x7f), packet, size, rx_ns))
+                    deliver_routed(m_router, decision, packet, size, audio_tap);
+                return false;
+            }
+        }
+        return admit(packet, size, rx_ns);
+    }
+
+    // Air unit capture time a video packet carries, 0 when it has none.
+    uint64_t capture_time(const uint8_t *packet, size_t size) const
+    {
+        uint64_t capture_ns = 0;
+        if (m_capture_ext_id)
+            clock_sync::rtp_capture_time(packet, size, m_capture_ext_id, capture_ns);
+        return capture_ns;
+    }
+
+    // Takes ownership of `buffer`, which holds one RTP packet with sequence number `seq`.
+    void add(GstBuffer *buffer, uint16_t seq)
+    {
+        if (!m_reorder || m_reorder->pass_through(seq))
+        {
+            append(buffer);
+            return;
+        }
+        // A packet held behind a gap leaves the pool: the pool is far smaller than the
+        // reorder window, and the reader that would release held packets is the one that
+        // blocks in acquire once it runs dry. The copy keeps the receive/capture metas.
+        BufferPtr owned(gst_buffer_copy_deep(buffer));
+        gst_buffer_unref(buffer);
+        if (owned)
+            m_reorder->push(seq, std::move(owned), monotonic_us());
+    }
+
+    void poll()
+    {
+        if (m_impairment)
+            m_impairment->poll(monotonic_us());
+        if (m_reorder)
+            m_reorder->poll(monotonic_us());
+        if (m_rtcp)
+            send_rtcp_report(*m_rtcp);
+    }
+
+    // How long the reader may block before a held gap expires.
+    int timeout_ms(int cap_ms) const
+    {
+        if (m_impairment)
+            cap_ms = m_impairment->timeout_ms(monotonic_us(), cap_ms);
+        return m_reorder ? m_reorder->timeout_ms(monotonic_us(), cap_ms) : cap_ms;
+    }
+
+    bool push()
+    {
+        if (!m_list)
+            return true;
+        const GstFlowReturn ret = gst_app_src_push_buffer_list(m_appsrc, m_list);
+        m_list = nullptr;
+        if (ret != GST_FLOW_OK)
+        {
+            spdlog::warn("Appsrc push error: {}", gst_flow_get_name(ret));
+            return false;
+        }
+        return true;
+    }
+
+    void report(const char *tag)
+    {
+        if (m_impairment)
+            log_impairment_stats(tag, *m_impairment);
+        if (m_fec)
+            log_fec_stats(tag, *m_fec);
+        if (m_reorder)
+            log_reorder_stats(tag, *m_reorder);
+    }
+
+private:
+    struct BufferUnref
+    {
+        void operator()(GstBuffer *buffer) const { gst_buffer_unref(buffer); }
+    };
+    using BufferPtr = std::unique_ptr<GstBuffer, BufferUnref>;
+
+    void append(GstBuffer *buffer)
+    {
+        if (!m_list)
+            m_list = gst_buffer_list_new_sized(16);
+        gst_buffer_list_add(m_list, buffer);
+    }
+
+    GstAppSrc *m_appsrc;
+    GstBufferList *m_list = nullptr;
+    std::unique_ptr<RtpReorderBuffer<BufferPtr>> m_reorder;
+    uint8_t m_fec_pt;
+    std::unique_ptr<RtpFecDecoder> m_fec;
+    RtcpReporter *m_rtcp;
+    RtpCaptureRing *m_capture;
+    const RtpRouter &m_router;
+    uint8_t m_capture_ext_id;
+    std::unique_ptr<RtpImpairment> m_impairment;
+    RtpImpairment::Output m_impaired_out;
+};
+
+/* Copies one datagram into a pool buffer queued for appsrc, or hands audio to its callback. */
+static void queue_copied_packet(GstBufferPool *pool, AppsrcVideoQueue &queue, const uint8_t *data, size_t n,
+                                uint64_t rx_ns, const AudioTap &audio_tap)
+{
+    if (n <= RTP_HEADER_LEN)
+    {
+        spdlog::warn("Invalid RTP packet size: {}", n);
+        return;
+    }
+    if (!queue.route(data, n, rx_ns, audio_tap))
+        return;
+    GstBuffer *buffer = nullptr;
+    if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) != GST_FLOW_OK || !buffer)
+    {
+        spdlog::warn("Failed to acquire buffer from pool");
+        return;
+    }
+    gst_buffer_fill(buffer, 0, data, n);
+    gst_buffer_resize(buffer, 0, n);
+    stamp_rx_time(buffer, rx_ns);
+    stamp_capture_time(buffer, queue.capture_time(data, n));
+    queue.add(buffer, rtp_seq(data));
+}
+
+static void log_diversity_stats(const char *tag, DiversityReceiver &diversity)
+{
+    const auto stats = diversity.merger().take_stats();
+    uint64_t total_first = 0;
+    for (const auto &in : stats)
+        total_first += in.first;
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        const auto &in = stats[i];
+        spdlog::debug("[{}] diversity port {}: pkts/s {} first {} ({:.0f}%) duplicates {} exclusive {}",
+                      tag, diversity.inputs()[i].port, in.packets, in.first,
+                      total_first ? 100.0 * static_cast<double>(in.first) / static_cast<double>(total_first) : 0.0,
+                      in.duplicates, in.exclusive);
+    }
+}
+
+static void log_shm_ring_stats(const char *tag, ShmRingConsumer &ring)
+{
+    const auto stats = ring.take_stats();
+    spdlog::debug("[{}] shm ring @{}: producer {} pkts {} sleeps {} eventfd wakeups {} producer drops {}",
+                  tag, ring.name(), ring.producer_attached() ? "attached" : "none", stats.packets,
+                  stats.sleeps, stats.wakeups, stats.dropped);
+}
+
+static void log_replay_stats(const char *tag, PcapReplaySource &replay)
+{
+    const auto stats = replay.take_stats();
+    spdlog::debug("[{}] replay: pkts {} bytes {} loop {} late avg {} us max {} us", tag, stats.packets, stats.bytes,
+                  replay.loops_done() + 1, stats.packets ? stats.late_us_sum / stats.packets : 0, stats.late_us_max);
+}
+
+/* SO_RCVTIMEO for the recvmmsg() readers, only touched when the wanted timeout changes.
+ * Returns the flags for the next recvmmsg(): a zero timeout means "don't block". */
+static int update_receive_timeout(int sock_fd, int timeout_ms, int &current_ms)
+{
+    if (timeout_ms == 0)
+        return MSG_WAITFORONE | MSG_DONTWAIT;
+    if (timeout_ms != current_ms)
+    {
+        timeval rcv_timeout{};
+        rcv_timeout.tv_sec = timeout_ms / 1000;
+        rcv_timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout));
+        current_ms = timeout_ms;
+    }
+    return MSG_WAITFORONE;
+}
+
+static void loop_read_socket(bool &keep_looping, int sock_fd, GstAppSrc *appsrc,
+                             const AudioTap &audio_tap,
+                             const RtpSocketFilter *filter, const IngestStages &stages,
+                             uint32_t spin_us)
+{
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("socket", filter);
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+            queue.report("socket");
+        queue.poll();
+        if (!queue.push())
+            break;
+        if (!spin_until_readable(sock_fd, spin_us, stats))
+        {
+            fd_set read_fds;
+            FD_ZERO(&read_fds);
+            FD_SET(sock_fd, &read_fds);
+
+            struct timeval timeout = {.tv_sec = 0, .tv_usec = queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS) * 1000};
+            int ready = select(sock_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+            stats.on_syscall();
+            if (ready <= 0)
+                continue;
+        }
+
+        GstBuffer *buffer = nullptr;
+        GstFlowReturn ret = gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr);
+        if (ret != GST_FLOW_OK || !buffer)
+        {
+            spdlog::warn("Failed to acquire buffer from pool");
+            continue;
+        }
+
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+        {
+            spdlog::warn("Failed to map buffer");
+            gst_buffer_unref(buffer);
+            continue;
+        }
+
+        iovec iov{map.data, map.size};
+        std::array<uint8_t, kRxTimestampControlLen> control{};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        const ssize_t n = recvmsg(sock_fd, &msg, 0);
+        stats.on_syscall();
+        if (n <= 0)
+        {
+            gst_buffer_unmap(buffer, &map);
+            gst_buffer_unref(buffer);
+            continue;
+        }
+
+        if (n <= RTP_HEADER_LEN)
+        {
+            spdlog::warn("Invalid RTP packet size: {}", n);
+            gst_buffer_unmap(buffer, &map);
+            gst_buffer_unref(buffer);
+            continue;
+        }
+
+        const uint64_t rx_ns = rx_timestamp_ns(msg);
+        stats.on_packet(static_cast<size_t>(n), rx_ns);
+        if (queue.ingress(map.data, static_cast<size_t>(n), rx_ns))
+        {
+            gst_buffer_unmap(buffer, &map);
+            gst_buffer_unref(buffer);
+            continue;
+        }
+        if (!queue.route(map.data, static_cast<size_t>(n), rx_ns, audio_tap))
+        {
+            gst_buffer_unmap(buffer, &map);
+            gst_buffer_unref(buffer);
+            continue;
+        }
+
+        const uint16_t seq = rtp_seq(map.data);
+        const uint64_t capture_ns = queue.capture_time(map.data, static_cast<size_t>(n));
+        gst_buffer_unmap(buffer, &map);
+        gst_buffer_resize(buffer, 0, n);
+        stamp_rx_time(buffer, rx_ns);
+        stamp_capture_time(buffer, capture_ns);
+        queue.add(buffer, seq);
+    }
+
+    // buffer pool owned by appsrc
+}
+
+/* socket → appsrc, recvmmsg() variant: one syscall drains up to `batch` datagrams
+ * straight into pool buffers, and the video ones go downstream as one GstBufferList. */
+static void loop_read_socket_batched(bool &keep_looping, int sock_fd, GstAppSrc *appsrc,
+                                     int batch,
+                                     const AudioTap &audio_tap,
+                                     const RtpSocketFilter *filter, const IngestStages &stages,
+                                     uint32_t spin_us)
 {
     GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
-    uint64_t pkt_counter = 0;
-    auto last_report = std::chrono::steady_clock::now();
+    SocketReadStats stats("socket-mmsg", filter);
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+
+    // MSG_WAITFORONE blocks for the first datagram only; the receive timeout keeps
+    // keep_looping responsive without an extra select() per batch.
+    int rcv_timeout_ms = -1;
+
+    std::vector<GstBuffer *> buffers(batch, nullptr);
+    std::vector<GstMapInfo> maps(batch);
+    std::vector<iovec> iovs(batch);
+    std::vector<mmsghdr> msgs(batch);
+    std::vector<uint8_t> control(static_cast<size_t>(batch) * kRxTimestampControlLen);
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+            queue.report("socket-mmsg");
+        queue.poll();
+        if (!queue.push())
+            break;
+
+        // Refill the slots whose buffers went downstream in the previous round;
+        // the rest are still mapped and get reused as-is.
+        int ready_slots = 0;
+        for (; ready_slots < batch; ++ready_slots)
+        {
+            if (buffers[ready_slots])
+                continue;
+            GstBuffer *buffer = nullptr;
+            if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) != GST_FLOW_OK || !buffer)
+                break;
+            if (!gst_buffer_map(buffer, &maps[ready_slots], GST_MAP_WRITE))
+            {
+                gst_buffer_unref(buffer);
+                break;
+            }
+            buffers[ready_slots] = buffer;
+        }
+        if (ready_slots == 0)
+        {
+            spdlog::warn("Failed to acquire buffer from pool");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        for (int i = 0; i < ready_slots; ++i)
+        {
+            iovs[i].iov_base = maps[i].data;
+            iovs[i].iov_len = maps[i].size;
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control.data() + static_cast<size_t>(i) * kRxTimestampControlLen;
+            msgs[i].msg_hdr.msg_controllen = kRxTimestampControlLen;
+        }
+
+        const int timeout_ms = spin_until_readable(sock_fd, spin_us, stats) ? 0 : queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS);
+        const int flags = update_receive_timeout(sock_fd, timeout_ms, rcv_timeout_ms);
+        const int received = recvmmsg(sock_fd, msgs.data(), ready_slots, flags, nullptr);
+        stats.on_syscall();
+        if (received <= 0)
+            continue;
+
+        for (int i = 0; i < received; ++i)
+        {
+            const size_t n = msgs[i].msg_len;
+            const uint64_t rx_ns = rx_timestamp_ns(msgs[i].msg_hdr);
+            stats.on_packet(n, rx_ns);
+            if (n <= RTP_HEADER_LEN)
+            {
+                spdlog::warn("Invalid RTP packet size: {}", n);
+                continue;
+            }
+            // The slot keeps its buffer for the next round.
+            if (queue.ingress(maps[i].data, n, rx_ns))
+                continue;
+
+            if (!queue.route(maps[i].data, n, rx_ns, audio_tap))
+                continue;
+
+            const uint16_t seq = rtp_seq(maps[i].data);
+            const uint64_t capture_ns = queue.capture_time(maps[i].data, n);
+            gst_buffer_unmap(buffers[i], &maps[i]);
+            gst_buffer_resize(buffers[i], 0, n);
+            stamp_rx_time(buffers[i], rx_ns);
+            stamp_capture_time(buffers[i], capture_ns);
+            queue.add(buffers[i], seq);
+            buffers[i] = nullptr;
+        }
+    }
+
+    for (int i = 0; i < batch; ++i)
+    {
+        if (!buffers[i])
+            continue;
+        gst_buffer_unmap(buffers[i], &maps[i]);
+        gst_buffer_unref(buffers[i]);
+    }
+}
+
+/* socket → appsrc, io_uring variant: datagrams land in the ring's provided buffers and
+ * are copied once into pool buffers; returns false if the ring could not be set up or
+ * failed while reading, for the caller to fall back to the socket reader. */
+static bool loop_read_uring(bool &keep_looping, int sock_fd, GstAppSrc *appsrc,
+                            const AudioTap &audio_tap,
+                            const RtpSocketFilter *filter, const IngestStages &stages)
+{
+    constexpr unsigned kRingBuffers = 512;
+    UringReceiver ring;
+    if (!ring.start(sock_fd, kRingBuffers, MAX_PACKET_SIZE))
+        return false;
+
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("socket-uring", filter);
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+    uint64_t last_syscalls = 0;
+
+    const auto on_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        stats.on_packet(n, rx_ns);
+        if (!queue.ingress(data, n, rx_ns))
+            queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap);
+    };
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+            queue.report("socket-uring");
+        queue.poll();
+        if (!queue.push())
+            break;
+        const int delivered = ring.wait(queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS), on_packet);
+        stats.on_syscall(ring.syscalls() - last_syscalls);
+        last_syscalls = ring.syscalls();
+        if (delivered < 0)
+            return false;
+    }
+    return true;
+}
+
+/* Shared-memory ring → appsrc: a co-located producer writes packets straight into the
+ * ring, they are copied once into pool buffers and no syscall is made while packets keep
+ * coming. */
+static void loop_read_shm_ring(bool &keep_looping, ShmRingConsumer &ring, GstAppSrc *appsrc,
+                               const AudioTap &audio_tap,
+                               const IngestStages &stages)
+{
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("shm-ring");
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+    uint64_t last_syscalls = 0;
+
+    const auto on_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        stats.on_packet(n, rx_ns);
+        if (!queue.ingress(data, n, rx_ns))
+            queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap);
+    };
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+        {
+            log_shm_ring_stats("shm-ring", ring);
+            queue.report("shm-ring");
+        }
+        queue.poll();
+        if (!queue.push())
+            break;
+        const int delivered = ring.wait(queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS), on_packet);
+        stats.on_syscall(ring.syscalls() - last_syscalls);
+        last_syscalls = ring.syscalls();
+        if (delivered < 0)
+            break;
+    }
+}
+
+/* pcap → appsrc: the replay source stands in for the socket, paced like the recording
+ * (or flat out), so the stages after it run exactly as for live traffic. */
+static void loop_read_replay(bool &keep_looping, PcapReplaySource &replay, GstAppSrc *appsrc,
+                             const AudioTap &audio_tap,
+                             const IngestStages &stages)
+{
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("replay");
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+
+    const auto on_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        stats.on_packet(n, rx_ns);
+        if (!queue.ingress(data, n, rx_ns))
+            queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap);
+    };
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+        {
+            log_replay_stats("replay", replay);
+            queue.report("replay");
+        }
+        queue.poll();
+        if (!queue.push())
+            break;
+        if (replay.wait(queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS), on_packet) < 0)
+        {
+            spdlog::info("pcap replay finished after {} loop(s)", replay.loops_done());
+            break;
+        }
+    }
+}
+
+/* Several sockets → appsrc: every input is drained as it becomes readable and only the
+ * first copy of each packet is queued, so the depayloader sees one merged stream. */
+static void loop_read_diversity(bool &keep_looping, DiversityReceiver &diversity, GstAppSrc *appsrc,
+                                const AudioTap &audio_tap,
+                                const IngestStages &stages)
+{
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("diversity");
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+    uint64_t last_syscalls = 0;
+
+    const auto on_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        stats.on_packet(n, rx_ns);
+        if (!queue.ingress(data, n, rx_ns))
+            queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap);
+    };
+
+    while (keep_looping)
+    {
+        if (stats.maybe_report())
+        {
+            log_diversity_stats("diversity", diversity);
+            queue.report("diversity");
+        }
+        queue.poll();
+        if (!queue.push())
+            break;
+        const int delivered = diversity.wait(queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS), on_packet);
+        stats.on_syscall(diversity.syscalls() - last_syscalls);
+        last_syscalls = diversity.syscalls();
+        if (delivered < 0)
+            break;
+    }
+}
+
+/* AF_PACKET ring → appsrc: video packets are wrapped in place as read-only GstBuffers, each
+ * holding a reference on its ring block, so nothing is copied before the depayloader. */
+static void loop_read_packet_ring(bool &keep_looping, PacketRingReceiver &ring, GstAppSrc *appsrc,
+                                  const AudioTap &audio_tap,
+                                  const IngestStages &stages)
+{
+    GstBufferPool *pool = GST_BUFFER_POOL(g_object_get_data(G_OBJECT(appsrc), "buffer-pool"));
+    SocketReadStats stats("packet-ring");
+    AppsrcVideoQueue queue(appsrc, stages);
+    queue.set_impaired_output([&](const uint8_t *data, size_t n, uint64_t rx_ns)
+                              { queue_copied_packet(pool, queue, data, n, rx_ns, audio_tap); });
+
+    const auto on_packet = [&](const PacketRingReceiver::Packet &pkt)
+    {
+        stats.on_packet(pkt.size, pkt.timestamp_ns);
+        if (pkt.size <= RTP_HEADER_LEN)
+        {
+            spdlog::warn("Invalid RTP packet size: {}", pkt.size);
+            return;
+        }
+        if (queue.ingress(pkt.data, pkt.size, pkt.timestamp_ns))
+            return;
+        if (!queue.route(pkt.data, pkt.size, pkt.timestamp_ns, audio_tap))
+            return;
+        ring.hold_block(pkt.block);
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                        const_cast<uint8_t *>(pkt.data), pkt.size, 0, pkt.size,
+                                                        ring.block_token(pkt.block),
+                                                        &PacketRingReceiver::release_block_token);
+        stamp_rx_time(buffer, pkt.timestamp_ns);
+        stamp_capture_time(buffer, queue.capture_time(pkt.data, pkt.size));
+        queue.add(buffer, rtp_seq(pkt.data));
+    };
 
     while (keep_looping)
     {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(sock_fd, &read_fds);
+        if (stats.maybe_report())
+        {
+            const auto ring_stats = ring.take_stats();
+            spdlog::debug("[packet-ring] blocks/s {} fill avg {}% max {}% held {} kernel pkts {} drops {} freeze {}",
+                          ring_stats.blocks, ring_stats.fill_avg_pct, ring_stats.fill_max_pct,
+                          ring_stats.blocks_held, ring_stats.kernel_packets, ring_stats.kernel_drops,
+                          ring_stats.freeze_q);
+            if (ring_stats.kernel_drops)
+                spdlog::warn("packet ring dropped {} packets (ring full)", ring_stats.kernel_drops);
+            queue.report("packet-ring");
+        }
+        queue.poll();
+        if (!queue.push())
+            break;
+        const int delivered = ring.wait(queue.timeout_ms(SOCKET_POLL_TIMEOUT_MS), on_packet);
+        stats.on_syscall();
+        if (delivered < 0)
+            break;
+    }
+}
 
-        struct timeval timeout = {.tv_sec = 0, .tv_usec = SOCKET_POLL_TIMEOUT_MS * 1000};
-        int ready = select(sock_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-        if (ready <= 0)
-            continue;
+/* Native path: packets go from the socket (or AF_PACKET ring) straight into RtpDepacketizer
+ * and completed access units to the frame callback, with no GStreamer element in between. */
+static void loop_read_native(bool &keep_looping, int sock_fd, PacketRingReceiver *ring,
+                             DiversityReceiver *diversity, ShmRingConsumer *shm_ring, PcapReplaySource *replay,
+                             bool use_uring, int batch,
+                             RtpDepacketizer &depacketizer,
+                             const AudioTap &audio_tap,
+                             const RtpSocketFilter *filter, const IngestStages &stages,
+                             uint32_t spin_us)
+{
+    SocketReadStats stats("native", filter);
+    const uint8_t fec_pt = stages.fec_pt;
+    RtcpReporter *const rtcp = stages.rtcp;
+    const RtpRouter &router = *stages.router;
 
-        GstBuffer *buffer = nullptr;
-        GstFlowReturn ret = gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr);
-        if (ret != GST_FLOW_OK || !buffer)
+    // Out-of-order packets are copied only while a gap is open.
+    struct OwnedPacket
+    {
+        std::vector<uint8_t> data;
+        uint64_t rx_ns;
+    };
+    std::unique_ptr<RtpReorderBuffer<OwnedPacket>> reorder;
+    if (stages.reorder_window_us > 0)
+        reorder = std::make_unique<RtpReorderBuffer<OwnedPacket>>(
+            stages.reorder_window_us, [&](OwnedPacket &&pkt)
+            { depacketizer.push(pkt.data.data(), pkt.data.size(), pkt.rx_ns); });
+
+    const auto deliver = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        const uint16_t seq = rtp_seq(data);
+        if (!reorder || reorder->pass_through(seq))
+            depacketizer.push(data, n, rx_ns);
+        else
+            reorder->push(seq, OwnedPacket{std::vector<uint8_t>(data, data + n), rx_ns}, monotonic_us());
+    };
+    std::unique_ptr<RtpFecDecoder> fec;
+    if (fec_pt != 0)
+        fec = std::make_unique<RtpFecDecoder>([&](const uint8_t *data, size_t n)
+                                              { deliver(data, n, 0); });
+
+    const auto handle_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        if (n <= RTP_HEADER_LEN)
+            return;
+        const uint8_t pt = static_cast<uint8_t>(data[1] & 0x7f);
         {
-            spdlog::warn("Failed to acquire buffer from pool");
-            continue;
+            // Video leaves the section before depacketization, so route changes never
+            // wait for a frame callback.
+            const RtpRouter::ReadSection section(router);
+            const auto decision = router.route(data, n);
+            if (decision.route != RtpRoute::VIDEO)
+            {
+                if (fec && pt == fec_pt)
+                    fec->on_parity(data, n);
+                else if (rtcp && RtcpReporter::is_rtcp(data, n))
+                    rtcp->on_rtcp(data, n, rx_ns);
+                else
+                    deliver_routed(router, decision, data, n, audio_tap);
+                return;
+            }
         }
-
-        GstMapInfo map;
-        if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+        if (rtcp)
+            rtcp->on_rtp(data, n, rx_ns);
+        if (!fec || fec->on_media(data, n))
+            deliver(data, n, rx_ns);
+    };
+    std::unique_ptr<RtpImpairment> impairment;
+    if (stages.impairment)
+        impairment = std::make_unique<RtpImpairment>(*stages.impairment, handle_packet);
+    RtpCaptureRing *const capture = stages.capture;
+    const auto on_packet = [&](const uint8_t *data, size_t n, uint64_t rx_ns)
+    {
+        stats.on_packet(n, rx_ns);
+        if (capture)
+            capture->record(data, n, rx_ns);
+        if (impairment)
+            impairment->push(data, n, rx_ns, monotonic_us());
+        else
+            handle_packet(data, n, rx_ns);
+    };
+    // Per-iteration housekeeping; returns how long the next wait may block.
+    const auto tick = [&]() -> int
+    {
+        if (stats.maybe_report())
         {
-            spdlog::warn("Failed to map buffer");
-            gst_buffer_unref(buffer);
-            continue;
+            const auto d = depacketizer.take_stats();
+            spdlog::debug("[native] frames/s {} incomplete {} seq gaps {} dropped fragments {} assembly avg {} us max {} us",
+                          d.frames, d.incomplete_frames, d.seq_gaps, d.dropped_fragments,
+                          d.frames ? d.assembly_us_sum / d.frames : 0, d.assembly_us_max);
+            if (fec)
+                log_fec_stats("native", *fec);
+            if (reorder)
+                log_reorder_stats("native", *reorder);
+            if (diversity)
+                log_diversity_stats("native", *diversity);
+            if (shm_ring)
+                log_shm_ring_stats("native", *shm_ring);
+            if (replay)
+                log_replay_stats("native", *replay);
+            if (impairment)
+                log_impairment_stats("native", *impairment);
+        }
+        if (rtcp)
+            send_rtcp_report(*rtcp);
+        int timeout_ms = SOCKET_POLL_TIMEOUT_MS;
+        if (impairment)
+        {
+            impairment->poll(monotonic_us());
+            timeout_ms = impairment->timeout_ms(monotonic_us(), timeout_ms);
         }
+        if (!reorder)
+            return timeout_ms;
+        reorder->poll(monotonic_us());
+        return reorder->timeout_ms(monotonic_us(), timeout_ms);
+    };
 
-        const ssize_t n = recv(sock_fd, map.data, map.size, 0);
-        if (n <= 0)
+    if (ring)
+    {
+        while (keep_looping)
         {
-            gst_buffer_unmap(buffer, &map);
-            gst_buffer_unref(buffer);
-            continue;
+            const int delivered = ring->wait(tick(), [&](const PacketRingReceiver::Packet &pkt)
+                                             { on_packet(pkt.data, pkt.size, pkt.timestamp_ns); });
+            stats.on_syscall();
+            if (delivered < 0)
+                break;
         }
+        return;
+    }
 
-        if (n <= RTP_HEADER_LEN)
+    if (shm_ring)
+    {
+        uint64_t last_syscalls = 0;
+        while (keep_looping)
         {
-            spdlog::warn("Invalid RTP packet size: {}", n);
-            gst_buffer_unmap(buffer, &map);
-            gst_buffer_unref(buffer);
-            continue;
+            const int delivered = shm_ring->wait(tick(), on_packet);
+            stats.on_syscall(shm_ring->syscalls() - last_syscalls);
+            last_syscalls = shm_ring->syscalls();
+            if (delivered < 0)
+                break;
         }
+        return;
+    }
 
-        const uint8_t pt = static_cast<uint8_t>(map.data[1] & 0x7f);
-        if (pt != video_pt)
+    if (replay)
+    {
+        while (keep_looping)
         {
-            if (pt == 98 && audio_cb)
+            if (replay->wait(tick(), on_packet) < 0)
             {
-                const size_t payload_size = static_cast<size_t>(n - RTP_HEADER_LEN);
-                auto payload = std::make_shared<std::vector<uint8_t>>(payload_size);
-                std::memcpy(payload->data(), map.data + RTP_HEADER_LEN, payload_size);
-                audio_cb(payload);
+                spdlog::info("pcap replay finished after {} loop(s)", replay->loops_done());
+                break;
             }
-            gst_buffer_unmap(buffer, &map);
-            gst_buffer_unref(buffer);
-            continue;
         }
+        return;
+    }
 
-        gst_buffer_unmap(buffer, &map);
-        gst_buffer_resize(buffer, 0, n);
+    if (diversity)
+    {
+        uint64_t last_syscalls = 0;
+        while (keep_looping)
+        {
+            const int delivered = diversity->wait(tick(), on_packet);
+            stats.on_syscall(diversity->syscalls() - last_syscalls);
+            last_syscalls = diversity->syscalls();
+            if (delivered < 0)
+                break;
+        }
+        return;
+    }
 
-        ret = gst_app_src_push_buffer(appsrc, buffer);
-        if (ret != GST_FLOW_OK)
+    if (use_uring)
+    {
+        UringReceiver uring;
+        if (uring.start(sock_fd, 512, MAX_PACKET_SIZE))
         {
-            spdlog::warn("Appsrc push error: {}", gst_flow_get_name(ret));
-            break;
+            uint64_t last_syscalls = 0;
+            int delivered = 0;
+            while (keep_looping && delivered >= 0)
+            {
+                delivered = uring.wait(tick(), on_packet);
+                stats.on_syscall(uring.syscalls() - last_syscalls);
+                last_syscalls = uring.syscalls();
+            }
+            if (delivered >= 0)
+                return;
         }
+        spdlog::warn("io_uring ingest unavailable, falling back to recvmmsg");
+    }
+
+    // Plain buffers are enough here: the depacketizer copies payloads into the frame anyway.
+    batch = std::clamp(batch, 1, MAX_RECV_BATCH);
+    int rcv_timeout_ms = -1;
+
+    std::vector<uint8_t> storage(static_cast<size_t>(batch) * MAX_PACKET_SIZE);
+    std::vector<iovec> iovs(batch);
+    std::vector<mmsghdr> msgs(batch);
+    std::vector<uint8_t> control(static_cast<size_t>(batch) * kRxTimestampControlLen);
+    for (int i = 0; i < batch; ++i)
+    {
+        iovs[i].iov_base = storage.data() + static_cast<size_t>(i) * MAX_PACKET_SIZE;
+        iovs[i].iov_len = MAX_PACKET_SIZE;
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control.data() + static_cast<size_t>(i) * kRxTimestampControlLen;
+    }
+
+    while (keep_looping)
+    {
+        const int timeout_ms = tick();
+        const int flags = update_receive_timeout(sock_fd, spin_until_readable(sock_fd, spin_us, stats) ? 0 : timeout_ms,
+                                                 rcv_timeout_ms);
+        // recvmmsg() shrinks msg_controllen to what each message used.
+        for (int i = 0; i < batch; ++i)
+            msgs[i].msg_hdr.msg_controllen = kRxTimestampControlLen;
+        const int received = recvmmsg(sock_fd, msgs.data(), batch, flags, nullptr);
+        stats.on_syscall();
+        for (int i = 0; i < received; ++i)
+            on_packet(static_cast<const uint8_t *>(iovs[i].iov_base), msgs[i].msg_len,
+                      rx_timestamp_ns(msgs[i].msg_hdr));
+    }
+}
+
+void GstRtpReceiver::start_native_stream()
+{
+    if (!unix_socket && !open_ingest_socket())
+        return;
+    ensure_fec_reorder_window();
+    if (m_alignment == 1)
+        spdlog::warn("Native depacketizer always delivers access units, ignoring nal alignment");
+
+    m_depacketizer = std::make_unique<RtpDepacketizer>(m_video_codec, [this](VideoFramePtr frame)
+                                                       { on_new_sample(std::move(frame)); });
+    m_depacketizer->set_capture_time_extension(m_capture_ext_id);
+    m_read_socket_run = true;
+    m_read_socket_thread = std::make_unique<std::thread>([this]()
+                                                         {
+        prepare_reader_thread();
+        const IngestStages stages{m_reorder_window_us, m_fec_pt, m_rtcp_reporter.get(), m_impairment.get(),
+                                  m_capture_ring, m_router.get(), m_capture_ext_id};
+        std::unique_ptr<DiversityReceiver> diversity;
+        if (!m_diversity_socks.empty())
+            diversity = make_diversity_receiver();
+        loop_read_native(m_read_socket_run, this->sock, m_packet_ring.get(), diversity.get(), m_shm_ring.get(), m_replay.get(),
+                         m_ingest_backend == IngestBackend::IO_URING, m_recv_batch,
+                         *m_depacketizer, *m_audio_tap, m_video_filter.get(), stages, m_busy_poll_us); });
+}
+
+/* Dedicated audio socket (SocketFilterMode::KERNEL_SPLIT): the kernel only queues
+ * audio RTP here, so this loop never touches video traffic. */
+static void loop_read_audio_socket(bool &keep_looping, int sock_fd,
+                                   const AudioTap &audio_tap,
+                                   const RtpSocketFilter *filter)
+{
+    SocketReadStats stats("audio-socket", filter);
+    std::array<uint8_t, MAX_PACKET_SIZE> packet{};
+
+    while (keep_looping)
+    {
+        stats.maybe_report();
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock_fd, &read_fds);
+
+        struct timeval timeout = {.tv_sec = 0, .tv_usec = SOCKET_POLL_TIMEOUT_MS * 1000};
+        const int ready = select(sock_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+        stats.on_syscall();
+        if (ready <= 0)
+            continue;
+
+        const ssize_t n = recv(sock_fd, packet.data(), packet.size(), 0);
+        stats.on_syscall();
+        if (n <= RTP_HEADER_LEN)
+            continue;
+        stats.on_packet(static_cast<size_t>(n));
+        audio_tap.deliver(packet.data(), static_cast<size_t>(n));
+    }
+}
+
+/* What the kernel filters let through: every payload type the router sends somewhere
+ * (the audio ones only with `audio`), FEC parity and sender reports. Audio passes whether
+ * or not a tap is attached, so sound=1 needs no new filter. */
+std::vector<uint8_t> GstRtpReceiver::filter_payload_types(bool audio) const
+{
+    std::vector<uint8_t> pts;
+    for (const uint8_t pt : m_router->payload_types())
+    {
+        if (m_router->pt_route(pt) != RtpRoute::AUDIO || audio)
+            pts.push_back(pt);
+    }
+    if (m_fec_pt != 0)
+        pts.push_back(m_fec_pt);
+    if (m_rtcp_reporter)
+        pts.push_back(kRtcpSrFilterPt);
+    return pts;
+}
+
+void GstRtpReceiver::setup_socket_filters()
+{
+    if (m_router->has_ssrc_routes())
+    {
+        spdlog::warn("SSRC routes are set, the kernel RTP filter is left off");
+        return;
+    }
+    std::vector<uint8_t> audio_pts;
+    for (const uint8_t pt : m_router->payload_types())
+    {
+        if (m_router->pt_route(pt) == RtpRoute::AUDIO)
+            audio_pts.push_back(pt);
+    }
+    // Audio copies from the diversity inputs must go through the same dedup as video. The
+    // reuseport program steers a single payload type.
+    const bool split = m_socket_filter == SocketFilterMode::KERNEL_SPLIT && m_diversity_socks.empty() &&
+                       audio_pts.size() == 1;
+    if (m_socket_filter == SocketFilterMode::KERNEL_SPLIT && audio_pts.size() > 1)
+        spdlog::warn("Audio is routed from {} payload types, it stays on the video socket", audio_pts.size());
+
+    std::vector<uint8_t> video_pts = filter_payload_types(!split);
+    m_video_filter = std::make_unique<RtpSocketFilter>();
+    if (!m_video_filter->attach(sock, video_pts))
+        spdlog::warn("Kernel RTP filter unavailable, filtering in user space only");
+    if (!split)
+        return;
 
-        // Log packet rate (optional)
-        pkt_counter++;
-        auto now = std::chrono::steady_clock::now();
-        if (now - last_report >= std::chrono::seconds(1))
+    // Second member of the SO_REUSEPORT group on the same port; the reuseport program
+    // steers by payload type, the per-socket filters drop whatever hashing misroutes.
+    const uint8_t audio_pt = audio_pts.front();
+    m_audio_sock = create_udp_socket(m_port, 256 * 1024, true, audio_pt);
+    if (m_audio_sock < 0 || !RtpSocketFilter::attach_reuseport_split(sock, audio_pt))
+    {
+        spdlog::warn("Separate audio socket unavailable, audio stays on the video socket");
+        if (m_audio_sock >= 0)
         {
-            spdlog::debug("socket pkts/s {}", pkt_counter);
-            pkt_counter = 0;
-            last_report = now;
+            close(m_audio_sock);
+            m_audio_sock = -1;
         }
+        video_pts.push_back(audio_pt);
+        m_video_filter->attach(sock, video_pts);
+        return;
     }
+    m_audio_filter = std::make_unique<RtpSocketFilter>();
+    m_audio_filter->attach(m_audio_sock, {audio_pt});
+    m_read_socket_run = true;
+    m_audio_socket_thread = std::make_unique<std::thread>([this]()
+                                                          {
+        pthread_setname_np(pthread_self(), "audio-socket");
+        loop_read_audio_socket(m_read_socket_run, m_audio_sock, *m_audio_tap, m_audio_filter.get()); });
+}
 
-    // buffer pool owned by appsrc
+void GstRtpReceiver::start_socket_reader(GstElement *appsrc)
+{
+    ensure_fec_reorder_window();
+    m_read_socket_run = true;
+    m_read_socket_thread = std::make_unique<std::thread>([this, appsrc]()
+                                                         {
+        prepare_reader_thread();
+        const IngestStages stages{m_reorder_window_us, m_fec_pt, m_rtcp_reporter.get(), m_impairment.get(),
+                                  m_capture_ring, m_router.get(), m_capture_ext_id};
+        if (!m_diversity_socks.empty())
+        {
+            auto diversity = make_diversity_receiver();
+            loop_read_diversity(m_read_socket_run, *diversity, GST_APP_SRC(appsrc), *m_audio_tap, stages);
+            return;
+        }
+        if (m_replay)
+        {
+            loop_read_replay(m_read_socket_run, *m_replay, GST_APP_SRC(appsrc), *m_audio_tap, stages);
+            return;
+        }
+        if (m_shm_ring)
+        {
+            loop_read_shm_ring(m_read_socket_run, *m_shm_ring, GST_APP_SRC(appsrc), *m_audio_tap, stages);
+            return;
+        }
+        if (m_packet_ring)
+        {
+            loop_read_packet_ring(m_read_socket_run, *m_packet_ring, GST_APP_SRC(appsrc), *m_audio_tap, stages);
+            return;
+        }
+        if (m_ingest_backend == IngestBackend::IO_URING)
+        {
+            if (loop_read_uring(m_read_socket_run, this->sock, GST_APP_SRC(appsrc), *m_audio_tap, m_video_filter.get(), stages))
+                return;
+            spdlog::warn("io_uring ingest unavailable, falling back to the socket reader");
+        }
+        if (m_recv_batch > 1)
+        {
+            spdlog::info("socket reader: recvmmsg batch={}", m_recv_batch);
+            loop_read_socket_batched(m_read_socket_run, this->sock, GST_APP_SRC(appsrc), m_recv_batch, *m_audio_tap, m_video_filter.get(), stages, m_busy_poll_us);
+        }
+        else
+        {
+            loop_read_socket(m_read_socket_run, this->sock, GST_APP_SRC(appsrc), *m_audio_tap, m_video_filter.get(), stages, m_busy_poll_us);
+        } });
 }
 
 void GstRtpReceiver::start_receiving(NEW_FRAME_CALLBACK cb)
+{
+    start_receiving(VIDEO_FRAME_CALLBACK([cb](VideoFramePtr frame)
+                                         { cb(frame->to_vector(), frame->timing()); }));
+}
+
+void GstRtpReceiver::start_receiving(VIDEO_FRAME_CALLBACK cb)
 {
     spdlog::info("GstRtpReceiver::start_receiving begin");
     assert(m_gst_pipeline == nullptr);
@@ -452,19 +2471,42 @@ void GstRtpReceiver::stop_receiving()
         m_read_socket_thread = nullptr;
     }
 
+    if (m_audio_socket_thread)
+    {
+        m_audio_socket_thread->join();
+        m_audio_socket_thread = nullptr;
+    }
+
     if (m_gst_pipeline != nullptr)
     {
-        gst_element_send_event((GstElement *)m_gst_pipeline, gst_event_new_eos());
-        gst_element_set_state(m_gst_pipeline, GST_STATE_PAUSED);
+        // NULL, not a teardown: the sockets close and every element drops what it queued,
+        // the pipeline itself stays cached for the next start.
         gst_element_set_state(m_gst_pipeline, GST_STATE_NULL);
-        gst_object_unref(m_gst_pipeline);
         m_gst_pipeline = nullptr;
+        m_app_sink_element = nullptr;
     }
-    if (m_udp_appsrc && sock >= 0)
+    m_handoff_stats = nullptr;
+    // Only after the pipeline is stopped: its buffers may still point into ring blocks.
+    m_packet_ring.reset();
+    m_shm_ring.reset();
+    m_replay.reset();
+    m_depacketizer.reset();
+    if ((uses_appsrc() || m_native_depay) && !unix_socket && sock >= 0)
     {
         close(sock);
         sock = -1;
     }
+    if (m_audio_sock >= 0)
+    {
+        close(m_audio_sock);
+        m_audio_sock = -1;
+    }
+    for (const auto &input : m_diversity_socks)
+        close(input.first);
+    m_diversity_socks.clear();
+    m_diversity_filters.clear();
+    m_video_filter.reset();
+    m_audio_filter.reset();
     spdlog::info("GstRtpReceiver::stop_receiving end");
 }
 
@@ -481,29 +2523,34 @@ std::string GstRtpReceiver::construct_file_playback_pipeline(const char *file_pa
 void GstRtpReceiver::switch_to_file_playback(const char *file_path)
 {
     stop_receiving();
-
-    const auto pipeline = construct_file_playback_pipeline(file_path);
-    GError *error = nullptr;
-    m_gst_pipeline = gst_parse_launch(pipeline.c_str(), &error);
-    spdlog::info("GSTREAMER FILE PLAYBACK PIPE=[{}]", pipeline);
-
-    if (error)
+    // Recorded frames are what the decoder saw live; seeks would only look like losses.
+    m_loss_gate.reset(LossPolicy::FORWARD);
+    m_streaming = false;
+
+    mark_restart();
+    spdlog::info("GSTREAMER FILE PLAYBACK PIPE=[{}]", construct_file_playback_pipeline(file_path));
+    CachedPipeline::Shape shape;
+    shape.codec = m_video_codec;
+    shape.file = true;
+    shape.alignment = m_alignment;
+    if (!m_file_pipeline || !(m_file_pipeline->shape == shape))
     {
-        spdlog::error("gst_parse_launch error: {}", error->message);
-        g_error_free(error);
-        return;
+        m_file_pipeline.reset();
+        m_file_pipeline = build_file_pipeline(shape);
+        if (!m_file_pipeline)
+        {
+            spdlog::error("Cannot construct file playback pipeline");
+            return;
+        }
+        m_start_kind = "built";
     }
-
-    if (!m_gst_pipeline || !(GST_IS_PIPELINE(m_gst_pipeline)))
+    else
     {
-        spdlog::error("Cannot construct file playback pipeline");
-        m_gst_pipeline = nullptr;
-        return;
+        m_start_kind = "reused";
     }
-
-    // Setup appsink
-    m_app_sink_element = gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "out_appsink");
-    assert(m_app_sink_element);
+    g_object_set(m_file_pipeline->source, "location", file_path, NULL);
+    m_gst_pipeline = m_file_pipeline->pipeline;
+    m_app_sink_element = m_file_pipeline->appsink;
 
     gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
 
@@ -511,98 +2558,203 @@ void GstRtpReceiver::switch_to_file_playback(const char *file_path)
     m_pull_samples_thread = std::make_unique<std::thread>(&GstRtpReceiver::loop_pull_samples, this);
 }
 
-void GstRtpReceiver::switch_to_stream()
+bool GstRtpReceiver::open_ingest_socket()
 {
-    stop_receiving();
-
-    const auto pipeline = construct_gstreamer_pipeline();
-    GError *error = nullptr;
-    m_gst_pipeline = gst_parse_launch(pipeline.c_str(), &error);
-    spdlog::info("GSTREAMER STREAM PIPE=[{}]", pipeline);
-
-    if (error)
+    constexpr int kUdpSocketBuffer = 5 * 1024 * 1024;
+    const uint8_t payload_type = (m_video_codec == VideoCodec::H264) ? 96 : 97;
+    if (sock < 0)
     {
-        spdlog::error("gst_parse_launch error: {}", error->message);
-        g_error_free(error);
-        return;
+        const bool reuse = m_socket_filter == SocketFilterMode::KERNEL_SPLIT;
+        sock = create_udp_socket(m_port, kUdpSocketBuffer, reuse, payload_type);
+        if (sock < 0)
+        {
+            spdlog::error("Failed to create UDP socket for appsrc");
+            return false;
+        }
     }
-
-    if (!m_gst_pipeline || !(GST_IS_PIPELINE(m_gst_pipeline)))
+    if (m_busy_poll_us > 0)
+        enable_busy_poll(sock, m_busy_poll_us);
+    if (!m_diversity_ports.empty())
+        open_diversity_sockets();
+    if (m_ingest_backend == IngestBackend::PACKET_RING && m_diversity_socks.empty())
     {
-        spdlog::error("Cannot construct streaming pipeline");
-        m_gst_pipeline = nullptr;
-        return;
+        auto ring = std::make_unique<PacketRingReceiver>();
+        if (ring->start(m_packet_ring_iface, m_port))
+        {
+            // The UDP socket stays bound so the port is not answered with ICMP unreachable,
+            // but drops everything: the ring already has a copy of each datagram.
+            drop_all_datagrams(sock);
+            m_packet_ring = std::move(ring);
+        }
+        else
+        {
+            spdlog::warn("AF_PACKET ingest unavailable, falling back to the socket reader");
+        }
     }
-
-    if (m_udp_appsrc && !unix_socket)
+    if (m_ingest_backend == IngestBackend::SHM_RING && m_diversity_socks.empty())
     {
-        constexpr int kUdpSocketBuffer = 5 * 1024 * 1024;
-        const uint8_t payload_type = (m_video_codec == VideoCodec::H264) ? 96 : 97;
-        if (sock < 0)
+        auto ring = std::make_unique<ShmRingConsumer>();
+        if (ring->start(m_shm_ring_name.empty() ? "amldigitalfpv" : m_shm_ring_name, 1024, MAX_PACKET_SIZE))
         {
-            sock = create_udp_socket(m_port, kUdpSocketBuffer, false, payload_type);
-            if (sock < 0)
-            {
-                spdlog::error("Failed to create UDP socket for appsrc");
-                return;
-            }
+            // As with the AF_PACKET ring: keep the port bound, the producer feeds the ring.
+            drop_all_datagrams(sock);
+            m_shm_ring = std::move(ring);
+        }
+        else
+        {
+            spdlog::warn("Shared-memory ring ingest unavailable, falling back to the socket reader");
+        }
+    }
+    if (m_ingest_backend == IngestBackend::PCAP_REPLAY && m_diversity_socks.empty())
+    {
+        PcapCapture capture;
+        std::string error;
+        if (capture.load(m_replay_path, static_cast<uint16_t>(m_port), error) ||
+            capture.load(m_replay_path, 0, error))
+        {
+            spdlog::info("pcap replay of {}: {} packets, {:.1f} s at {}", m_replay_path, capture.packets.size(),
+                         capture.duration_s(), m_replay_speed > 0.0 ? fmt::format("{}x", m_replay_speed) : "full speed");
+            // Live traffic on the port would mix into the recording.
+            drop_all_datagrams(sock);
+            m_replay = std::make_unique<PcapReplaySource>(std::move(capture), m_replay_speed, m_replay_loops);
+        }
+        else
+        {
+            spdlog::warn("pcap replay of '{}' unavailable ({}), falling back to the socket reader", m_replay_path, error);
         }
     }
+    if (!m_packet_ring && !m_shm_ring && !m_replay && m_socket_filter != SocketFilterMode::OFF)
+        setup_socket_filters();
+    if (m_busy_poll_us > 0 && (m_packet_ring || m_shm_ring || m_replay || !m_diversity_socks.empty() ||
+                               m_ingest_backend == IngestBackend::IO_URING))
+        spdlog::warn("Busy poll only spins in the recv()/recvmmsg() socket readers, this ingest path blocks as usual");
+    return true;
+}
+
+void GstRtpReceiver::ensure_fec_reorder_window()
+{
+    // A recovered packet shows up once its row or column parity has arrived, behind the
+    // rest of its block; without a hold the depayloader has already given up on it.
+    // 30 ms covers an 8x4 block down to ~1000 packets/s (~11 Mbit/s at 1400 bytes).
+    constexpr uint32_t kFecReorderWindowUs = 30000;
+    if (m_fec_pt == 0 || m_reorder_window_us != 0)
+        return;
+    m_reorder_window_us = kFecReorderWindowUs;
+    spdlog::info("FEC needs a reorder window, using {} us (-j for bigger blocks or lower rates)", m_reorder_window_us);
+}
 
-    // If using Unix socket, setup appsrc with buffer pool
-    if (unix_socket)
+void GstRtpReceiver::open_diversity_sockets()
+{
+    constexpr int kUdpSocketBuffer = 5 * 1024 * 1024;
+    const uint8_t video_pt = (m_video_codec == VideoCodec::H264) ? 96 : 97;
+    const std::vector<uint8_t> pts = filter_payload_types(true);
+    for (int port : m_diversity_ports)
     {
-        GstElement *appsrc = gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "appsrc");
-        if (!appsrc)
+        const int fd = create_udp_socket(port, kUdpSocketBuffer, false, video_pt);
+        if (fd < 0)
         {
-            spdlog::error("Failed to get appsrc element from pipeline");
-            return;
+            spdlog::warn("Diversity input on UDP {} unavailable", port);
+            continue;
+        }
+        m_diversity_socks.emplace_back(fd, port);
+        if (m_socket_filter != SocketFilterMode::OFF && !m_router->has_ssrc_routes())
+        {
+            auto filter = std::make_unique<RtpSocketFilter>();
+            filter->attach(fd, pts);
+            m_diversity_filters.push_back(std::move(filter));
         }
+    }
+    if (m_diversity_socks.empty())
+        return;
+    if (m_ingest_backend != IngestBackend::UDPSRC && m_ingest_backend != IngestBackend::SOCKET)
+        spdlog::warn("Diversity reception reads all inputs with poll()+recvmmsg(), ignoring the ingest backend");
+    spdlog::info("Diversity reception on {} UDP ports", m_diversity_socks.size() + 1);
+}
 
-        g_object_set(appsrc,
-                     "stream-type", 0,
-                     "is-live", TRUE,
-                     "format", GST_FORMAT_TIME,
-                     "block", FALSE,
-                     "do-timestamp", TRUE,
-                     NULL);
-        setup_appsrc_buffer_pool(appsrc, m_video_codec);
+std::unique_ptr<DiversityReceiver> GstRtpReceiver::make_diversity_receiver() const
+{
+    std::vector<DiversityReceiver::Input> inputs{{sock, m_port}};
+    for (const auto &input : m_diversity_socks)
+        inputs.push_back({input.first, input.second});
+    return std::make_unique<DiversityReceiver>(std::move(inputs), std::max(m_recv_batch, 16));
+}
+
+void GstRtpReceiver::switch_to_stream()
+{
+    stop_receiving();
+    m_loss_gate.reset(m_loss_policy);
+    m_streaming = true;
+    mark_restart();
+    check_fec_payload_type();
 
-        // Start socket reading thread
-        m_read_socket_run = true;
-        m_read_socket_thread = std::make_unique<std::thread>([this, appsrc]()
-                                                             {
-            pthread_setname_np(pthread_self(), "socket-reader");
-            const uint8_t video_pt = (m_video_codec == VideoCodec::H264) ? 96 : 97;
-            loop_read_socket(m_read_socket_run, this->sock, GST_APP_SRC(appsrc), video_pt, this->m_audio_cb); });
+    if (m_native_depay)
+    {
+        spdlog::info("Native RTP depacketizer, no GStreamer stream pipeline");
+        m_start_kind = "native";
+        start_native_stream();
+        return;
     }
-    else if (m_udp_appsrc)
+
+    spdlog::info("GSTREAMER STREAM PIPE=[{}]", construct_gstreamer_pipeline());
+    CachedPipeline::Shape shape;
+    shape.codec = m_video_codec;
+    shape.appsrc = uses_appsrc();
+    shape.port = m_port;
+    shape.alignment = m_alignment;
+    shape.appsink_drop = m_appsink_drop;
+    shape.appsink_max_buffers = m_appsink_max_buffers;
+    shape.appsink_callbacks = m_appsink_callbacks;
+    shape.recv_batch = m_recv_batch;
+    shape.capture = m_capture_ring;
+    if (!m_stream_pipeline || !(m_stream_pipeline->shape == shape))
     {
-        GstElement *appsrc = gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "appsrc");
-        if (!appsrc)
+        const uint64_t build_start_us = monotonic_us();
+        m_stream_pipeline.reset();
+        m_stream_pipeline = build_stream_pipeline(shape, *m_router, *m_audio_tap);
+        if (!m_stream_pipeline)
         {
-            spdlog::error("Failed to get appsrc element from pipeline");
+            spdlog::error("Cannot construct streaming pipeline");
             return;
         }
-        g_object_set(appsrc,
-                     "stream-type", 0,
-                     "is-live", TRUE,
-                     "format", GST_FORMAT_TIME,
-                     "block", FALSE,
-                     "do-timestamp", TRUE,
-                     NULL);
-        setup_appsrc_buffer_pool(appsrc, m_video_codec);
-        m_read_socket_run = true;
-        m_read_socket_thread = std::make_unique<std::thread>([this, appsrc]()
-                                                             {
-            pthread_setname_np(pthread_self(), "socket-reader");
-            const uint8_t video_pt = (m_video_codec == VideoCodec::H264) ? 96 : 97;
-            loop_read_socket(m_read_socket_run, this->sock, GST_APP_SRC(appsrc), video_pt, this->m_audio_cb); });
+        spdlog::info("Stream pipeline built in {} us", monotonic_us() - build_start_us);
+        m_start_kind = "built";
+        if (m_appsink_callbacks)
+        {
+            // Runs on the streaming thread right after h26Xparse: no queue, no thread hop.
+            GstAppSinkCallbacks callbacks{};
+            callbacks.new_sample = [](GstAppSink *appsink, gpointer user_data) -> GstFlowReturn
+            {
+                auto *self = static_cast<GstRtpReceiver *>(user_data);
+                GstSample *sample = gst_app_sink_pull_sample(appsink);
+                if (!sample)
+                    return GST_FLOW_EOS;
+                GstBuffer *buffer = gst_sample_get_buffer(sample);
+                if (buffer)
+                {
+                    auto frame = VideoFrame::wrap(buffer, self->m_video_codec, sample_timing(buffer));
+                    self->m_handoff_stats->on_delivery(buffer);
+                    if (frame)
+                        self->on_new_sample(std::move(frame));
+                }
+                gst_sample_unref(sample);
+                return GST_FLOW_OK;
+            };
+            gst_app_sink_set_callbacks(GST_APP_SINK(m_stream_pipeline->appsink), &callbacks, this, nullptr);
+        }
+    }
+    else
+    {
+        m_start_kind = "reused";
     }
+    m_gst_pipeline = m_stream_pipeline->pipeline;
+    m_app_sink_element = m_stream_pipeline->appsink;
+    m_handoff_stats = m_stream_pipeline->handoff.get();
+
+    if (uses_appsrc() && !unix_socket && !open_ingest_socket())
+        return;
+    if (uses_appsrc())
+        start_socket_reader(m_stream_pipeline->source);
 
-    // Setup appsink
-    m_app_sink_element = gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "out_appsink");
-    assert(m_app_sink_element);
     GObjectClass *klass = G_OBJECT_GET_CLASS(m_app_sink_element);
     gint max_buffers = -1;
     gint64 max_bytes = -1;
@@ -621,8 +2773,14 @@ void GstRtpReceiver::switch_to_stream()
         g_object_get(G_OBJECT(m_app_sink_element), "drop", &drop, NULL);
     }
 
-    spdlog::info("appsink config: max-buffers={} max-bytes={} drop={}",
-                 max_buffers, max_bytes, drop);
+    spdlog::info("appsink config: max-buffers={} max-bytes={} drop={} delivery={}",
+                 max_buffers, max_bytes, drop, m_appsink_callbacks ? "callback" : "pull thread");
+
+    if (m_appsink_callbacks)
+    {
+        gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
+        return;
+    }
 
     gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
 
@@ -8,21 +8,62 @@
 
 #include <stdint.h>
 #include <gst/gst.h>
+#include <atomic>
 #include <thread>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <string>
+#include <utility>
+
+#include "frame_timing.h"
+#include "video_frame.h"
+#include "loss_policy.h"
 
 #define MAX_PACKET_SIZE 4096
 #define RTP_HEADER_LEN 12
+#define MAX_RECV_BATCH 64
 
-enum class VideoCodec
+// How RTP reaches the depayloader: GStreamer's own udpsrc, or the appsrc socket
+// reader thread fed by select()/recv() (or recvmmsg), by io_uring or by an
+// AF_PACKET TPACKET_V3 mmap ring (zero copy, needs CAP_NET_RAW), or a shared-memory
+// ring filled by a co-located producer process (ShmPacketRing), or a pcap played back
+// with its original timing (PcapReplaySource, see set_replay_source()).
+enum class IngestBackend
 {
-    UNKNOWN = 0,
-    H264,
-    H265
+    UDPSRC = 0,
+    SOCKET,
+    IO_URING,
+    PACKET_RING,
+    SHM_RING,
+    PCAP_REPLAY
 };
 
+// Kernel-side filtering of the appsrc UDP socket (see RtpSocketFilter).
+enum class SocketFilterMode
+{
+    OFF = 0,
+    KERNEL,      // drop short / non-RTP / unknown payload types before they are queued
+    KERNEL_SPLIT // same, plus audio on its own SO_REUSEPORT socket and reader thread
+};
+
+class PacketRingReceiver;
+class ShmRingConsumer;
+class PcapReplaySource;
+class RtpSocketFilter;
+class RtpDepacketizer;
+class DiversityReceiver;
+class AppsinkHandoffStats;
+class KeyframeRequester;
+enum class KeyframeRequestFormat;
+class RtcpReporter;
+struct RtcpReceptionReport;
+struct ImpairmentConfig;
+class RtpCaptureRing;
+class RtpRouter;
+class AudioTap;
+class CachedPipeline;
+
 static VideoCodec video_codec(const char *str)
 {
     if (!strcmp(str, "h264"))
@@ -47,20 +88,103 @@ public:
      * The constructor is delayed, remember to use start_receiving()
      */
     explicit GstRtpReceiver(int udp_port, const VideoCodec &codec);
+    // Abstract AF_UNIX datagram socket; IngestBackend::SHM_RING does the same without a
+    // syscall per packet.
     explicit GstRtpReceiver(const char *s, const VideoCodec &codec);
     virtual ~GstRtpReceiver();
     // Depending on the codec, these are h264,h265 or mjpeg "frames" / frame buffers
     // The big advantage of gstreamer is that it seems to handle all those parsing quirks the best,
     // e.g. the frames on this cb should be easily passable to whatever decode api is available.
-    typedef std::function<void(std::shared_ptr<std::vector<uint8_t>> frame)> NEW_FRAME_CALLBACK;
+    // Frames are handed over without copying; VideoFrame::timing() holds the kernel receive
+    // times of the frame's packets when the ingest path has them.
+    typedef std::function<void(VideoFramePtr frame)> VIDEO_FRAME_CALLBACK;
+    // Compatibility: same frames copied into an owning vector.
+    typedef std::function<void(std::shared_ptr<std::vector<uint8_t>> frame, const FrameTiming &timing)> NEW_FRAME_CALLBACK;
     typedef std::function<void(std::shared_ptr<std::vector<uint8_t>> payload)> AUDIO_PAYLOAD_CALLBACK;
+    typedef std::function<void(const RtcpReceptionReport &report)> RECEPTION_REPORT_CALLBACK;
+    typedef std::function<void(uint8_t pt, uint32_t ssrc, const uint8_t *payload, size_t size)> TELEMETRY_CALLBACK;
+    void start_receiving(VIDEO_FRAME_CALLBACK cb);
     void start_receiving(NEW_FRAME_CALLBACK cb);
     void stop_receiving();
     void switch_to_file_playback(const char *file_path);
     void switch_to_stream();
     void set_udp_appsrc(bool enable);
+    // Where audio payloads (packets routed to "audio", payload type 98 by default) go,
+    // nullptr = nowhere. Safe while streaming on every ingest path, udpsrc included: the
+    // tap attaches and detaches without restarting the pipeline, and once this returns the
+    // previous callback is no longer running.
     void set_audio_payload_callback(AUDIO_PAYLOAD_CALLBACK cb);
     void set_alignment(int alignment);
+    // Number of datagrams pulled per recvmmsg() by the socket reader, <= 1 keeps select()+recv().
+    void set_recv_batch(int batch);
+    void set_ingest_backend(IngestBackend backend);
+    // Interface the AF_PACKET ring binds to; empty listens on all of them.
+    void set_packet_ring_interface(const std::string &iface);
+    // Low-latency profile: spin up to spin_us on non-blocking reads before blocking, with
+    // SO_BUSY_POLL / SO_PREFER_BUSY_POLL on the socket (0 = off). reader_cpu >= 0 pins the
+    // socket-reader thread to that core.
+    void set_busy_poll(uint32_t spin_us, int reader_cpu);
+    // Abstract socket name producers connect to for the shared-memory ring; empty = default.
+    void set_shm_ring_name(const std::string &name);
+    // pcap the PCAP_REPLAY backend plays into the ingest path instead of the socket, at
+    // `speed` times the recorded pace (0 = as fast as it is taken), `loops` times (0 =
+    // forever). Datagrams to the receiver's port, or all UDP if none are.
+    void set_replay_source(const std::string &path, double speed, uint32_t loops);
+    // Any mode other than OFF switches to the appsrc socket reader.
+    void set_socket_filter(SocketFilterMode mode);
+    // Depacketize RTP in the socket reader (RtpDepacketizer) instead of
+    // rtph26Xdepay ! h26Xparse ! appsink; frames always come out AU-aligned.
+    void set_native_depacketizer(bool enable);
+    // Hold time for putting video RTP back into sequence order before depacketization,
+    // 0 disables the reorder stage; any other value switches to the appsrc socket reader.
+    void set_reorder_window_us(uint32_t window_us);
+    // Extra UDP ports carrying copies of the same RTP stream from other ground radios; the
+    // first copy of each (SSRC, seq) wins. Switches to the appsrc socket reader.
+    void set_diversity_ports(const std::vector<int> &ports);
+    // Payload type of the XOR parity packets sent alongside the video (RtpFecDecoder), 0 = off.
+    // Lost video packets are rebuilt ahead of the reorder stage, which then holds at least
+    // 30 ms even without set_reorder_window_us(); switches to the appsrc reader. Routes may
+    // not claim the payload type; if one already does when the stream opens, FEC is off.
+    void set_fec_payload_type(int pt);
+    // RFC 8285 header extension id (1..14) in which the air unit sends each frame's capture
+    // time (clock_sync.h), 0 = none. Frames then carry it in FrameTiming::capture_ns for
+    // glass-to-glass latency; switches to the appsrc reader.
+    void set_capture_time_extension(int id);
+    // Deliver frames from appsink new-sample callbacks on the streaming thread instead of
+    // the try_pull thread (stream pipeline only; file playback keeps the pull thread).
+    void set_appsink_callbacks(bool enable);
+    // appsink queue for the pull thread: max-buffers (0 = unlimited) and whether to drop
+    // the oldest frame (leaky) or block upstream when it is full.
+    void set_appsink_queue(int max_buffers, bool drop);
+    // What to do with access units that lost packets (stream only; file playback forwards
+    // everything): hand them to the decoder, drop them, or drop until the next IRAP/IDR.
+    void set_loss_policy(LossPolicy policy);
+    // Ask the transmitter at `destination` (host:port) for a keyframe whenever a reference
+    // frame arrives damaged, at most every min_interval_ms while none has come (stream only).
+    void set_keyframe_requests(const std::string &destination, KeyframeRequestFormat format,
+                               uint32_t min_interval_ms);
+    // Send RTCP receiver reports (loss, jitter, highest seq, LSR/DLSR) for the video stream
+    // to `destination` (host:port) every interval_ms; switches to the appsrc socket reader.
+    void set_receiver_reports(const std::string &destination, uint32_t interval_ms);
+    // Hand every receiver report (loss, jitter) to `cb` on the socket reader thread, also
+    // when none are sent (-r unset: reports at the set_receiver_reports() interval, 1 s by
+    // default). Call after set_receiver_reports(); switches to the appsrc socket reader.
+    void set_reception_report_callback(RECEPTION_REPORT_CALLBACK cb);
+    // Simulated network impairment (loss, jitter, reordering, duplication, rate cap) on
+    // every received datagram before anything else sees it, for dev-PC benchmarks; see
+    // ImpairmentConfig::parse() for `spec`, empty = off. Switches to the appsrc reader.
+    bool set_impairment(const std::string &spec);
+    // Record every datagram as it comes off the socket (before impairment, FEC, reorder)
+    // into `ring`, which the caller owns and dumps; nullptr = off. Works on every ingest
+    // path, udpsrc included, so it does not change which reader runs.
+    void set_capture_ring(RtpCaptureRing *ring);
+    // Which handler each RTP packet goes to, by SSRC or payload type (RtpRouter::apply()
+    // for `spec`), on top of the default "<video pt>=video,98=audio". Safe while streaming:
+    // the readers pick the new table up with the next packet. Switches to the appsrc reader.
+    bool set_routes(const std::string &spec);
+    std::string describe_routes() const;
+    // Payloads routed to "telemetry", on the socket reader thread. Before start_receiving().
+    void set_telemetry_callback(TELEMETRY_CALLBACK cb);
     void fast_forward(double rate = 2.0);
     void fast_rewind(double rate = 2.0);
     void skip_duration(int64_t skip_ms);
@@ -72,11 +196,23 @@ private:
     std::string construct_gstreamer_pipeline();
     std::string construct_file_playback_pipeline(const char *file_path);
     void loop_pull_samples();
-    void on_new_sample(std::shared_ptr<std::vector<uint8_t>> sample);
+    void start_socket_reader(GstElement *appsrc);
+    void setup_socket_filters();
+    bool open_ingest_socket();
+    void open_diversity_sockets();
+    std::unique_ptr<DiversityReceiver> make_diversity_receiver() const;
+    void start_native_stream();
+    void check_fec_payload_type();
+    void ensure_fec_reorder_window();
+    void prepare_reader_thread();
+    bool uses_appsrc() const;
+    std::vector<uint8_t> filter_payload_types(bool audio) const;
+    void on_new_sample(VideoFramePtr frame);
+    void mark_restart();
     // The gstreamer pipeline
     GstElement *m_gst_pipeline = nullptr;
-    NEW_FRAME_CALLBACK m_cb;
-    AUDIO_PAYLOAD_CALLBACK m_audio_cb;
+    VIDEO_FRAME_CALLBACK m_cb;
+    std::unique_ptr<AudioTap> m_audio_tap;
     VideoCodec m_video_codec;
     int m_port;
     // appsink
@@ -89,7 +225,55 @@ private:
     bool m_udp_appsrc = false;
     bool m_read_socket_run = false;
     int m_alignment = 0; // 0: au, 1: nal
+    int m_recv_batch = 0;
+    IngestBackend m_ingest_backend = IngestBackend::UDPSRC;
+    std::string m_packet_ring_iface;
+    std::unique_ptr<PacketRingReceiver> m_packet_ring;
+    std::string m_shm_ring_name;
+    std::unique_ptr<ShmRingConsumer> m_shm_ring;
+    std::string m_replay_path;
+    double m_replay_speed = 1.0;
+    uint32_t m_replay_loops = 1;
+    std::unique_ptr<PcapReplaySource> m_replay;
+    uint32_t m_busy_poll_us = 0;
+    int m_reader_cpu = -1;
+    SocketFilterMode m_socket_filter = SocketFilterMode::OFF;
+    std::unique_ptr<RtpSocketFilter> m_video_filter;
+    std::unique_ptr<RtpSocketFilter> m_audio_filter;
+    int m_audio_sock = -1;
+    std::unique_ptr<std::thread> m_audio_socket_thread;
+    bool m_native_depay = false;
+    std::unique_ptr<RtpDepacketizer> m_depacketizer;
+    uint32_t m_reorder_window_us = 0;
+    std::vector<int> m_diversity_ports;
+    std::vector<std::pair<int, int>> m_diversity_socks; // fd, port
+    std::vector<std::unique_ptr<RtpSocketFilter>> m_diversity_filters;
+    uint8_t m_fec_pt = 0;
+    uint8_t m_capture_ext_id = 0;
+    bool m_appsink_callbacks = false;
+    int m_appsink_max_buffers = 0;
+    bool m_appsink_drop = true;
+    AppsinkHandoffStats *m_handoff_stats = nullptr; // of the running stream pipeline
+    LossPolicy m_loss_policy = LossPolicy::FORWARD;
+    LossGate m_loss_gate;
+    uint64_t m_loss_window_start_us = 0;
+    std::unique_ptr<KeyframeRequester> m_keyframe_requester;
+    std::unique_ptr<RtcpReporter> m_rtcp_reporter;
+    uint32_t m_rtcp_interval_ms = 1000;
+    RECEPTION_REPORT_CALLBACK m_report_cb;
+    std::unique_ptr<ImpairmentConfig> m_impairment;
+    RtpCaptureRing *m_capture_ring = nullptr;
+    std::unique_ptr<RtpRouter> m_router;
+    bool m_custom_routes = false;
+    bool m_streaming = false;
     std::unique_ptr<std::thread> m_read_socket_thread;
+    // Time to first frame after a (re)start, and whether the pipeline was built for it.
+    std::atomic<bool> m_first_frame_pending{false};
+    uint64_t m_start_us = 0;
+    const char *m_start_kind = "built";
+    // Stopped (NULL), not destroyed, between runs; declared last so they go first.
+    std::unique_ptr<CachedPipeline> m_stream_pipeline;
+    std::unique_ptr<CachedPipeline> m_file_pipeline;
 
     // dvr
     void set_playback_rate(double rate);
@@ -0,0 +1,95 @@
+#include "keyframe_requester.h"
+
+#include <algorithm>
+#include <random>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udp_target.h"
+
+namespace {
+constexpr uint8_t kRtcpPsfb = 206;
+constexpr uint8_t kPsfbPli = 1;
+constexpr char kTextRequest[] = "keyframe\n";
+} // namespace
+
+KeyframeRequester::KeyframeRequester(KeyframeRequestFormat format, uint32_t min_interval_ms)
+    : format_(format), min_interval_us_(static_cast<uint64_t>(min_interval_ms) * 1000)
+{
+    std::random_device rd;
+    sender_ssrc_ = rd();
+}
+
+KeyframeRequester::~KeyframeRequester()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool KeyframeRequester::open(const std::string &destination)
+{
+    fd_ = connect_udp_target(destination, "Keyframe request");
+    if (fd_ < 0) {
+        return false;
+    }
+    destination_ = destination;
+    return true;
+}
+
+void KeyframeRequester::send_request()
+{
+    if (format_ == KeyframeRequestFormat::TEXT) {
+        send(fd_, kTextRequest, sizeof(kTextRequest) - 1, 0);
+        return;
+    }
+    // The media SSRC is left 0: single-stream senders key off the feedback type alone.
+    uint8_t pli[12] = {static_cast<uint8_t>(0x80 | kPsfbPli), kRtcpPsfb, 0, 2};
+    pli[4] = static_cast<uint8_t>(sender_ssrc_ >> 24);
+    pli[5] = static_cast<uint8_t>(sender_ssrc_ >> 16);
+    pli[6] = static_cast<uint8_t>(sender_ssrc_ >> 8);
+    pli[7] = static_cast<uint8_t>(sender_ssrc_);
+    send(fd_, pli, sizeof(pli), 0);
+}
+
+void KeyframeRequester::on_frame(const VideoFrame &frame, uint64_t now_us)
+{
+    if (fd_ < 0) {
+        return;
+    }
+    if (frame.keyframe() && !frame.incomplete()) {
+        if (waiting_) {
+            const uint64_t turnaround = now_us - first_request_us_;
+            ++stats_.turnarounds;
+            stats_.turnaround_us_sum += turnaround;
+            stats_.turnaround_us_max = std::max(stats_.turnaround_us_max, turnaround);
+            waiting_ = false;
+        }
+        return;
+    }
+    const bool damaged = frame.incomplete() && frame.reference();
+    if (!damaged && !waiting_) {
+        return;
+    }
+    // Keep asking while the keyframe is overdue, in case a request or its answer got lost.
+    if (last_request_us_ && now_us - last_request_us_ < min_interval_us_) {
+        if (damaged) {
+            ++stats_.suppressed;
+        }
+        return;
+    }
+    send_request();
+    ++stats_.requests;
+    last_request_us_ = now_us;
+    if (!waiting_) {
+        waiting_ = true;
+        first_request_us_ = now_us;
+    }
+}
+
+KeyframeRequester::Stats KeyframeRequester::take_stats()
+{
+    Stats out = stats_;
+    stats_ = Stats{};
+    return out;
+}
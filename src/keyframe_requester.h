@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "gstrtpreceiver.h"
+
+// How a keyframe request looks on the wire.
+enum class KeyframeRequestFormat {
+    RTCP_PLI = 0, // RFC 4585 Picture Loss Indication (PSFB, FMT 1), 12 bytes
+    TEXT          // the ASCII datagram "keyframe\n", for air units with a simple control port
+};
+
+// Feedback channel to the transmitter: asks for a keyframe as soon as a reference frame
+// arrives damaged instead of waiting for the encoder's next periodic IDR. Requests are
+// rate-limited and repeated while no intact keyframe has shown up, and the time from
+// the first request to that keyframe is measured. Not thread-safe; driven from the
+// frame callback.
+class KeyframeRequester {
+public:
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t suppressed = 0;  // wanted to ask, but inside the minimum interval
+        uint64_t turnarounds = 0; // request -> intact keyframe
+        uint64_t turnaround_us_sum = 0;
+        uint64_t turnaround_us_max = 0;
+    };
+
+    KeyframeRequester(KeyframeRequestFormat format, uint32_t min_interval_ms);
+    ~KeyframeRequester();
+    KeyframeRequester(const KeyframeRequester &) = delete;
+    KeyframeRequester &operator=(const KeyframeRequester &) = delete;
+
+    // "host:port" of the transmitter's request port.
+    bool open(const std::string &destination);
+    const std::string &destination() const { return destination_; }
+
+    // Losing a non-reference frame (VideoFrame::reference()) costs that frame only, so
+    // only damaged reference frames ask for a keyframe.
+    void on_frame(const VideoFrame &frame, uint64_t now_us);
+    Stats take_stats();
+
+private:
+    void send_request();
+
+    KeyframeRequestFormat format_;
+    uint64_t min_interval_us_;
+    int fd_{-1};
+    std::string destination_;
+    uint32_t sender_ssrc_{0};
+    bool waiting_{false};
+    uint64_t first_request_us_{0};
+    uint64_t last_request_us_{0};
+    Stats stats_;
+};
@@ -0,0 +1,131 @@
+#include "link_estimator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udp_target.h"
+
+LinkEstimator::LinkEstimator(const Config &config)
+    : config_(config)
+{
+    config_.max_kbps = std::max(config_.max_kbps, config_.min_kbps);
+    config_.start_kbps = std::clamp(config_.start_kbps, config_.min_kbps, config_.max_kbps);
+    target_kbps_ = config_.start_kbps;
+    estimate_.target_kbps = config_.start_kbps;
+}
+
+const LinkEstimate &LinkEstimator::update(const LinkSample &sample)
+{
+    const double dt = std::clamp(sample.duration_s, 0.1, 5.0);
+
+    // The floor follows drops at once and rises slowly; a delay-driven decrease moves it up
+    // to the jitter that caused it (below), so only a further rise counts as overuse again.
+    bool delay_overuse = false;
+    if (jitter_floor_ms_ < 0.0 || sample.jitter_ms < jitter_floor_ms_) {
+        jitter_floor_ms_ = sample.jitter_ms;
+    } else {
+        delay_overuse = sample.jitter_ms > jitter_floor_ms_ + config_.jitter_margin_ms;
+        jitter_floor_ms_ += (sample.jitter_ms - jitter_floor_ms_) * std::min(1.0, 0.02 * dt);
+    }
+
+    LinkState state;
+    const char *reason;
+    if (sample.decoder_eagain > 0 || sample.queue_depth > config_.queue_limit) {
+        state = LinkState::DECREASE;
+        reason = "decoder";
+        target_kbps_ *= config_.backoff;
+    } else if (delay_overuse) {
+        state = LinkState::DECREASE;
+        reason = "delay";
+        target_kbps_ *= config_.backoff;
+        jitter_floor_ms_ = sample.jitter_ms;
+    } else if (sample.loss > config_.loss_high) {
+        state = LinkState::DECREASE;
+        reason = "loss";
+        target_kbps_ *= 1.0 - 0.5 * std::min(sample.loss, 1.0);
+    } else if (sample.loss > config_.loss_low) {
+        state = LinkState::HOLD;
+        reason = "loss";
+    } else if (hold_ > 0) {
+        state = LinkState::HOLD;
+        reason = "settle";
+        --hold_;
+    } else {
+        state = LinkState::INCREASE;
+        reason = "probe";
+        target_kbps_ += std::max(config_.min_step_kbps * dt, target_kbps_ * config_.increase_per_s * dt);
+    }
+    if (state == LinkState::DECREASE) {
+        hold_ = config_.hold_windows;
+    }
+    target_kbps_ = std::clamp(target_kbps_, static_cast<double>(config_.min_kbps), static_cast<double>(config_.max_kbps));
+
+    estimate_.target_kbps = static_cast<uint32_t>(target_kbps_);
+    estimate_.state = state;
+    estimate_.reason = reason;
+    return estimate_;
+}
+
+const char *LinkEstimator::state_name(LinkState state)
+{
+    switch (state) {
+    case LinkState::INCREASE:
+        return "increase";
+    case LinkState::DECREASE:
+        return "decrease";
+    default:
+        return "hold";
+    }
+}
+
+std::string link_sample_to_trace(const LinkSample &sample)
+{
+    char line[128];
+    std::snprintf(line, sizeof(line), "%.3f,%.4f,%.2f,%u,%u", sample.duration_s, sample.loss, sample.jitter_ms,
+                  sample.queue_depth, sample.decoder_eagain);
+    return line;
+}
+
+bool link_sample_from_trace(const std::string &line, LinkSample &sample)
+{
+    LinkSample parsed;
+    if (std::sscanf(line.c_str(), "%lf,%lf,%lf,%u,%u", &parsed.duration_s, &parsed.loss, &parsed.jitter_ms,
+                    &parsed.queue_depth, &parsed.decoder_eagain) != 5) {
+        return false;
+    }
+    sample = parsed;
+    return true;
+}
+
+BitrateHintPublisher::~BitrateHintPublisher()
+{
+    for (int fd : fds_) {
+        close(fd);
+    }
+}
+
+bool BitrateHintPublisher::add_target(const std::string &destination)
+{
+    const int fd = connect_udp_target(destination, "Bitrate hint");
+    if (fd < 0) {
+        return false;
+    }
+    fds_.push_back(fd);
+    return true;
+}
+
+void BitrateHintPublisher::publish(const LinkEstimate &estimate, const LinkSample &sample)
+{
+    char msg[160];
+    const int n = std::snprintf(msg, sizeof(msg), "bitrate_kbps=%u state=%s reason=%s loss_pct=%.1f jitter_ms=%.2f\n",
+                                estimate.target_kbps, LinkEstimator::state_name(estimate.state), estimate.reason,
+                                sample.loss * 100.0, sample.jitter_ms);
+    if (n <= 0) {
+        return;
+    }
+    for (int fd : fds_) {
+        send(fd, msg, static_cast<size_t>(std::min(n, static_cast<int>(sizeof(msg)) - 1)), 0);
+    }
+}
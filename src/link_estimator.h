@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One observation window, normally one receiver report interval.
+struct LinkSample {
+    double duration_s = 1.0;
+    double loss = 0.0;           // fraction of video packets lost, 0..1
+    double jitter_ms = 0.0;      // RFC 3550 interarrival jitter
+    uint32_t queue_depth = 0;    // deepest decode_queue seen in the window
+    uint32_t decoder_eagain = 0; // codec_write() calls that returned EAGAIN
+};
+
+enum class LinkState { INCREASE, HOLD, DECREASE };
+
+struct LinkEstimate {
+    uint32_t target_kbps = 0;
+    LinkState state = LinkState::HOLD;
+    const char *reason = "start"; // the signal that decided the state
+};
+
+// Recommended encoder bitrate from what the ground station sees, in the spirit of GCC's
+// loss- and delay-based controllers with AIMD steps: back off multiplicatively when the
+// decoder falls behind (decode_queue depth, EAGAIN) or jitter climbs above its running
+// floor, i.e. something on the path started queuing (the floor then moves up to that
+// jitter, so one step in link noise costs one backoff); back off in proportion to heavy
+// loss; hold on moderate loss and right after a decrease; otherwise probe upward a few
+// percent per second. The aim is to sit just under the rate where latency starts to
+// build. Pure arithmetic on LinkSample, so recorded traces replay exactly
+// (tools/link_estimator_replay).
+class LinkEstimator {
+public:
+    struct Config {
+        uint32_t min_kbps = 2000;
+        uint32_t max_kbps = 20000;
+        uint32_t start_kbps = 8000;
+        double loss_high = 0.10;       // above: decrease by loss / 2
+        double loss_low = 0.02;        // below: free to probe
+        double jitter_margin_ms = 3.0; // jitter this far above its floor = queuing on the link
+        uint32_t queue_limit = 2;      // decode_queue depth that means the decoder falls behind
+        double backoff = 0.85;         // on overuse (delay, decoder)
+        double increase_per_s = 0.05;  // probe step, fraction of the target per second
+        uint32_t min_step_kbps = 100;  // per second
+        int hold_windows = 2;          // no probing right after a decrease
+    };
+
+    explicit LinkEstimator(const Config &config);
+
+    const LinkEstimate &update(const LinkSample &sample);
+    const LinkEstimate &estimate() const { return estimate_; }
+    const Config &config() const { return config_; }
+
+    static const char *state_name(LinkState state);
+
+private:
+    Config config_;
+    double target_kbps_;
+    double jitter_floor_ms_{-1.0};
+    int hold_{0};
+    LinkEstimate estimate_;
+};
+
+// Trace lines as logged by the receiver ("[link] sample <line>") and read back by the
+// replay tool: duration_s,loss,jitter_ms,queue_depth,decoder_eagain
+std::string link_sample_to_trace(const LinkSample &sample);
+bool link_sample_from_trace(const std::string &line, LinkSample &sample);
+
+// Publishes every estimate as the text datagram
+//   "bitrate_kbps=<n> state=<increase|hold|decrease> reason=<...> loss_pct=<x> jitter_ms=<x>\n"
+// to the air unit and any local consumers (OSD, logger).
+class BitrateHintPublisher {
+public:
+    BitrateHintPublisher() = default;
+    ~BitrateHintPublisher();
+    BitrateHintPublisher(const BitrateHintPublisher &) = delete;
+    BitrateHintPublisher &operator=(const BitrateHintPublisher &) = delete;
+
+    // "host:port"; false if it cannot be resolved / connected.
+    bool add_target(const std::string &destination);
+    size_t targets() const { return fds_.size(); }
+
+    void publish(const LinkEstimate &estimate, const LinkSample &sample);
+
+private:
+    std::vector<int> fds_;
+};
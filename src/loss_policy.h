@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// What happens to an access unit that lost packets on the way in.
+enum class LossPolicy {
+    FORWARD = 0,     // hand it to the decoder anyway (old behaviour)
+    DROP_FRAME,      // drop just this access unit
+    DROP_UNTIL_IRAP  // drop it and everything after it until the next IRAP/IDR picture
+};
+
+// Applies a LossPolicy to the frames leaving the receiver. Frames only need to say whether
+// they are incomplete and whether they start a new coded video sequence; admit() decides
+// whether the decoder gets to see them and keeps per-policy counters. Not thread-safe.
+class LossGate {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t incomplete = 0;
+        uint64_t forwarded_partial = 0;  // FORWARD: incomplete frames passed on
+        uint64_t dropped_frame = 0;      // DROP_FRAME, and the broken frame under DROP_UNTIL_IRAP
+        uint64_t dropped_until_irap = 0; // intact frames dropped while waiting for an IRAP
+        uint64_t recoveries = 0;         // first loss -> next intact IRAP
+        uint64_t recovery_us_sum = 0;
+        uint64_t recovery_us_max = 0;
+    };
+
+    void reset(LossPolicy policy)
+    {
+        policy_ = policy;
+        waiting_irap_ = false;
+        damaged_since_us_ = 0;
+    }
+
+    LossPolicy policy() const { return policy_; }
+
+    bool admit(bool incomplete, bool irap, uint64_t now_us)
+    {
+        ++stats_.frames;
+        if (incomplete) {
+            ++stats_.incomplete;
+            // Until an intact IRAP arrives the picture is damaged whatever the policy does.
+            if (!damaged_since_us_) {
+                damaged_since_us_ = now_us;
+            }
+        } else if (irap && damaged_since_us_) {
+            const uint64_t recovery_us = now_us - damaged_since_us_;
+            ++stats_.recoveries;
+            stats_.recovery_us_sum += recovery_us;
+            stats_.recovery_us_max = std::max(stats_.recovery_us_max, recovery_us);
+            damaged_since_us_ = 0;
+        }
+
+        switch (policy_) {
+        case LossPolicy::FORWARD:
+            if (incomplete) {
+                ++stats_.forwarded_partial;
+            }
+            return true;
+        case LossPolicy::DROP_FRAME:
+            if (incomplete) {
+                ++stats_.dropped_frame;
+                return false;
+            }
+            return true;
+        case LossPolicy::DROP_UNTIL_IRAP:
+            if (incomplete) {
+                ++stats_.dropped_frame;
+                waiting_irap_ = true;
+                return false;
+            }
+            if (waiting_irap_ && !irap) {
+                ++stats_.dropped_until_irap;
+                return false;
+            }
+            waiting_irap_ = false;
+            return true;
+        }
+        return true;
+    }
+
+    Stats take_stats()
+    {
+        Stats out = stats_;
+        stats_ = Stats{};
+        return out;
+    }
+
+private:
+    LossPolicy policy_ = LossPolicy::FORWARD;
+    bool waiting_irap_ = false;
+    uint64_t damaged_since_us_ = 0;
+    Stats stats_;
+};
+
+inline const char *loss_policy_name(LossPolicy policy)
+{
+    switch (policy) {
+    case LossPolicy::DROP_FRAME:
+        return "drop-frame";
+    case LossPolicy::DROP_UNTIL_IRAP:
+        return "drop-until-irap";
+    default:
+        return "forward";
+    }
+}
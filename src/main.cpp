@@ -2,6 +2,11 @@
 
 // #include <codec.h>
 #include "gstrtpreceiver.h"
+#include "keyframe_requester.h"
+#include "rtcp_reporter.h"
+#include "link_estimator.h"
+#include "rtp_capture_ring.h"
+#include "clock_sync.h"
 #include "dvr_recorder.h"
 #include "audio_receiver.h"
 #include "scheduling_helper.hpp"
@@ -11,6 +16,7 @@
 #include <execinfo.h>
 #include <cerrno>
 #include <cstring>
+#include <cstdio>
 #include <thread>
 #include <atomic>
 #include <netinet/in.h>
@@ -19,6 +25,11 @@
 #include <sys/select.h>
 #include <unistd.h>
 #include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+#include <vector>
 
 extern "C"
 {
@@ -43,6 +54,38 @@ struct CmdOptions
     int enable_audio = 0; // enable UDP appsrc + RTP payload filter for audio present
     int alignment = 0;    // 0: au (default), 1: nal
     int dec_mode = 1;     // 0: STREAM_TYPE_STREAM, 1: STREAM_TYPE_FRAME (default)
+    int recv_batch = 0;   // appsrc socket reader: 0/1 select+recv, >1 datagrams per recvmmsg
+    int ingest = 0;       // 0: udpsrc, 1: appsrc socket reader, 2: io_uring, 3: AF_PACKET ring, 4: shared-memory ring, 5: pcap replay (2-5 fall back to 1)
+    std::string ingest_iface; // AF_PACKET ring interface (empty = all) or shared-memory ring name (empty = amldigitalfpv)
+    int socket_filter = 0; // 0: off, 1: kernel RTP filter, 2: filter + separate audio socket
+    int native_depay = 0;  // 1: in-process RTP depacketizer instead of rtph26Xdepay/h26Xparse/appsink
+    int reorder_us = 0;    // RTP reorder hold window in microseconds, 0 = off
+    std::vector<int> diversity_ports; // extra UDP ports with copies of the stream (first copy wins)
+    int appsink_callbacks = 0; // 1: deliver frames from appsink new-sample callbacks instead of the pull thread
+    int appsink_max_buffers = 0; // appsink queue depth for the pull thread, 0 = unlimited
+    int busy_poll_us = 0;  // socket reader spin budget before blocking (SO_BUSY_POLL), 0 = off
+    int reader_cpu = -1;   // pin the socket-reader thread to this core, -1 = no pinning
+    int appsink_drop = 1;  // 1: drop the oldest frame when the appsink queue is full, 0: block upstream
+    int loss_policy = 0;   // 0: forward incomplete frames, 1: drop them, 2: drop until the next IRAP/IDR
+    int fec_pt = 0;        // payload type of the XOR parity packets, 0 = no FEC
+    std::string keyframe_target;  // host:port the keyframe requests go to, empty = off
+    int keyframe_format = 0;      // 0: RTCP PLI, 1: "keyframe\n" text datagram
+    int keyframe_interval_ms = 200;
+    std::string rtcp_target;      // host:port the RTCP receiver reports go to, empty = off
+    int rtcp_interval_ms = 1000;
+    std::vector<std::string> bitrate_hint_targets; // host:port list for the link estimator's hints, empty = off
+    LinkEstimator::Config link_config;
+    std::string impairment; // ingest impairment spec (dev/benchmark only), empty = off
+    int capture_s = 0;      // seconds of raw RTP kept in memory for pcap dumps, 0 = off
+    int capture_mb = 16;    // capture ring size, caps capture_s at high bitrates
+    std::string capture_dir; // where dumps go, empty = /storage (or /tmp without it)
+    std::string replay_path; // pcap played into the ingest path instead of the socket (-i 5)
+    double replay_speed = 1.0; // 0 = as fast as possible
+    int replay_loops = 1;      // 0 = forever
+    std::string routes;        // RTP routes on top of the defaults (RtpRouter), empty = defaults
+    std::string clock_sync_target; // host:port of the air unit's clock sync responder, empty = off
+    int capture_ext_id = 0;        // RTP header extension id with the air capture time, 0 = none
+    std::string log_level = "info";
 };
 
 int signal_flag = 0;
@@ -54,14 +97,27 @@ std::unique_ptr<GstRtpReceiver>
 std::unique_ptr<DvrRecorder> g_dvr;
 std::unique_ptr<AudioReceiver> g_audio;
 std::mutex g_receiver_mutex;
-moodycamel::BlockingConcurrentQueue<std::shared_ptr<std::vector<uint8_t>>> decode_queue;
+moodycamel::BlockingConcurrentQueue<VideoFramePtr> decode_queue;
 std::atomic<bool> decoding_active{false};
 std::thread decode_thread;
 std::atomic<uint64_t> last_queue_log_ms{0};
 std::thread dvr_command_thread;
 std::atomic<bool> dvr_command_running{false};
 std::atomic<bool> g_audio_enabled{false};
-GstRtpReceiver::NEW_FRAME_CALLBACK g_video_cb;
+// Last frame to the decode queue and the last sound=1/0, for the video gap a toggle causes.
+std::atomic<uint64_t> g_last_frame_ms{0};
+std::atomic<uint64_t> g_audio_toggle_ms{0};
+// Link estimator inputs from the decode thread, taken once per receiver report.
+std::atomic<uint32_t> g_decode_queue_max{0};
+std::atomic<uint32_t> g_decoder_eagain{0};
+std::unique_ptr<LinkEstimator> g_link_estimator;
+std::unique_ptr<BitrateHintPublisher> g_bitrate_hints;
+GstRtpReceiver::VIDEO_FRAME_CALLBACK g_video_cb;
+// Raw RTP capture ring; dumped on "capture=1" and from the crash handler.
+std::unique_ptr<RtpCaptureRing> g_capture;
+char g_capture_crash_path[256] = "";
+// Air unit clock offset/drift; maps frame capture times into our CLOCK_MONOTONIC.
+std::unique_ptr<ClockSyncClient> g_clock_sync;
 
 static uint64_t monotonic_ms_main()
 {
@@ -70,6 +126,142 @@ static uint64_t monotonic_ms_main()
         .count();
 }
 
+// Per-second receive → codec_write latency split, from the kernel receive timestamps and
+// the frame's stage marks. network: packet arrival spread within a frame and
+// frame-to-frame interval jitter; ours: kernel → frame complete (reader + depay/parse),
+// frame complete → codec_write and codec_write itself. The slowest frame of the second
+// is traced stage by stage with its RTP and NAL metadata.
+// With capture times from the air unit and clock sync (-E, -S) also glass-to-glass:
+// capture → kernel receive, capture → codec_write, and capture → display estimated by
+// adding the decoder's own input → display delay.
+class LatencyStats
+{
+public:
+    void add(const VideoFrame &frame, uint64_t write_mono_ns)
+    {
+        const FrameTiming &timing = frame.timing();
+        const uint64_t write_ns = frame.stage_ns(VideoFrame::Stage::DECODE_SUBMIT);
+        const uint64_t decoded_ns = frame.stage_ns(VideoFrame::Stage::DECODED);
+        uint64_t capture_ns = 0;
+        if (timing.capture_ns && g_clock_sync && g_clock_sync->to_ground_ns(timing.capture_ns, capture_ns))
+        {
+            ++m_glass_frames;
+            m_capture_to_write.add(write_mono_ns > capture_ns ? write_mono_ns - capture_ns : 0);
+            if (timing.kernel)
+            {
+                // Receive stamps are CLOCK_REALTIME, the clock sync maps into CLOCK_MONOTONIC.
+                const uint64_t rx_mono_ns = timing.first_rx_ns - (write_ns - write_mono_ns);
+                m_capture_to_rx.add(rx_mono_ns > capture_ns ? rx_mono_ns - capture_ns : 0);
+            }
+        }
+        if (!timing.kernel)
+            return;
+        ++m_frames;
+        m_socket_to_write.add(write_ns - timing.first_rx_ns);
+        m_spread.add(timing.last_rx_ns - timing.first_rx_ns);
+        m_assembly.add(timing.complete_ns - timing.last_rx_ns);
+        m_queue.add(write_ns - timing.complete_ns);
+        m_codec_write.add(decoded_ns - write_ns);
+        if (decoded_ns - timing.first_rx_ns > m_slowest_ns)
+        {
+            m_slowest_ns = decoded_ns - timing.first_rx_ns;
+            m_slowest = trace(frame);
+        }
+        if (m_last_first_rx_ns)
+        {
+            const int64_t interval = static_cast<int64_t>(timing.first_rx_ns - m_last_first_rx_ns);
+            if (m_last_interval_ns)
+                m_interval_jitter.add(static_cast<uint64_t>(std::llabs(interval - m_last_interval_ns)));
+            m_last_interval_ns = interval;
+        }
+        m_last_first_rx_ns = timing.first_rx_ns;
+    }
+
+    void maybe_report()
+    {
+        const uint64_t now = monotonic_ms_main();
+        if (now - m_window_start_ms < 1000)
+            return;
+        if (m_frames)
+            spdlog::debug("[latency] frames {} socket->codec_write avg {:.2f} max {:.2f} ms | network: rx spread avg {:.2f} max {:.2f} ms, "
+                          "interval jitter avg {:.2f} max {:.2f} ms | ours: rx->frame avg {:.2f} max {:.2f} ms, frame->codec_write avg {:.2f} max {:.2f} ms, "
+                          "codec_write avg {:.2f} max {:.2f} ms",
+                          m_frames, m_socket_to_write.avg_ms(), m_socket_to_write.max_ms(), m_spread.avg_ms(), m_spread.max_ms(),
+                          m_interval_jitter.avg_ms(), m_interval_jitter.max_ms(), m_assembly.avg_ms(), m_assembly.max_ms(),
+                          m_queue.avg_ms(), m_queue.max_ms(), m_codec_write.avg_ms(), m_codec_write.max_ms());
+        if (m_frames)
+            spdlog::debug("[trace] slowest frame: {}", m_slowest);
+        if (m_glass_frames)
+        {
+            const int decoder_delay_ms = aml_get_video_delay_ms();
+            const auto clock = g_clock_sync->estimate();
+            spdlog::debug("[glass] frames {} capture->rx avg {:.2f} max {:.2f} ms, capture->codec_write avg {:.2f} max {:.2f} ms, "
+                          "capture->display ~{:.2f} ms (decoder delay {} ms) | clock rtt {:.2f} ms drift {:.1f} ppm",
+                          m_glass_frames, m_capture_to_rx.avg_ms(), m_capture_to_rx.max_ms(), m_capture_to_write.avg_ms(),
+                          m_capture_to_write.max_ms(), m_capture_to_write.avg_ms() + std::max(decoder_delay_ms, 0),
+                          decoder_delay_ms, clock.rtt_ns / 1e6, clock.drift_ppm);
+        }
+        const uint64_t last_first_rx_ns = m_last_first_rx_ns;
+        const int64_t last_interval_ns = m_last_interval_ns;
+        *this = LatencyStats{};
+        m_window_start_ms = now;
+        m_last_first_rx_ns = last_first_rx_ns;
+        m_last_interval_ns = last_interval_ns;
+    }
+
+private:
+    // Stage times relative to the first packet's arrival, for the one frame per second
+    // that gets logged.
+    static std::string trace(const VideoFrame &frame)
+    {
+        const FrameMeta &meta = frame.meta();
+        const auto since_rx = [&meta](uint64_t ns)
+        { return ns ? (static_cast<int64_t>(ns - meta.timing.first_rx_ns)) / 1e6 : 0.0; };
+        std::string out = meta.rtp_valid ? fmt::format("rtp ts {} seq {}-{}, ", meta.rtp_timestamp, meta.first_seq, meta.last_seq)
+                                         : std::string();
+        out += fmt::format("{} bytes{}{}{}, nal types {:#x} tid {} | last packet +{:.2f} complete +{:.2f} queued +{:.2f} "
+                           "codec_write +{:.2f} returned +{:.2f} ms",
+                           frame.size(), frame.keyframe() ? " keyframe" : "", frame.incomplete() ? " incomplete" : "",
+                           frame.reference() ? "" : " non-ref", meta.nals.types, meta.nals.temporal_id,
+                           since_rx(meta.timing.last_rx_ns), since_rx(meta.timing.complete_ns),
+                           since_rx(frame.stage_ns(VideoFrame::Stage::QUEUED)),
+                           since_rx(frame.stage_ns(VideoFrame::Stage::DECODE_SUBMIT)),
+                           since_rx(frame.stage_ns(VideoFrame::Stage::DECODED)));
+        return out;
+    }
+
+    struct Span
+    {
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        uint64_t count = 0;
+        void add(uint64_t ns)
+        {
+            sum += ns;
+            max = std::max(max, ns);
+            ++count;
+        }
+        double avg_ms() const { return count ? static_cast<double>(sum) / count / 1e6 : 0.0; }
+        double max_ms() const { return static_cast<double>(max) / 1e6; }
+    };
+
+    uint64_t m_window_start_ms = monotonic_ms_main();
+    uint64_t m_frames = 0;
+    Span m_socket_to_write;
+    Span m_spread;
+    Span m_interval_jitter;
+    Span m_assembly;
+    Span m_queue;
+    Span m_codec_write;
+    uint64_t m_slowest_ns = 0;
+    std::string m_slowest;
+    uint64_t m_glass_frames = 0;
+    Span m_capture_to_rx;
+    Span m_capture_to_write;
+    uint64_t m_last_first_rx_ns = 0;
+    int64_t m_last_interval_ns = 0;
+};
+
 void signal_handler(int sig)
 {
     void *array[10];
@@ -81,6 +273,11 @@ void signal_handler(int sig)
     // 打印调用栈
     fprintf(stderr, "Error: signal %d:\n", sig);
     backtrace_symbols_fd(array, size, STDERR_FILENO);
+    if (g_capture)
+    {
+        g_capture->write_pcap_from_signal(g_capture_crash_path);
+        fprintf(stderr, "RTP capture written to %s\n", g_capture_crash_path);
+    }
     exit(1);
 }
 
@@ -98,6 +295,35 @@ void sig_handler(int signum)
     return_value = signum;
 }
 
+std::string capture_dir()
+{
+    if (!g_opts.capture_dir.empty())
+        return g_opts.capture_dir;
+    return access("/storage", W_OK) == 0 ? "/storage" : "/tmp";
+}
+
+// Writes the capture ring to <dir>/rtp_capture_<time>.pcap; returns the path, empty on failure.
+std::string dump_capture()
+{
+    if (!g_capture)
+        return {};
+    char name[64];
+    const time_t now = time(nullptr);
+    tm local{};
+    localtime_r(&now, &local);
+    strftime(name, sizeof(name), "rtp_capture_%Y%m%d_%H%M%S.pcap", &local);
+    const std::string path = capture_dir() + "/" + name;
+    const auto result = g_capture->write_pcap(path);
+    if (!result.ok)
+    {
+        spdlog::error("RTP capture dump to {} failed: {}", path, strerror(errno));
+        return {};
+    }
+    spdlog::info("RTP capture: {} packets over {:.1f} s written to {}", result.packets,
+                 result.packets ? (result.last_ns - result.first_ns) / 1e9 : 0.0, path);
+    return path;
+}
+
 void dvr_command_loop(int port)
 {
     SchedulingHelper::set_thread_params_max_realtime("DvrCommand", 10);
@@ -143,7 +369,7 @@ void dvr_command_loop(int port)
         }
         if (ret > 0 && FD_ISSET(sock, &rfds))
         {
-            char buffer[128];
+            char buffer[512];
             sockaddr_in sender{};
             socklen_t sender_len = sizeof(sender);
             ssize_t len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0,
@@ -182,17 +408,16 @@ void dvr_command_loop(int port)
                             g_audio.reset();
                         }
                     }
+                    // The tap attaches to the running ingest path; video keeps flowing.
                     if (receiver)
                     {
-                        receiver->stop_receiving();
-                        receiver->set_udp_appsrc(true);
+                        g_audio_toggle_ms.store(monotonic_ms_main());
                         receiver->set_audio_payload_callback([&](std::shared_ptr<std::vector<uint8_t>> payload)
                                                              {
                             if (g_audio) {
                                 g_audio->enqueue_payload(payload);
                             }
                         });
-                        receiver->start_receiving(g_video_cb);
                     }
                 }
                 else if (payload.find("sound=0") != std::string::npos)
@@ -200,18 +425,39 @@ void dvr_command_loop(int port)
                     spdlog::info("Audio command: disable");
                     g_audio_enabled.store(false);
                     std::lock_guard<std::mutex> lock(g_receiver_mutex);
+                    // Detach first: once this returns no reader touches g_audio anymore.
+                    if (receiver)
+                    {
+                        g_audio_toggle_ms.store(monotonic_ms_main());
+                        receiver->set_audio_payload_callback(nullptr);
+                    }
                     if (g_audio)
                     {
                         g_audio->stop();
                         g_audio.reset();
                     }
-                    if (receiver)
+                }
+                else if (payload.find("capture=1") != std::string::npos)
+                {
+                    spdlog::info("Capture command: dump");
+                    const std::string reply = "capture=" + dump_capture();
+                    sendto(sock, reply.c_str(), reply.size(), 0,
+                           reinterpret_cast<sockaddr *>(&sender), sender_len);
+                }
+                else if (payload.rfind("route=", 0) == 0)
+                {
+                    // route=<spec>, e.g. "route=110=fwd:127.0.0.1:5700"; replies with the table.
+                    std::string spec = payload.substr(6);
+                    spec.erase(spec.find_last_not_of(" \r\n") + 1);
+                    spdlog::info("Route command: {}", spec);
+                    std::string reply = "route=error";
                     {
-                        receiver->stop_receiving();
-                        receiver->set_udp_appsrc(false);
-                        receiver->set_audio_payload_callback(nullptr);
-                        receiver->start_receiving(g_video_cb);
+                        std::lock_guard<std::mutex> lock(g_receiver_mutex);
+                        if (receiver && receiver->set_routes(spec))
+                            reply = "route=" + receiver->describe_routes();
                     }
+                    sendto(sock, reply.c_str(), reply.size(), 0,
+                           reinterpret_cast<sockaddr *>(&sender), sender_len);
                 }
                 else if (payload.find("ping=1") != std::string::npos)
                 {
@@ -231,7 +477,7 @@ int main(int argc, char *argv[])
 {
     // parse args via getopt: -w width -h height -p fps -s path
     int opt;
-    while ((opt = getopt(argc, argv, "w:h:p:s:f:t:d:l:a:g:m:")) != -1)
+    while ((opt = getopt(argc, argv, "w:h:p:s:f:t:d:l:a:g:m:b:i:I:F:n:j:D:c:q:k:B:C:L:e:K:P:R:r:T:H:M:X:W:Y:U:S:E:v:")) != -1)
     {
         switch (opt)
         {
@@ -271,13 +517,153 @@ int main(int argc, char *argv[])
         case 'm':
             g_opts.dec_mode = std::atoi(optarg);
             break;
+        case 'b':
+            g_opts.recv_batch = std::atoi(optarg);
+            break;
+        case 'i':
+            g_opts.ingest = std::atoi(optarg);
+            break;
+        case 'I':
+            g_opts.ingest_iface = optarg ? std::string(optarg) : "";
+            break;
+        case 'F':
+            g_opts.socket_filter = std::atoi(optarg);
+            break;
+        case 'n':
+            g_opts.native_depay = std::atoi(optarg);
+            break;
+        case 'j':
+            g_opts.reorder_us = std::max(0, std::atoi(optarg));
+            break;
+        case 'D':
+        {
+            // comma separated, e.g. -D 5601,5602
+            std::stringstream ports(optarg ? optarg : "");
+            std::string port;
+            while (std::getline(ports, port, ','))
+            {
+                const int value = std::atoi(port.c_str());
+                if (value > 0 && value < 65536)
+                    g_opts.diversity_ports.push_back(value);
+            }
+            break;
+        }
+        case 'c':
+            g_opts.appsink_callbacks = std::atoi(optarg);
+            break;
+        case 'q':
+            g_opts.appsink_max_buffers = std::max(0, std::atoi(optarg));
+            break;
+        case 'k':
+            g_opts.appsink_drop = std::atoi(optarg);
+            break;
+        case 'B':
+            g_opts.busy_poll_us = std::max(0, std::atoi(optarg));
+            break;
+        case 'C':
+            g_opts.reader_cpu = std::atoi(optarg);
+            break;
+        case 'L':
+            g_opts.loss_policy = std::clamp(std::atoi(optarg), 0, 2);
+            break;
+        case 'e':
+            g_opts.fec_pt = std::clamp(std::atoi(optarg), 0, 127);
+            break;
+        case 'K':
+            g_opts.keyframe_target = optarg;
+            break;
+        case 'P':
+            g_opts.keyframe_format = std::clamp(std::atoi(optarg), 0, 1);
+            break;
+        case 'R':
+            g_opts.keyframe_interval_ms = std::max(10, std::atoi(optarg));
+            break;
+        case 'r':
+            g_opts.rtcp_target = optarg;
+            break;
+        case 'T':
+            g_opts.rtcp_interval_ms = std::max(50, std::atoi(optarg));
+            break;
+        case 'H':
+        {
+            // comma separated, e.g. -H 10.5.0.10:5620,127.0.0.1:5621
+            std::stringstream targets(optarg ? optarg : "");
+            std::string target;
+            while (std::getline(targets, target, ','))
+            {
+                if (!target.empty())
+                    g_opts.bitrate_hint_targets.push_back(target);
+            }
+            break;
+        }
+        case 'X':
+            g_opts.impairment = optarg;
+            break;
+        case 'U':
+            g_opts.routes = optarg;
+            break;
+        case 'S':
+            g_opts.clock_sync_target = optarg;
+            break;
+        case 'E':
+            g_opts.capture_ext_id = std::atoi(optarg);
+            break;
+        case 'Y':
+        {
+            // pcap[,speed[,loops]]
+            std::stringstream ss(optarg ? optarg : "");
+            std::string field;
+            std::getline(ss, g_opts.replay_path, ',');
+            if (std::getline(ss, field, ','))
+                g_opts.replay_speed = std::max(0.0, std::atof(field.c_str()));
+            if (std::getline(ss, field, ','))
+                g_opts.replay_loops = std::max(0, std::atoi(field.c_str()));
+            g_opts.ingest = static_cast<int>(IngestBackend::PCAP_REPLAY);
+            break;
+        }
+        case 'W':
+        {
+            // seconds[,MiB[,dir]]
+            std::stringstream ss(optarg ? optarg : "");
+            std::string field;
+            if (std::getline(ss, field, ','))
+                g_opts.capture_s = std::max(0, std::atoi(field.c_str()));
+            if (std::getline(ss, field, ','))
+                g_opts.capture_mb = std::max(1, std::atoi(field.c_str()));
+            if (std::getline(ss, field))
+                g_opts.capture_dir = field;
+            break;
+        }
+        case 'M':
+        {
+            // min,max[,start] in kbit/s
+            unsigned min_kbps = 0, max_kbps = 0, start_kbps = 0;
+            const int fields = sscanf(optarg ? optarg : "", "%u,%u,%u", &min_kbps, &max_kbps, &start_kbps);
+            if (fields >= 2 && min_kbps > 0 && max_kbps >= min_kbps)
+            {
+                g_opts.link_config.min_kbps = min_kbps;
+                g_opts.link_config.max_kbps = max_kbps;
+                g_opts.link_config.start_kbps = fields == 3 ? start_kbps : min_kbps + (max_kbps - min_kbps) / 2;
+            }
+            break;
+        }
+        case 'v':
+            g_opts.log_level = optarg ? std::string(optarg) : "info";
+            break;
         default:
             // ignore unknown options for now
             break;
         }
     }
 
-    spdlog::set_level(spdlog::level::info);
+    // from_str() maps any name it does not know to off, which would hide errors too.
+    auto log_level = spdlog::level::from_str(g_opts.log_level);
+    if (log_level == spdlog::level::off && g_opts.log_level != "off")
+    {
+        spdlog::error("Unknown log level '{}', using info", g_opts.log_level);
+        log_level = spdlog::level::info;
+    }
+    spdlog::set_level(log_level);
 
     spdlog::info("Starting GST RTP Receiver... Daivide");
     signal(SIGSEGV, signal_handler);
@@ -291,6 +677,84 @@ int main(int argc, char *argv[])
         receiver = std::make_unique<GstRtpReceiver>(5600, selected_codec);
         receiver->set_udp_appsrc(g_opts.enable_audio != 0);
         receiver->set_alignment(g_opts.alignment);
+        receiver->set_recv_batch(g_opts.recv_batch);
+        receiver->set_ingest_backend(static_cast<IngestBackend>(std::clamp(g_opts.ingest, 0, 5)));
+        receiver->set_replay_source(g_opts.replay_path, g_opts.replay_speed, static_cast<uint32_t>(g_opts.replay_loops));
+        receiver->set_packet_ring_interface(g_opts.ingest_iface);
+        receiver->set_shm_ring_name(g_opts.ingest_iface);
+        receiver->set_socket_filter(static_cast<SocketFilterMode>(std::clamp(g_opts.socket_filter, 0, 2)));
+        receiver->set_native_depacketizer(g_opts.native_depay != 0);
+        receiver->set_reorder_window_us(static_cast<uint32_t>(g_opts.reorder_us));
+        receiver->set_fec_payload_type(g_opts.fec_pt);
+        receiver->set_impairment(g_opts.impairment);
+        receiver->set_routes(g_opts.routes);
+        if (g_opts.capture_s > 0)
+        {
+            g_capture = std::make_unique<RtpCaptureRing>(static_cast<size_t>(g_opts.capture_mb) << 20,
+                                                         static_cast<uint32_t>(g_opts.capture_s) * 1000, 5600);
+            snprintf(g_capture_crash_path, sizeof(g_capture_crash_path), "%s/rtp_capture_crash.pcap",
+                     capture_dir().c_str());
+            receiver->set_capture_ring(g_capture.get());
+            spdlog::info("RTP capture ring: last {} s in {} MiB, dumps to {}", g_opts.capture_s, g_opts.capture_mb,
+                         capture_dir());
+        }
+        receiver->set_diversity_ports(g_opts.diversity_ports);
+        receiver->set_busy_poll(static_cast<uint32_t>(g_opts.busy_poll_us), g_opts.reader_cpu);
+        receiver->set_appsink_callbacks(g_opts.appsink_callbacks != 0);
+        receiver->set_appsink_queue(g_opts.appsink_max_buffers, g_opts.appsink_drop != 0);
+        receiver->set_loss_policy(static_cast<LossPolicy>(g_opts.loss_policy));
+        receiver->set_keyframe_requests(g_opts.keyframe_target, static_cast<KeyframeRequestFormat>(g_opts.keyframe_format),
+                                        static_cast<uint32_t>(g_opts.keyframe_interval_ms));
+        receiver->set_receiver_reports(g_opts.rtcp_target, static_cast<uint32_t>(g_opts.rtcp_interval_ms));
+        receiver->set_capture_time_extension(g_opts.capture_ext_id);
+        // Payloads routed to "telemetry" (-U): no consumer in this process, so they are
+        // counted and logged per second at debug. Runs on the socket reader thread only.
+        receiver->set_telemetry_callback([](uint8_t pt, uint32_t ssrc, const uint8_t *, size_t size)
+                                         {
+            static uint64_t window_start_ms = monotonic_ms_main();
+            static uint64_t packets = 0;
+            static uint64_t bytes = 0;
+            ++packets;
+            bytes += size;
+            const uint64_t now = monotonic_ms_main();
+            if (now - window_start_ms < 1000)
+                return;
+            spdlog::debug("[telemetry] pkts {} bytes {} in {} ms (last pt {} ssrc {:#x})", packets, bytes,
+                          now - window_start_ms, pt, ssrc);
+            window_start_ms = now;
+            packets = bytes = 0; });
+        if (!g_opts.clock_sync_target.empty())
+        {
+            g_clock_sync = std::make_unique<ClockSyncClient>();
+            if (!g_clock_sync->start(g_opts.clock_sync_target))
+                g_clock_sync.reset();
+        }
+        if (g_opts.capture_ext_id && !g_clock_sync)
+            spdlog::warn("Capture times (-E) without clock sync (-S): no glass-to-glass latency");
+        if (!g_opts.bitrate_hint_targets.empty())
+        {
+            g_bitrate_hints = std::make_unique<BitrateHintPublisher>();
+            for (const auto &target : g_opts.bitrate_hint_targets)
+                g_bitrate_hints->add_target(target);
+            g_link_estimator = std::make_unique<LinkEstimator>(g_opts.link_config);
+            spdlog::info("Link estimator: {}..{} kbps, hints to {} target(s)", g_link_estimator->config().min_kbps,
+                         g_link_estimator->config().max_kbps, g_bitrate_hints->targets());
+            receiver->set_reception_report_callback([](const RtcpReceptionReport &report)
+                                                    {
+                LinkSample sample;
+                sample.duration_s = report.elapsed_us ? report.elapsed_us / 1e6 : g_opts.rtcp_interval_ms / 1000.0;
+                sample.loss = report.fraction_lost / 256.0;
+                sample.jitter_ms = report.jitter_ms;
+                sample.queue_depth = g_decode_queue_max.exchange(0);
+                sample.decoder_eagain = g_decoder_eagain.exchange(0);
+                // No video in the window: nothing to judge the link by.
+                if (!report.has_block)
+                    return;
+                const auto &estimate = g_link_estimator->update(sample);
+                g_bitrate_hints->publish(estimate, sample);
+                spdlog::debug("[link] sample {} -> {} kbps {} ({})", link_sample_to_trace(sample), estimate.target_kbps,
+                              LinkEstimator::state_name(estimate.state), estimate.reason); });
+        }
         if (g_opts.enable_audio)
         {
             g_audio_enabled.store(true);
@@ -320,12 +784,15 @@ int main(int argc, char *argv[])
             
             SchedulingHelper::set_thread_params_max_realtime("DecodeThread", SchedulingHelper::PRIORITY_REALTIME_MID);
 
+            LatencyStats latency;
             while (decoding_active || decode_queue.size_approx() > 0) {
-                std::shared_ptr<std::vector<uint8_t>> frame;
+                VideoFramePtr frame;
                 decode_queue.wait_dequeue(frame);
                 if (frame != nullptr)
                 {
                     const uint64_t queue_depth = decode_queue.size_approx();
+                    if (queue_depth > g_decode_queue_max.load(std::memory_order_relaxed))
+                        g_decode_queue_max.store(static_cast<uint32_t>(queue_depth), std::memory_order_relaxed);
                     if (queue_depth > 0) {
                         spdlog::debug("[decode] dequeued frame size={} queue_depth={}", frame->size(), queue_depth);
                     }
@@ -336,7 +803,15 @@ int main(int argc, char *argv[])
                     //    measure_latency_breakdown();
                     //}
                     const uint64_t submit_begin = monotonic_ms_main();
-                    int ret = aml_submit_decode_unit(frame->data(), frame->size());
+                    const uint64_t submit_mono_ns = monotonic_ns();
+                    frame->mark(VideoFrame::Stage::DECODE_SUBMIT);
+                    // codec_write() only reads the unit; the frame may still be mapped from a GstBuffer.
+                    int ret = aml_submit_decode_unit(const_cast<uint8_t *>(frame->data()), frame->size());
+                    frame->mark(VideoFrame::Stage::DECODED);
+                    latency.add(*frame, submit_mono_ns);
+                    latency.maybe_report();
+                    if (ret < 0 && errno == EAGAIN)
+                        g_decoder_eagain.fetch_add(1, std::memory_order_relaxed);
                     const uint64_t submit_end = monotonic_ms_main();
                     const uint64_t submit_cost = submit_end - submit_begin;
                     if (submit_cost > 0)
@@ -358,7 +833,7 @@ int main(int argc, char *argv[])
             
             spdlog::info("decode thread terminated"); });
 
-        auto cb = [/*&decoder_stalled_count,*/ &bytes_received, &frame_count, &period_start](std::shared_ptr<std::vector<uint8_t>> frame)
+        auto cb = [/*&decoder_stalled_count,*/ &bytes_received, &frame_count, &period_start](VideoFramePtr frame)
         {
             // Let the gst pull thread run at quite high priority
             static bool first = false;
@@ -370,7 +845,12 @@ int main(int argc, char *argv[])
                 first = false;
             }
             bytes_received += frame->size();
+            const uint64_t frame_ms = monotonic_ms_main();
+            const uint64_t previous_frame_ms = g_last_frame_ms.exchange(frame_ms);
+            if (g_audio_toggle_ms.exchange(0) != 0 && previous_frame_ms)
+                spdlog::info("Audio toggle: video gap {} ms", frame_ms - previous_frame_ms);
             // spdlog::debug("{}ms Received frame of size {} ", get_time_ms(), frame->size());
+            frame->mark(VideoFrame::Stage::QUEUED);
             decode_queue.enqueue(frame);
             if (g_dvr)
             {
@@ -449,6 +929,7 @@ int main(int argc, char *argv[])
     {
         decode_thread.join();
     }
+    g_clock_sync.reset();
     dvr_command_running = false;
     if (dvr_command_thread.joinable())
     {
@@ -0,0 +1,283 @@
+#include "packet_ring_receiver.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t kIpv4MinHeader = 20;
+constexpr size_t kUdpHeader = 8;
+
+tpacket_block_desc *block_at(uint8_t *map, unsigned block_size, unsigned index)
+{
+    return reinterpret_cast<tpacket_block_desc *>(map + static_cast<size_t>(index) * block_size);
+}
+} // namespace
+
+PacketRingReceiver::~PacketRingReceiver()
+{
+    stop();
+}
+
+bool PacketRingReceiver::attach_port_filter(int udp_port)
+{
+    // SOCK_DGRAM packet sockets see the network header at offset 0:
+    //   IPv4, protocol UDP, not a non-first fragment, destination port == udp_port.
+    sock_filter code[] = {
+        {BPF_LD | BPF_B | BPF_ABS, 0, 0, 0},                      // A = ip[0]
+        {BPF_ALU | BPF_RSH | BPF_K, 0, 0, 4},                     // A >>= 4 (version)
+        {BPF_JMP | BPF_JEQ | BPF_K, 0, 8, 4},                     // IPv4?
+        {BPF_LD | BPF_B | BPF_ABS, 0, 0, 9},                      // A = ip protocol
+        {BPF_JMP | BPF_JEQ | BPF_K, 0, 6, IPPROTO_UDP},
+        {BPF_LD | BPF_H | BPF_ABS, 0, 0, 6},                      // A = flags/frag offset
+        {BPF_JMP | BPF_JSET | BPF_K, 4, 0, 0x1fff},               // fragment offset != 0
+        {BPF_LDX | BPF_B | BPF_MSH, 0, 0, 0},                     // X = IP header length
+        {BPF_LD | BPF_H | BPF_IND, 0, 0, 2},                      // A = udp dport
+        {BPF_JMP | BPF_JEQ | BPF_K, 0, 1, static_cast<uint32_t>(udp_port)},
+        {BPF_RET | BPF_K, 0, 0, 0x40000},                         // accept
+        {BPF_RET | BPF_K, 0, 0, 0},                               // drop
+    };
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        spdlog::error("packet ring: SO_ATTACH_FILTER failed: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool PacketRingReceiver::start(const std::string &ifname, int udp_port,
+                               unsigned block_size, unsigned block_count, unsigned retire_ms)
+{
+    stop();
+
+    fd_ = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (fd_ < 0) {
+        spdlog::error("packet ring: socket(AF_PACKET) failed: {} (needs CAP_NET_RAW)", strerror(errno));
+        return false;
+    }
+    if (!attach_port_filter(udp_port)) {
+        stop();
+        return false;
+    }
+    port_ = static_cast<uint16_t>(udp_port);
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        spdlog::error("packet ring: TPACKET_V3 not supported: {}", strerror(errno));
+        stop();
+        return false;
+    }
+#ifdef PACKET_IGNORE_OUTGOING
+    // On loopback every datagram shows up twice (outgoing + host); best effort on old kernels.
+    int ignore_outgoing = 1;
+    setsockopt(fd_, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore_outgoing, sizeof(ignore_outgoing));
+#endif
+
+    const long page = sysconf(_SC_PAGESIZE);
+    block_size_ = std::max<unsigned>(static_cast<unsigned>(page), block_size - block_size % page);
+    block_count_ = block_count;
+    constexpr unsigned kFrameSize = 2048;
+
+    tpacket_req3 req{};
+    req.tp_block_size = block_size_;
+    req.tp_block_nr = block_count_;
+    req.tp_frame_size = kFrameSize;
+    req.tp_frame_nr = block_size_ / kFrameSize * block_count_;
+    req.tp_retire_blk_tov = retire_ms;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        spdlog::error("packet ring: PACKET_RX_RING failed: {}", strerror(errno));
+        stop();
+        return false;
+    }
+
+    map_size_ = static_cast<size_t>(block_size_) * block_count_;
+    void *map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if (map == MAP_FAILED) {
+        map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (map == MAP_FAILED) {
+        spdlog::error("packet ring: mmap failed: {}", strerror(errno));
+        stop();
+        return false;
+    }
+    map_ = static_cast<uint8_t *>(map);
+
+    refs_ = std::make_unique<BlockRef[]>(block_count_);
+    for (unsigned i = 0; i < block_count_; ++i) {
+        refs_[i].owner = this;
+        refs_[i].index = i;
+    }
+    current_ = 0;
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    addr.sll_ifindex = ifname.empty() ? 0 : static_cast<int>(if_nametoindex(ifname.c_str()));
+    if (!ifname.empty() && addr.sll_ifindex == 0) {
+        spdlog::error("packet ring: unknown interface {}", ifname);
+        stop();
+        return false;
+    }
+    if (bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        spdlog::error("packet ring: bind failed: {}", strerror(errno));
+        stop();
+        return false;
+    }
+
+    spdlog::info("packet ring on {} udp/{}: {} blocks x {} KiB, retire {} ms",
+                 ifname.empty() ? "any" : ifname, udp_port, block_count_, block_size_ / 1024, retire_ms);
+    return true;
+}
+
+void PacketRingReceiver::stop()
+{
+    if (map_) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    refs_.reset();
+}
+
+int PacketRingReceiver::wait(int timeout_ms, const PacketHandler &handler)
+{
+    if (!map_) {
+        return -1;
+    }
+
+    // A block still referenced from the previous lap is user-owned but already consumed;
+    // the kernel is stalled on it as well, so there is nothing new to read yet.
+    if (refs_[current_].refs.load(std::memory_order_acquire) > 0) {
+        usleep(static_cast<useconds_t>(std::min(timeout_ms, 1)) * 1000);
+        return 0;
+    }
+
+    auto *desc = block_at(map_, block_size_, current_);
+    if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        pollfd pfd{fd_, POLLIN | POLLERR, 0};
+        const int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno != EINTR) {
+            spdlog::warn("packet ring: poll failed: {}", strerror(errno));
+            return -1;
+        }
+        if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return 0;
+        }
+    }
+
+    const unsigned block = current_;
+    BlockRef &ref = refs_[block];
+    ref.refs.store(1, std::memory_order_relaxed);
+
+    const tpacket_hdr_v1 &bh = desc->hdr.bh1;
+    const uint32_t fill_pct = static_cast<uint32_t>(static_cast<uint64_t>(bh.blk_len) * 100 / block_size_);
+    stat_fill_sum_ += fill_pct;
+    stat_fill_max_ = std::max(stat_fill_max_, fill_pct);
+    ++stat_blocks_;
+
+    int delivered = 0;
+    auto *hdr = reinterpret_cast<tpacket3_hdr *>(reinterpret_cast<uint8_t *>(desc) + bh.offset_to_first_pkt);
+    for (uint32_t i = 0; i < bh.num_pkts; ++i) {
+        const auto *sll = reinterpret_cast<const sockaddr_ll *>(reinterpret_cast<uint8_t *>(hdr) +
+                                                                TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        const uint8_t *ip = reinterpret_cast<uint8_t *>(hdr) + hdr->tp_net;
+        const size_t caplen = hdr->tp_snaplen;
+        // Same checks as the socket filter, in case it is missing or wrong.
+        if (sll->sll_pkttype != PACKET_OUTGOING && caplen >= kIpv4MinHeader + kUdpHeader && ip[9] == IPPROTO_UDP &&
+            (((static_cast<unsigned>(ip[6]) << 8) | ip[7]) & 0x1fff) == 0) {
+            const size_t ihl = static_cast<size_t>(ip[0] & 0x0f) * 4;
+            const uint8_t *udp = ip + ihl;
+            if (ihl >= kIpv4MinHeader && caplen >= ihl + kUdpHeader &&
+                ((static_cast<uint16_t>(udp[2]) << 8) | udp[3]) == port_) {
+                const size_t udp_len = (static_cast<size_t>(udp[4]) << 8) | udp[5];
+                if (udp_len >= kUdpHeader && ihl + udp_len <= caplen) {
+                    Packet pkt{};
+                    pkt.data = udp + kUdpHeader;
+                    pkt.size = udp_len - kUdpHeader;
+                    pkt.timestamp_ns = static_cast<uint64_t>(hdr->tp_sec) * 1000000000ULL + hdr->tp_nsec;
+                    pkt.block = block;
+                    handler(pkt);
+                    ++delivered;
+                }
+            }
+        }
+        hdr = reinterpret_cast<tpacket3_hdr *>(reinterpret_cast<uint8_t *>(hdr) + hdr->tp_next_offset);
+    }
+    stat_packets_ += static_cast<uint64_t>(delivered);
+
+    current_ = (current_ + 1) % block_count_;
+    release_block(block);
+    return delivered;
+}
+
+void PacketRingReceiver::hold_block(unsigned block)
+{
+    refs_[block].refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketRingReceiver::release_block(unsigned block)
+{
+    if (refs_[block].refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        return_block(block);
+    }
+}
+
+void *PacketRingReceiver::block_token(unsigned block)
+{
+    return &refs_[block];
+}
+
+void PacketRingReceiver::release_block_token(void *token)
+{
+    auto *ref = static_cast<BlockRef *>(token);
+    ref->owner->release_block(ref->index);
+}
+
+void PacketRingReceiver::return_block(unsigned block)
+{
+    auto *desc = block_at(map_, block_size_, block);
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+}
+
+PacketRingReceiver::Stats PacketRingReceiver::take_stats()
+{
+    Stats stats;
+    stats.blocks = stat_blocks_;
+    stats.packets = stat_packets_;
+    stats.fill_avg_pct = stat_blocks_ ? static_cast<uint32_t>(stat_fill_sum_ / stat_blocks_) : 0;
+    stats.fill_max_pct = stat_fill_max_;
+    for (unsigned i = 0; i < block_count_; ++i) {
+        if (refs_[i].refs.load(std::memory_order_relaxed) > 0) {
+            ++stats.blocks_held;
+        }
+    }
+
+    tpacket_stats_v3 kstats{};
+    socklen_t len = sizeof(kstats);
+    if (fd_ >= 0 && getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) == 0) {
+        stats.kernel_packets = kstats.tp_packets;
+        stats.kernel_drops = kstats.tp_drops;
+        stats.freeze_q = kstats.tp_freeze_q_cnt;
+    }
+
+    stat_blocks_ = 0;
+    stat_packets_ = 0;
+    stat_fill_sum_ = 0;
+    stat_fill_max_ = 0;
+    return stats;
+}
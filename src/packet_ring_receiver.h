@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// UDP ingest straight from an AF_PACKET TPACKET_V3 (PACKET_RX_RING) block ring.
+// A classic BPF filter keeps only IPv4/UDP datagrams for one destination port, the kernel
+// writes them into memory-mapped blocks, and payloads are handed out in place. A block goes
+// back to the kernel once the reader is done walking it and every hold_block() reference
+// taken on it (e.g. by a wrapped GstBuffer) has been released.
+class PacketRingReceiver {
+public:
+    struct Packet {
+        const uint8_t *data;   // UDP payload inside the ring
+        size_t size;
+        uint64_t timestamp_ns; // kernel receive time (CLOCK_REALTIME)
+        unsigned block;
+    };
+    using PacketHandler = std::function<void(const Packet &pkt)>;
+
+    struct Stats {
+        uint64_t blocks = 0;
+        uint64_t packets = 0;
+        uint32_t fill_avg_pct = 0;  // average used fraction of the retired blocks
+        uint32_t fill_max_pct = 0;
+        uint32_t blocks_held = 0;   // blocks still out of the kernel's hands
+        uint32_t kernel_packets = 0;
+        uint32_t kernel_drops = 0;  // tp_drops since the previous take_stats()
+        uint32_t freeze_q = 0;      // times the ring was full and the kernel froze the queue
+    };
+
+    PacketRingReceiver() = default;
+    ~PacketRingReceiver();
+    PacketRingReceiver(const PacketRingReceiver &) = delete;
+    PacketRingReceiver &operator=(const PacketRingReceiver &) = delete;
+
+    // ifname empty = all interfaces. A block is retired to user space when full or after
+    // retire_ms, which bounds the latency this ring adds.
+    bool start(const std::string &ifname, int udp_port,
+               unsigned block_size = 1u << 15, unsigned block_count = 256, unsigned retire_ms = 1);
+    void stop();
+
+    // Walks the next retired block, blocking up to timeout_ms for one.
+    // Returns the number of packets delivered, or -1 on a fatal error.
+    int wait(int timeout_ms, const PacketHandler &handler);
+
+    // Keeps `block` away from the kernel until the matching release_block(); thread-safe.
+    void hold_block(unsigned block);
+    void release_block(unsigned block);
+    // Opaque token for GDestroyNotify-style callbacks: release_block_token(block_token(b)).
+    void *block_token(unsigned block);
+    static void release_block_token(void *token);
+
+    Stats take_stats();
+
+private:
+    struct BlockRef {
+        PacketRingReceiver *owner = nullptr;
+        unsigned index = 0;
+        std::atomic<int> refs{0};
+    };
+
+    bool attach_port_filter(int udp_port);
+    void return_block(unsigned block);
+
+    int fd_{-1};
+    uint16_t port_{0};
+    uint8_t *map_{nullptr};
+    size_t map_size_{0};
+    unsigned block_size_{0};
+    unsigned block_count_{0};
+    unsigned current_{0};
+    std::unique_ptr<BlockRef[]> refs_;
+
+    uint64_t stat_blocks_{0};
+    uint64_t stat_packets_{0};
+    uint64_t stat_fill_sum_{0};
+    uint32_t stat_fill_max_{0};
+};
@@ -0,0 +1,226 @@
+#include "pcap_replay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+namespace {
+constexpr uint32_t kMagicUs = 0xa1b2c3d4;
+constexpr uint32_t kMagicNs = 0xa1b23c4d;
+constexpr uint32_t kMagicPcapng = 0x0a0d0d0a;
+constexpr int kMaxBatch = 64; // as-fast-as-possible: packets per wait()
+
+uint64_t clock_ns(clockid_t clock)
+{
+    timespec ts{};
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint32_t swap32(uint32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+uint16_t be16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+// Offset of the IP header in a frame of `linktype`, -1 when it does not carry IP.
+long ip_offset(uint32_t linktype, const uint8_t *frame, size_t size)
+{
+    switch (linktype) {
+    case 1: { // Ethernet
+        size_t off = 12;
+        while (off + 2 <= size && (be16(frame + off) == 0x8100 || be16(frame + off) == 0x88a8)) {
+            off += 4;
+        }
+        if (off + 2 > size) {
+            return -1;
+        }
+        const uint16_t type = be16(frame + off);
+        return type == 0x0800 || type == 0x86dd ? static_cast<long>(off + 2) : -1;
+    }
+    case 12:  // raw IP (OpenBSD numbering)
+    case 101: // raw IP
+    case 228: // IPv4
+    case 229: // IPv6
+        return 0;
+    case 113: // Linux cooked v1
+        return size >= 16 && (be16(frame + 14) == 0x0800 || be16(frame + 14) == 0x86dd) ? 16 : -1;
+    case 276: // Linux cooked v2
+        return size >= 20 && (be16(frame) == 0x0800 || be16(frame) == 0x86dd) ? 20 : -1;
+    case 0: // BSD loopback, host-order address family
+        return size >= 4 ? 4 : -1;
+    default:
+        return -1;
+    }
+}
+
+// UDP payload of an IP packet: offset into `ip` and size, false for anything else.
+bool udp_payload(const uint8_t *ip, size_t size, uint16_t dst_port, size_t &offset, size_t &length)
+{
+    if (size < 1) {
+        return false;
+    }
+    size_t udp = 0;
+    if ((ip[0] >> 4) == 4) {
+        const size_t ihl = static_cast<size_t>(ip[0] & 0x0f) * 4;
+        // Fragments other than the first carry no UDP header.
+        if (size < 20 || ihl < 20 || ip[9] != 17 || (be16(ip + 6) & 0x1fff) != 0) {
+            return false;
+        }
+        udp = ihl;
+    } else if ((ip[0] >> 4) == 6) {
+        if (size < 40 || ip[6] != 17) {
+            return false;
+        }
+        udp = 40;
+    } else {
+        return false;
+    }
+    if (size < udp + 8 || (dst_port && be16(ip + udp + 2) != dst_port)) {
+        return false;
+    }
+    const size_t udp_len = be16(ip + udp + 4);
+    offset = udp + 8;
+    // A snap length cut the datagram: keep what was captured.
+    length = std::min(size - offset, udp_len >= 8 ? udp_len - 8 : size_t{0});
+    return length > 0;
+}
+} // namespace
+
+bool PcapCapture::load(const std::string &path, uint16_t dst_port, std::string &error)
+{
+    data.clear();
+    packets.clear();
+    error.clear();
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        error = std::strerror(errno);
+        return false;
+    }
+    uint32_t header[6];
+    if (std::fread(header, sizeof(header), 1, file) != 1) {
+        std::fclose(file);
+        error = "too short for a pcap header";
+        return false;
+    }
+    const bool swapped = header[0] == swap32(kMagicUs) || header[0] == swap32(kMagicNs);
+    const uint32_t magic = swapped ? swap32(header[0]) : header[0];
+    if (magic != kMagicUs && magic != kMagicNs) {
+        std::fclose(file);
+        error = header[0] == kMagicPcapng ? "pcapng is not supported, convert with editcap -F pcap" : "not a pcap file";
+        return false;
+    }
+    const uint64_t frac_ns = magic == kMagicNs ? 1 : 1000;
+    const uint32_t linktype = (swapped ? swap32(header[5]) : header[5]) & 0xffff;
+
+    std::vector<uint8_t> frame;
+    uint32_t rec[4];
+    uint64_t skipped = 0;
+    while (std::fread(rec, sizeof(rec), 1, file) == 1) {
+        if (swapped) {
+            for (auto &v : rec) {
+                v = swap32(v);
+            }
+        }
+        const uint32_t caplen = rec[2];
+        if (caplen > 256 * 1024) {
+            error = "corrupt record";
+            break;
+        }
+        frame.resize(caplen);
+        if (caplen && std::fread(frame.data(), caplen, 1, file) != 1) {
+            break; // truncated at the end: keep what came before
+        }
+        const long ip = ip_offset(linktype, frame.data(), caplen);
+        size_t offset = 0, length = 0;
+        if (ip < 0 || !udp_payload(frame.data() + ip, caplen - static_cast<size_t>(ip), dst_port, offset, length)) {
+            ++skipped;
+            continue;
+        }
+        const uint8_t *payload = frame.data() + ip + offset;
+        packets.push_back({static_cast<uint64_t>(rec[0]) * 1000000000ull + rec[1] * frac_ns, data.size(),
+                           static_cast<uint32_t>(length)});
+        data.insert(data.end(), payload, payload + length);
+    }
+    std::fclose(file);
+    if (packets.empty()) {
+        if (error.empty()) {
+            error = skipped ? "no matching UDP datagrams" : "no packets";
+        }
+        return false;
+    }
+    // Captures from several interfaces can be slightly out of order; replay by time.
+    std::stable_sort(packets.begin(), packets.end(), [](const Packet &a, const Packet &b) { return a.ts_ns < b.ts_ns; });
+    return true;
+}
+
+PcapReplaySource::PcapReplaySource(PcapCapture capture, double speed, uint32_t loops)
+    : capture_(std::move(capture)), speed_(std::max(speed, 0.0)), loops_(loops)
+{
+}
+
+uint64_t PcapReplaySource::due_ns(size_t index) const
+{
+    const uint64_t offset = capture_.packets[index].ts_ns - capture_.packets.front().ts_ns;
+    return start_ns_ + static_cast<uint64_t>(static_cast<double>(offset) / speed_);
+}
+
+int PcapReplaySource::wait(int timeout_ms, const PacketHandler &handler)
+{
+    if (capture_.packets.empty() || (loops_ && loops_done_ >= loops_)) {
+        return -1;
+    }
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (next_ == 0) {
+        start_ns_ = now;
+    }
+    if (speed_ > 0.0) {
+        const uint64_t due = due_ns(next_);
+        if (due > now) {
+            const uint64_t until = std::min<uint64_t>(due, now + static_cast<uint64_t>(std::max(timeout_ms, 0)) * 1000000ull);
+            const timespec ts{static_cast<time_t>(until / 1000000000ull), static_cast<long>(until % 1000000000ull)};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+            }
+            now = clock_ns(CLOCK_MONOTONIC);
+        }
+    }
+
+    int delivered = 0;
+    while (next_ < capture_.packets.size()) {
+        if (speed_ > 0.0) {
+            const uint64_t due = due_ns(next_);
+            if (due > now) {
+                break;
+            }
+            const uint64_t late_us = (now - due) / 1000;
+            stats_.late_us_sum += late_us;
+            stats_.late_us_max = std::max(stats_.late_us_max, late_us);
+        } else if (delivered == kMaxBatch) {
+            break;
+        }
+        const auto &packet = capture_.packets[next_++];
+        handler(capture_.payload(packet), packet.size, clock_ns(CLOCK_REALTIME));
+        ++stats_.packets;
+        stats_.bytes += packet.size;
+        ++delivered;
+    }
+    if (next_ == capture_.packets.size()) {
+        next_ = 0;
+        ++loops_done_;
+    }
+    return delivered;
+}
+
+PcapReplaySource::Stats PcapReplaySource::take_stats()
+{
+    Stats out = stats_;
+    stats_ = Stats{};
+    return out;
+}
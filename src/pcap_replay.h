@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The UDP payloads of a classic pcap file, with their capture times. Reads microsecond
+// and nanosecond pcaps in either byte order, link types Ethernet (VLAN tags included),
+// raw IP, IPv4, Linux cooked (v1/v2) and BSD loopback; IPv4 and IPv6 without extension
+// headers. The capture ring dumps (-W) are such files. pcapng is not read; convert with
+// `editcap -F pcap`.
+struct PcapCapture {
+    struct Packet {
+        uint64_t ts_ns;
+        size_t offset; // into data
+        uint32_t size;
+    };
+    std::vector<uint8_t> data;
+    std::vector<Packet> packets;
+
+    // Keeps the datagrams to dst_port, or every UDP datagram with dst_port 0. False with
+    // `error` set when the file cannot be read or is not a pcap.
+    bool load(const std::string &path, uint16_t dst_port, std::string &error);
+    const uint8_t *payload(const Packet &packet) const { return data.data() + packet.offset; }
+    double duration_s() const
+    {
+        return packets.size() > 1 ? (packets.back().ts_ns - packets.front().ts_ns) / 1e9 : 0.0;
+    }
+};
+
+// Plays a PcapCapture back with its original inter-arrival times, scaled by `speed`
+// (2 = twice as fast), or as fast as the consumer takes it (speed 0). Each packet is
+// handed over with the current CLOCK_REALTIME as its receive time, so latency
+// measurements downstream start at the replayed arrival. Drives the receiver's replay
+// ingest backend and tools/rtp_replay, through the same wait() shape as the other
+// ingest sources.
+class PcapReplaySource {
+public:
+    using PacketHandler = std::function<void(const uint8_t *data, size_t size, uint64_t rx_ns)>;
+
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t late_us_sum = 0; // paced mode: delivery behind the schedule
+        uint64_t late_us_max = 0;
+    };
+
+    // loops: times through the file, 0 = forever.
+    PcapReplaySource(PcapCapture capture, double speed, uint32_t loops);
+
+    // Delivers the packets that are due, sleeping up to timeout_ms for the next one.
+    // Returns the number delivered, or -1 once the last loop has finished.
+    int wait(int timeout_ms, const PacketHandler &handler);
+
+    const PcapCapture &capture() const { return capture_; }
+    uint32_t loops_done() const { return loops_done_; }
+    Stats take_stats();
+
+private:
+    uint64_t due_ns(size_t index) const;
+
+    PcapCapture capture_;
+    double speed_;
+    uint32_t loops_;
+    uint32_t loops_done_{0};
+    size_t next_{0};
+    uint64_t start_ns_{0}; // CLOCK_MONOTONIC time of the first packet of this loop
+    Stats stats_;
+};
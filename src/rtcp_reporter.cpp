@@ -0,0 +1,289 @@
+#include "rtcp_reporter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "frame_timing.h"
+#include "udp_target.h"
+
+namespace {
+constexpr uint8_t kRtcpSr = 200;
+constexpr uint8_t kRtcpRr = 201;
+constexpr uint8_t kRtcpSdes = 202;
+constexpr uint8_t kSdesCname = 1;
+constexpr char kCname[] = "amldigitalfpv";
+
+// RFC 3550 A.1
+constexpr uint32_t kMaxDropout = 3000;
+constexpr uint32_t kMaxMisorder = 100;
+constexpr uint32_t kSeqMod = 1u << 16;
+
+uint16_t read_u16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read_u32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void write_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+void write_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+} // namespace
+
+RtcpReporter::RtcpReporter(uint32_t clock_rate, uint32_t interval_ms, ReportCallback on_report)
+    : clock_rate_(clock_rate), interval_us_(static_cast<uint64_t>(interval_ms) * 1000),
+      on_report_(std::move(on_report))
+{
+    std::random_device rd;
+    sender_ssrc_ = rd();
+}
+
+RtcpReporter::~RtcpReporter()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool RtcpReporter::open(const std::string &destination)
+{
+    fd_ = connect_udp_target(destination, "RTCP report");
+    if (fd_ < 0) {
+        return false;
+    }
+    // SRs are only read when a report is due; the kernel stamp keeps DLSR exact anyway.
+    enable_rx_timestamps(fd_);
+    destination_ = destination;
+    return true;
+}
+
+void RtcpReporter::init_seq(uint16_t seq)
+{
+    base_seq_ = seq;
+    max_seq_ = seq;
+    bad_seq_ = kSeqMod + 1;
+    cycles_ = 0;
+    received_ = 0;
+    received_prior_ = 0;
+    expected_prior_ = 0;
+}
+
+bool RtcpReporter::update_seq(uint16_t seq)
+{
+    const uint16_t udelta = static_cast<uint16_t>(seq - max_seq_);
+    if (udelta < kMaxDropout) {
+        if (seq < max_seq_) {
+            cycles_ += kSeqMod;
+        }
+        max_seq_ = seq;
+    } else if (udelta <= kSeqMod - kMaxMisorder) {
+        // A big jump: the sender restarted, or this is a stray. Two in a row resync.
+        if (seq != bad_seq_) {
+            bad_seq_ = (static_cast<uint32_t>(seq) + 1) & (kSeqMod - 1);
+            return false;
+        }
+        init_seq(seq);
+        have_transit_ = false;
+    }
+    // else: duplicate or reordered, counted but max_seq stays
+    ++received_;
+    return true;
+}
+
+void RtcpReporter::on_rtp(const uint8_t *packet, size_t size, uint64_t rx_ns)
+{
+    if (size < 12) {
+        return;
+    }
+    const uint16_t seq = read_u16(packet + 2);
+    const uint32_t ts = read_u32(packet + 4);
+    const uint32_t ssrc = read_u32(packet + 8);
+    if (!started_ || ssrc != media_ssrc_) {
+        started_ = true;
+        media_ssrc_ = ssrc;
+        init_seq(seq);
+        ++received_;
+        have_transit_ = false;
+        jitter_q4_ = 0;
+    } else if (!update_seq(seq)) {
+        return;
+    }
+    heard_ = true;
+
+    // A.8: arrival time in timestamp units; only differences matter, so it may wrap.
+    if (!rx_ns) {
+        rx_ns = realtime_ns();
+    }
+    const uint64_t sec = rx_ns / 1000000000ULL;
+    const uint64_t frac = rx_ns % 1000000000ULL;
+    const auto arrival = static_cast<uint32_t>(sec * clock_rate_ + frac * clock_rate_ / 1000000000ULL);
+    const auto transit = static_cast<int32_t>(arrival - ts);
+    if (have_transit_) {
+        int64_t d = static_cast<int64_t>(transit) - transit_;
+        if (d < 0) {
+            d = -d;
+        }
+        // Sender restarts or clock jumps would otherwise poison the estimate for minutes.
+        if (d < static_cast<int64_t>(clock_rate_)) {
+            jitter_q4_ += static_cast<uint32_t>(d) - ((jitter_q4_ + 8) >> 4);
+        }
+    }
+    transit_ = transit;
+    have_transit_ = true;
+}
+
+void RtcpReporter::on_rtcp(const uint8_t *packet, size_t size, uint64_t rx_ns)
+{
+    size_t offset = 0;
+    while (offset + 4 <= size) {
+        const uint8_t *p = packet + offset;
+        const size_t len = (static_cast<size_t>(read_u16(p + 2)) + 1) * 4;
+        if ((p[0] & 0xc0) != 0x80 || offset + len > size) {
+            return;
+        }
+        // SR: header, sender SSRC, NTP timestamp (64), RTP timestamp, counts.
+        if (p[1] == kRtcpSr && len >= 28) {
+            sr_ssrc_ = read_u32(p + 4);
+            lsr_ = read_u32(p + 10);
+            sr_rx_ns_ = rx_ns ? rx_ns : realtime_ns();
+        }
+        offset += len;
+    }
+}
+
+void RtcpReporter::drain_socket()
+{
+    std::array<uint8_t, 1500> buf;
+    std::array<uint8_t, kRxTimestampControlLen> control{};
+    for (;;) {
+        iovec iov{buf.data(), buf.size()};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        const ssize_t n = recvmsg(fd_, &msg, 0);
+        if (n <= 0) {
+            return;
+        }
+        if (is_rtcp(buf.data(), static_cast<size_t>(n))) {
+            on_rtcp(buf.data(), static_cast<size_t>(n), rx_timestamp_ns(msg));
+        }
+    }
+}
+
+void RtcpReporter::build_report()
+{
+    report_ = RtcpReceptionReport{};
+    if (!started_ || !heard_) {
+        return;
+    }
+    report_.has_block = true;
+    report_.media_ssrc = media_ssrc_;
+
+    // A.3
+    const uint32_t extended_max = cycles_ + max_seq_;
+    const uint32_t expected = extended_max - base_seq_ + 1;
+    const int64_t lost = static_cast<int64_t>(expected) - static_cast<int64_t>(received_);
+    report_.cumulative_lost = static_cast<int32_t>(std::clamp<int64_t>(lost, -0x800000, 0x7fffff));
+    const uint32_t expected_interval = expected - expected_prior_;
+    expected_prior_ = expected;
+    const uint32_t received_interval = received_ - received_prior_;
+    received_prior_ = received_;
+    const int64_t lost_interval = static_cast<int64_t>(expected_interval) - static_cast<int64_t>(received_interval);
+    if (expected_interval > 0 && lost_interval > 0) {
+        report_.fraction_lost = static_cast<uint8_t>(std::min<int64_t>((lost_interval << 8) / expected_interval, 255));
+    }
+    report_.extended_highest_seq = extended_max;
+    report_.jitter = jitter_q4_ >> 4;
+    report_.jitter_ms = report_.jitter * 1000.0 / clock_rate_;
+
+    if (lsr_ && sr_ssrc_ == media_ssrc_) {
+        report_.lsr = lsr_;
+        const uint64_t now = realtime_ns();
+        const uint64_t delay_ns = now > sr_rx_ns_ ? now - sr_rx_ns_ : 0;
+        report_.dlsr = static_cast<uint32_t>(std::min<uint64_t>((delay_ns << 16) / 1000000000ULL, UINT32_MAX));
+    }
+}
+
+void RtcpReporter::send_report()
+{
+    uint8_t *p = packet_;
+    // RR: header, reporter SSRC, at most one report block.
+    const uint8_t blocks = report_.has_block ? 1 : 0;
+    p[0] = static_cast<uint8_t>(0x80 | blocks);
+    p[1] = kRtcpRr;
+    write_u16(p + 2, static_cast<uint16_t>(1 + 6 * blocks));
+    write_u32(p + 4, sender_ssrc_);
+    p += 8;
+    if (blocks) {
+        write_u32(p, report_.media_ssrc);
+        write_u32(p + 4, (static_cast<uint32_t>(report_.fraction_lost) << 24) |
+                             (static_cast<uint32_t>(report_.cumulative_lost) & 0xffffff));
+        write_u32(p + 8, report_.extended_highest_seq);
+        write_u32(p + 12, report_.jitter);
+        write_u32(p + 16, report_.lsr);
+        write_u32(p + 20, report_.dlsr);
+        p += 24;
+    }
+
+    // SDES with the CNAME every compound packet has to carry; the item list ends with
+    // a zero byte and is padded to a 32-bit boundary.
+    uint8_t *sdes = p;
+    const size_t cname_len = sizeof(kCname) - 1;
+    const size_t chunk = 4 + 2 + cname_len + 1;
+    const size_t sdes_len = 4 + ((chunk + 3) & ~size_t{3});
+    std::memset(sdes, 0, sdes_len);
+    sdes[0] = 0x81;
+    sdes[1] = kRtcpSdes;
+    write_u16(sdes + 2, static_cast<uint16_t>(sdes_len / 4 - 1));
+    write_u32(sdes + 4, sender_ssrc_);
+    sdes[8] = kSdesCname;
+    sdes[9] = static_cast<uint8_t>(cname_len);
+    std::memcpy(sdes + 10, kCname, cname_len);
+    p += sdes_len;
+
+    packet_len_ = static_cast<size_t>(p - packet_);
+    send(fd_, packet_, packet_len_, 0);
+}
+
+bool RtcpReporter::maybe_send(uint64_t now_us)
+{
+    if (now_us < next_report_us_) {
+        return false;
+    }
+    next_report_us_ = now_us + interval_us_;
+    if (fd_ >= 0) {
+        drain_socket();
+    }
+    build_report();
+    report_.elapsed_us = last_report_us_ ? now_us - last_report_us_ : 0;
+    last_report_us_ = now_us;
+    if (fd_ >= 0) {
+        send_report();
+    }
+    heard_ = false;
+    if (on_report_) {
+        on_report_(report_);
+    }
+    return true;
+}
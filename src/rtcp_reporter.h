@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// The report block of one receiver report, plus what it means in wall-clock terms.
+struct RtcpReceptionReport {
+    bool has_block = false;        // false: nothing received since the previous report
+    uint32_t media_ssrc = 0;
+    uint8_t fraction_lost = 0;     // lost / expected since the previous report, in 1/256
+    int32_t cumulative_lost = 0;   // 24-bit signed on the wire
+    uint32_t extended_highest_seq = 0;
+    uint32_t jitter = 0;           // RTP timestamp units
+    uint32_t lsr = 0;              // middle 32 bits of the last SR's NTP time, 0 = none
+    uint32_t dlsr = 0;             // since that SR, in 1/65536 s
+    double jitter_ms = 0.0;
+    uint64_t elapsed_us = 0;       // since the previous report
+};
+
+// RTCP receiver reports (RFC 3550) for the video stream. Reception statistics are kept
+// the way appendix A does it -- extended highest sequence number with restart detection
+// (A.1), expected vs. received for fraction / cumulative lost (A.3) and interarrival
+// jitter from the kernel receive time against the RTP timestamp (A.8) -- and sent as an
+// RR + SDES compound packet every interval. Sender reports, muxed on the RTP port
+// (RFC 5761) or sent back to the report socket, supply LSR/DLSR so the transmitter can
+// work out the round trip. Without open() the reports are only built and handed to the
+// report callback. Not thread-safe; driven from the socket reader thread.
+class RtcpReporter {
+public:
+    using ReportCallback = std::function<void(const RtcpReceptionReport &)>;
+
+    RtcpReporter(uint32_t clock_rate, uint32_t interval_ms, ReportCallback on_report = nullptr);
+    ~RtcpReporter();
+    RtcpReporter(const RtcpReporter &) = delete;
+    RtcpReporter &operator=(const RtcpReporter &) = delete;
+
+    // "host:port" of the transmitter's RTCP port.
+    bool open(const std::string &destination);
+    const std::string &destination() const { return destination_; }
+
+    // Every video RTP packet as it came off the network (not packets rebuilt from FEC);
+    // rx_ns is the CLOCK_REALTIME receive time, 0 when the ingest path has none.
+    void on_rtp(const uint8_t *packet, size_t size, uint64_t rx_ns);
+    // A compound RTCP packet from the sender; only the SR is used.
+    void on_rtcp(const uint8_t *packet, size_t size, uint64_t rx_ns);
+    // Picks up SRs queued on the report socket and sends a report once the interval is
+    // up. True when one was built; last_report() describes it.
+    bool maybe_send(uint64_t now_us);
+    const RtcpReceptionReport &last_report() const { return report_; }
+
+    // RFC 5761 demultiplexing: RTCP packet types 192..223 sit where RTP has M + PT.
+    static bool is_rtcp(const uint8_t *packet, size_t size)
+    {
+        return size >= 8 && (packet[0] & 0xc0) == 0x80 && packet[1] >= 192 && packet[1] <= 223;
+    }
+
+private:
+    void init_seq(uint16_t seq);
+    bool update_seq(uint16_t seq);
+    void drain_socket();
+    void build_report();
+    void send_report();
+
+    uint32_t clock_rate_;
+    uint64_t interval_us_;
+    int fd_{-1};
+    std::string destination_;
+    uint32_t sender_ssrc_{0};
+    uint64_t next_report_us_{0};
+    uint64_t last_report_us_{0};
+    ReportCallback on_report_;
+
+    // RFC 3550 A.1 source state
+    bool started_{false};
+    bool heard_{false}; // packets since the previous report
+    uint32_t media_ssrc_{0};
+    uint16_t max_seq_{0};
+    uint32_t cycles_{0};
+    uint32_t base_seq_{0};
+    uint32_t bad_seq_{0};
+    uint32_t received_{0};
+    uint32_t expected_prior_{0};
+    uint32_t received_prior_{0};
+    int64_t transit_{0};
+    bool have_transit_{false};
+    uint32_t jitter_q4_{0}; // jitter << 4, as in A.8
+
+    uint32_t sr_ssrc_{0};
+    uint32_t lsr_{0};
+    uint64_t sr_rx_ns_{0};
+
+    RtcpReceptionReport report_;
+    uint8_t packet_[128];
+    size_t packet_len_{0};
+};
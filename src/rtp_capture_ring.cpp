@@ -0,0 +1,203 @@
+#include "rtp_capture_ring.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t kMinCapacity = 64 * 1024;
+constexpr uint32_t kMaxSnaplen = 2048; // a whole wfb-ng/RTP datagram
+constexpr uint32_t kIpUdpHeader = 28;
+constexpr uint16_t kLinktypeIpv4 = 228;
+
+uint64_t realtime_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void put_be16(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+// pcap record header + IPv4 + UDP in front of each captured datagram.
+void build_packet_header(uint8_t *h, uint64_t rx_ns, uint32_t caplen, uint32_t len, uint16_t port)
+{
+    const uint32_t ts[4] = {static_cast<uint32_t>(rx_ns / 1000000000ull), static_cast<uint32_t>(rx_ns % 1000000000ull),
+                            kIpUdpHeader + caplen, kIpUdpHeader + len};
+    std::memcpy(h, ts, sizeof(ts));
+    uint8_t *ip = h + 16;
+    const uint32_t ip_len = std::min<uint32_t>(kIpUdpHeader + len, 0xffff);
+    std::memset(ip, 0, kIpUdpHeader);
+    ip[0] = 0x45;
+    put_be16(ip + 2, ip_len);
+    ip[6] = 0x40; // DF
+    ip[8] = 64;
+    ip[9] = 17;   // UDP
+    ip[12] = ip[16] = 127;
+    ip[15] = ip[19] = 1;
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2) {
+        sum += static_cast<uint32_t>(ip[i] << 8 | ip[i + 1]);
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    put_be16(ip + 10, ~sum & 0xffff);
+    uint8_t *udp = ip + 20;
+    put_be16(udp, port);
+    put_be16(udp + 2, port);
+    put_be16(udp + 4, std::min<uint32_t>(8 + len, 0xffff));
+}
+} // namespace
+
+RtpCaptureRing::RtpCaptureRing(size_t capacity_bytes, uint32_t window_ms, uint16_t port)
+    : window_ms_(window_ms), port_(port)
+{
+    const size_t capacity = (std::max(capacity_bytes, kMinCapacity) + 15) & ~size_t{15};
+    // Sized and zeroed up front: record() never faults a fresh page in.
+    arena_.assign(capacity, 0);
+    snaplen_ = static_cast<uint32_t>(std::min<size_t>(kMaxSnaplen, capacity / 4 - sizeof(Record)));
+}
+
+void RtpCaptureRing::record(const uint8_t *packet, size_t size, uint64_t rx_ns)
+{
+    const uint64_t cap = arena_.size();
+    const uint32_t caplen = static_cast<uint32_t>(std::min<size_t>(size, snaplen_));
+    const uint64_t need = record_size(caplen);
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t room = cap - head % cap;
+    const uint64_t start = room < need ? head + room : head;
+    const uint64_t end = start + need;
+
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (end - tail > cap) {
+        do {
+            tail = next(tail, arena_.data());
+        } while (end - tail > cap);
+        tail_.store(tail, std::memory_order_relaxed);
+        // A dumper reads tail_ after copying the arena; the new tail has to be visible
+        // before any of the bytes it gave up change.
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    uint8_t *base = arena_.data();
+    if (start != head) {
+        const Record pad{0, kPad, 0};
+        std::memcpy(base + head % cap, &pad, sizeof(pad));
+    }
+    const Record rec{rx_ns ? rx_ns : realtime_ns(), caplen, static_cast<uint32_t>(size)};
+    std::memcpy(base + start % cap, &rec, sizeof(rec));
+    std::memcpy(base + start % cap + sizeof(rec), packet, caplen);
+    head_.store(end, std::memory_order_release);
+}
+
+uint64_t RtpCaptureRing::next(uint64_t pos, const uint8_t *arena) const
+{
+    const uint64_t cap = arena_.size();
+    Record rec;
+    std::memcpy(&rec, arena + pos % cap, sizeof(rec));
+    if (rec.caplen == kPad) {
+        return pos + (cap - pos % cap);
+    }
+    return pos + record_size(std::min(rec.caplen, snaplen_));
+}
+
+uint64_t RtpCaptureRing::since_ns() const
+{
+    const uint64_t window_ns = static_cast<uint64_t>(window_ms_) * 1000000ull;
+    const uint64_t now = realtime_ns();
+    return window_ns && now > window_ns ? now - window_ns : 0;
+}
+
+template <typename Sink>
+void RtpCaptureRing::emit(const uint8_t *arena, uint64_t tail, uint64_t head, uint64_t since_ns, Sink &&sink,
+                          DumpResult &result) const
+{
+    // pcap 2.4 with nanosecond timestamps, host byte order (the magic tells readers which).
+    uint8_t file_header[24] = {};
+    const uint32_t magic = 0xa1b23c4d;
+    const uint16_t version[2] = {2, 4};
+    const uint32_t snaplen = kIpUdpHeader + snaplen_;
+    const uint32_t linktype = kLinktypeIpv4;
+    std::memcpy(file_header, &magic, 4);
+    std::memcpy(file_header + 4, version, 4);
+    std::memcpy(file_header + 16, &snaplen, 4);
+    std::memcpy(file_header + 20, &linktype, 4);
+    sink(file_header, sizeof(file_header));
+    result.bytes = sizeof(file_header);
+
+    const uint64_t cap = arena_.size();
+    for (uint64_t pos = tail; pos < head; pos = next(pos, arena)) {
+        Record rec;
+        std::memcpy(&rec, arena + pos % cap, sizeof(rec));
+        if (rec.caplen == kPad) {
+            continue;
+        }
+        if (rec.caplen > snaplen_) {
+            break; // torn; only possible on the signal path
+        }
+        if (rec.rx_ns < since_ns) {
+            continue;
+        }
+        uint8_t header[16 + kIpUdpHeader];
+        build_packet_header(header, rec.rx_ns, rec.caplen, rec.len, port_);
+        sink(header, sizeof(header));
+        sink(arena + pos % cap + sizeof(rec), rec.caplen);
+        result.bytes += sizeof(header) + rec.caplen;
+        if (!result.packets++) {
+            result.first_ns = rec.rx_ns;
+        }
+        result.last_ns = rec.rx_ns;
+    }
+}
+
+RtpCaptureRing::DumpResult RtpCaptureRing::write_pcap(const std::string &path) const
+{
+    DumpResult result;
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const std::vector<uint8_t> snapshot(arena_);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Everything from here on is still what the writer left there when we copied it.
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return result;
+    }
+    bool ok = true;
+    emit(snapshot.data(), tail, std::max(head, tail), since_ns(),
+         [&](const void *data, size_t size) { ok = ok && std::fwrite(data, 1, size, file) == size; }, result);
+    result.ok = std::fclose(file) == 0 && ok;
+    return result;
+}
+
+void RtpCaptureRing::write_pcap_from_signal(const char *path) const
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    DumpResult result;
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    emit(arena_.data(), tail, std::max(head, tail), since_ns(),
+         [fd](const void *data, size_t size) {
+             const auto *p = static_cast<const uint8_t *>(data);
+             while (size > 0) {
+                 const ssize_t n = write(fd, p, size);
+                 if (n <= 0) {
+                     return;
+                 }
+                 p += n;
+                 size -= static_cast<size_t>(n);
+             }
+         },
+         result);
+    close(fd);
+}
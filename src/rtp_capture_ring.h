@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The most recent raw datagrams off the wire, kept in memory for post-mortem analysis
+// and written out as pcap on request or from the crash handler.
+//
+// One preallocated byte arena, used as a ring of variable-size records (16-byte header
+// + packet, 16-byte aligned); a record never wraps, the arena end is padded instead.
+// record() is the hot path: a header, one memcpy, no allocation, no lock. Overwriting
+// the oldest records advances tail_ before their bytes are reused, so a concurrent
+// dump can tell which part of its copy is intact. Single writer (the reader thread),
+// any number of dumpers.
+//
+// The pcap uses nanosecond timestamps and LINKTYPE_IPV4 with a synthesized IPv4/UDP
+// header (127.0.0.1 -> 127.0.0.1, both ports = the receiver's), so Wireshark shows
+// UDP to the video port; "Decode As... RTP" from there.
+class RtpCaptureRing {
+public:
+    // capacity_bytes: arena size (rounded up to 16). window_ms: how far back a dump goes;
+    // 0 = everything still in the arena.
+    RtpCaptureRing(size_t capacity_bytes, uint32_t window_ms, uint16_t port);
+    RtpCaptureRing(const RtpCaptureRing &) = delete;
+    RtpCaptureRing &operator=(const RtpCaptureRing &) = delete;
+
+    // rx_ns: CLOCK_REALTIME receive time, 0 = now. Packets beyond the snap length are cut.
+    void record(const uint8_t *packet, size_t size, uint64_t rx_ns);
+
+    struct DumpResult {
+        bool ok = false;
+        uint64_t packets = 0;
+        uint64_t bytes = 0;       // file size
+        uint64_t first_ns = 0;
+        uint64_t last_ns = 0;
+    };
+    // Snapshots the ring and writes it to `path`. Any thread; does not stall the writer.
+    DumpResult write_pcap(const std::string &path) const;
+    // For fatal-signal handlers: open/write/close straight from the live arena, no
+    // allocation. Best effort; a record the writer is overwriting can come out torn.
+    void write_pcap_from_signal(const char *path) const;
+
+    size_t capacity() const { return arena_.size(); }
+    uint32_t window_ms() const { return window_ms_; }
+
+private:
+    struct Record {
+        uint64_t rx_ns;
+        uint32_t caplen; // kPad: filler up to the arena end
+        uint32_t len;
+    };
+    static constexpr uint32_t kPad = 0xffffffffu;
+
+    static uint64_t record_size(uint32_t caplen) { return (sizeof(Record) + caplen + 15) & ~uint64_t{15}; }
+    uint64_t next(uint64_t pos, const uint8_t *arena) const;
+    uint64_t since_ns() const;
+
+    template <typename Sink>
+    void emit(const uint8_t *arena, uint64_t tail, uint64_t head, uint64_t since_ns, Sink &&sink,
+              DumpResult &result) const;
+
+    std::vector<uint8_t> arena_;
+    uint32_t snaplen_;
+    uint32_t window_ms_;
+    uint16_t port_;
+    std::atomic<uint64_t> head_{0}; // logical byte positions; offset = pos % capacity
+    std::atomic<uint64_t> tail_{0}; // oldest intact record
+};
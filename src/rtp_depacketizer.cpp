@@ -0,0 +1,304 @@
+#include "rtp_depacketizer.h"
+
+#include <algorithm>
+
+#include "clock_sync.h"
+#include "rtp_router.h"
+
+namespace {
+constexpr uint8_t kStartCode[4] = {0, 0, 0, 1};
+
+constexpr uint8_t kH264StapA = 24;
+constexpr uint8_t kH264FuA = 28;
+constexpr uint8_t kH265Ap = 48;
+constexpr uint8_t kH265Fu = 49;
+
+uint16_t read_u16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+} // namespace
+
+RtpDepacketizer::RtpDepacketizer(VideoCodec codec, FrameCallback cb)
+    : codec_(codec), cb_(std::move(cb))
+{
+    reset();
+}
+
+void RtpDepacketizer::reset()
+{
+    frame_ = std::make_shared<std::vector<uint8_t>>();
+    frame_->reserve(size_hint_);
+    have_ts_ = false;
+    have_seq_ = false;
+    fu_active_ = false;
+    au_has_params_ = false;
+    au_damaged_ = true;
+}
+
+RtpDepacketizer::Stats RtpDepacketizer::take_stats()
+{
+    Stats out = stats_;
+    stats_ = Stats{};
+    return out;
+}
+
+void RtpDepacketizer::push(const uint8_t *packet, size_t size, uint64_t rx_ns)
+{
+    size_t header = 0, length = 0;
+    if (size <= RTP_HEADER_LEN || !rtp_payload(packet, size, header, length)) {
+        return;
+    }
+
+    ++stats_.packets;
+    const bool marker = (packet[1] & 0x80) != 0;
+    const uint16_t seq = read_u16(packet + 2);
+    const uint32_t ts = (static_cast<uint32_t>(packet[4]) << 24) | (static_cast<uint32_t>(packet[5]) << 16) |
+                        (static_cast<uint32_t>(packet[6]) << 8) | packet[7];
+
+    const bool gap = have_seq_ && seq != next_seq_;
+    if (gap) {
+        ++stats_.seq_gaps;
+        abort_fragment();
+        au_damaged_ = true;
+    }
+    have_seq_ = true;
+    next_seq_ = static_cast<uint16_t>(seq + 1);
+
+    // A new timestamp means the previous access unit lost its marker packet.
+    if (have_ts_ && ts != ts_) {
+        au_damaged_ = true;
+        flush();
+        // The lost packets may just as well have been the start of this access unit.
+        au_damaged_ = gap;
+    }
+    if (!have_ts_) {
+        have_ts_ = true;
+        ts_ = ts;
+        first_packet_ = std::chrono::steady_clock::now();
+        meta_ = FrameMeta{};
+        meta_.rtp_valid = true;
+        meta_.rtp_timestamp = ts;
+        meta_.first_seq = seq;
+    }
+    meta_.last_seq = seq;
+    meta_.timing.add_packet(rx_ns);
+    uint64_t capture_ns = 0;
+    if (capture_ext_id_ && clock_sync::rtp_capture_time(packet, size, capture_ext_id_, capture_ns)) {
+        meta_.timing.add_capture(capture_ns);
+    }
+
+    if (codec_ == VideoCodec::H264) {
+        push_h264(packet + header, length);
+    } else {
+        push_h265(packet + header, length);
+    }
+
+    if (marker) {
+        flush();
+    }
+}
+
+void RtpDepacketizer::push_h264(const uint8_t *payload, size_t size)
+{
+    const uint8_t type = payload[0] & 0x1f;
+    if (type >= 1 && type < kH264StapA) {
+        append_nal(payload, size);
+    } else if (type == kH264StapA) {
+        size_t pos = 1;
+        while (pos + 2 <= size) {
+            const size_t nal_size = read_u16(payload + pos);
+            pos += 2;
+            if (nal_size == 0 || pos + nal_size > size) {
+                break;
+            }
+            append_nal(payload + pos, nal_size);
+            pos += nal_size;
+        }
+    } else if (type == kH264FuA && size > 2) {
+        const uint8_t fu = payload[1];
+        if (fu & 0x80) {
+            abort_fragment();
+            const uint8_t nal_header = static_cast<uint8_t>((payload[0] & 0xe0) | (fu & 0x1f));
+            begin_nal(&nal_header);
+            fu_active_ = true;
+            fu_offset_ = frame_->size();
+            frame_->insert(frame_->end(), kStartCode, kStartCode + 4);
+            frame_->push_back(nal_header);
+        } else if (!fu_active_) {
+            ++stats_.dropped_fragments;
+            au_damaged_ = true;
+            return;
+        }
+        frame_->insert(frame_->end(), payload + 2, payload + size);
+        if (fu & 0x40) {
+            fu_active_ = false;
+            end_nal(fu_offset_);
+        }
+    }
+}
+
+void RtpDepacketizer::push_h265(const uint8_t *payload, size_t size)
+{
+    if (size < 2) {
+        return;
+    }
+    const uint8_t type = (payload[0] >> 1) & 0x3f;
+    if (type < kH265Ap) {
+        append_nal(payload, size);
+    } else if (type == kH265Ap) {
+        size_t pos = 2;
+        while (pos + 2 <= size) {
+            const size_t nal_size = read_u16(payload + pos);
+            pos += 2;
+            if (nal_size < 2 || pos + nal_size > size) {
+                break;
+            }
+            append_nal(payload + pos, nal_size);
+            pos += nal_size;
+        }
+    } else if (type == kH265Fu && size > 3) {
+        const uint8_t fu = payload[2];
+        if (fu & 0x80) {
+            abort_fragment();
+            const uint8_t nal_header[2] = {static_cast<uint8_t>((payload[0] & 0x81) | ((fu & 0x3f) << 1)),
+                                           payload[1]};
+            begin_nal(nal_header);
+            fu_active_ = true;
+            fu_offset_ = frame_->size();
+            frame_->insert(frame_->end(), kStartCode, kStartCode + 4);
+            frame_->insert(frame_->end(), nal_header, nal_header + 2);
+        } else if (!fu_active_) {
+            ++stats_.dropped_fragments;
+            au_damaged_ = true;
+            return;
+        }
+        frame_->insert(frame_->end(), payload + 3, payload + size);
+        if (fu & 0x40) {
+            fu_active_ = false;
+            end_nal(fu_offset_);
+        }
+    }
+}
+
+void RtpDepacketizer::append_nal(const uint8_t *nal, size_t size)
+{
+    begin_nal(nal);
+    const size_t offset = frame_->size();
+    frame_->insert(frame_->end(), kStartCode, kStartCode + 4);
+    frame_->insert(frame_->end(), nal, nal + size);
+    end_nal(offset);
+}
+
+void RtpDepacketizer::begin_nal(const uint8_t *header)
+{
+    const bool was_irap = meta_.nals.irap;
+    meta_.nals.add(codec_, header);
+    if (parameter_set_index(header) >= 0) {
+        au_has_params_ = true;
+        return;
+    }
+    // Only the first IRAP slice of the access unit needs the parameter sets in front.
+    if (!meta_.nals.irap || was_irap || au_has_params_) {
+        return;
+    }
+    // Same guarantee as h26Xparse config-interval=-1: every IRAP carries its parameter sets.
+    const int first = codec_ == VideoCodec::H264 ? 1 : 0;
+    for (int i = first; i < 3; ++i) {
+        if (params_[i].empty()) {
+            return;
+        }
+    }
+    for (int i = first; i < 3; ++i) {
+        frame_->insert(frame_->end(), kStartCode, kStartCode + 4);
+        frame_->insert(frame_->end(), params_[i].begin(), params_[i].end());
+        meta_.nals.add(codec_, params_[i].data());
+    }
+    au_has_params_ = true;
+}
+
+void RtpDepacketizer::end_nal(size_t offset)
+{
+    const int index = parameter_set_index(frame_->data() + offset + 4);
+    if (index >= 0) {
+        params_[index].assign(frame_->begin() + static_cast<std::ptrdiff_t>(offset + 4), frame_->end());
+    }
+}
+
+void RtpDepacketizer::abort_fragment()
+{
+    if (!fu_active_) {
+        return;
+    }
+    frame_->resize(fu_offset_);
+    fu_active_ = false;
+    au_damaged_ = true;
+    ++stats_.dropped_fragments;
+}
+
+void RtpDepacketizer::flush()
+{
+    abort_fragment();
+    meta_.flags = (meta_.nals.irap ? VideoFrame::KEYFRAME : 0u) | (au_damaged_ ? VideoFrame::INCOMPLETE : 0u);
+    const bool had_packets = have_ts_;
+    have_ts_ = false;
+    au_has_params_ = false;
+    au_damaged_ = false;
+    if (frame_->empty()) {
+        // Nothing survived of a damaged access unit: still tell the receiver it was lost.
+        if (had_packets && (meta_.flags & VideoFrame::INCOMPLETE) && cb_) {
+            ++stats_.incomplete_frames;
+            meta_.timing.complete_ns = realtime_ns();
+            meta_.flags = VideoFrame::INCOMPLETE;
+            cb_(VideoFrame::wrap(std::make_shared<std::vector<uint8_t>>(), meta_));
+        }
+        return;
+    }
+
+    const auto assembly_us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - first_packet_)
+            .count());
+    ++stats_.frames;
+    if (meta_.flags & VideoFrame::INCOMPLETE) {
+        ++stats_.incomplete_frames;
+    }
+    stats_.assembly_us_sum += assembly_us;
+    stats_.assembly_us_max = std::max(stats_.assembly_us_max, static_cast<uint32_t>(assembly_us));
+
+    // Track recent frame sizes so keyframes rarely need to grow the next buffer.
+    size_hint_ = std::max(size_hint_ - size_hint_ / 8, frame_->size());
+    auto frame = std::move(frame_);
+    frame_ = std::make_shared<std::vector<uint8_t>>();
+    frame_->reserve(size_hint_);
+    meta_.timing.complete_ns = realtime_ns();
+    if (!meta_.timing.kernel) {
+        meta_.timing.first_rx_ns = meta_.timing.last_rx_ns = meta_.timing.complete_ns;
+    }
+    if (cb_) {
+        cb_(VideoFrame::wrap(std::move(frame), meta_));
+    }
+}
+
+int RtpDepacketizer::parameter_set_index(const uint8_t *header) const
+{
+    if (codec_ == VideoCodec::H264) {
+        switch (header[0] & 0x1f) {
+        case 7:
+            return 1;
+        case 8:
+            return 2;
+        default:
+            return -1;
+        }
+    }
+    switch ((header[0] >> 1) & 0x3f) {
+    case 32:
+        return 0;
+    case 33:
+        return 1;
+    case 34:
+        return 2;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "frame_timing.h"
+#include "gstrtpreceiver.h"
+
+// In-process replacement for `rtph26Xdepay ! h26Xparse config-interval=-1 ! appsink`:
+// turns RTP packets (RFC 6184 / RFC 7798: single NAL, STAP-A/AP, FU-A/FU) into Annex-B
+// access units, completed on the marker bit (or on a timestamp change when the marker
+// packet was lost). Cached VPS/SPS/PPS are inserted in front of IRAP pictures that arrive
+// without them. Access units are flagged (VideoFrame::Flags) as keyframes when they carry an
+// IRAP/IDR slice and as incomplete when a sequence gap, a broken fragment or a lost marker
+// touched them; an access unit lost entirely comes out as an empty INCOMPLETE frame. The
+// frame's metadata (RTP timestamp and sequence range, NAL summary) is collected from the
+// headers on the way, so nothing rescans the access unit.
+// Not thread-safe; meant to be driven by the socket reader thread.
+class RtpDepacketizer {
+public:
+    using FrameCallback = std::function<void(VideoFramePtr frame)>;
+
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t frames = 0;
+        uint64_t incomplete_frames = 0;
+        uint64_t seq_gaps = 0;          // discontinuities in the RTP sequence
+        uint64_t dropped_fragments = 0; // FU payloads discarded because their NAL was broken
+        uint64_t assembly_us_sum = 0;   // first packet -> frame callback
+        uint32_t assembly_us_max = 0;
+    };
+
+    RtpDepacketizer(VideoCodec codec, FrameCallback cb);
+
+    // One complete RTP packet (header included); rx_ns is its kernel receive time, or 0.
+    void push(const uint8_t *packet, size_t size, uint64_t rx_ns = 0);
+    // Forgets the partial access unit and sequence state, e.g. after a source change.
+    void reset();
+    // Header extension element carrying the air unit's capture time (FrameTiming::capture_ns), 0 = none.
+    void set_capture_time_extension(uint8_t id) { capture_ext_id_ = id; }
+
+    Stats take_stats();
+
+private:
+    void push_h264(const uint8_t *payload, size_t size);
+    void push_h265(const uint8_t *payload, size_t size);
+    void append_nal(const uint8_t *nal, size_t size);
+    void begin_nal(const uint8_t *header);
+    void end_nal(size_t offset);
+    void abort_fragment();
+    void flush();
+
+    int parameter_set_index(const uint8_t *header) const;
+
+    VideoCodec codec_;
+    FrameCallback cb_;
+
+    std::shared_ptr<std::vector<uint8_t>> frame_;
+    size_t size_hint_{64 * 1024};
+    bool have_ts_{false};
+    uint32_t ts_{0};
+    bool have_seq_{false};
+    uint16_t next_seq_{0};
+    std::chrono::steady_clock::time_point first_packet_;
+    FrameMeta meta_; // of the access unit being assembled; flags are set in flush()
+    uint8_t capture_ext_id_{0};
+
+    bool fu_active_{false};
+    size_t fu_offset_{0};          // where the fragmented NAL's start code begins
+    bool au_has_params_{false};
+    bool au_damaged_{true};        // nothing is known about the access unit we join in
+
+    // [0] VPS (H.265 only), [1] SPS, [2] PPS
+    std::vector<uint8_t> params_[3];
+
+    Stats stats_;
+};
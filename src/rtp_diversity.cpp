@@ -0,0 +1,162 @@
+#include "rtp_diversity.h"
+#include "gstrtpreceiver.h"
+#include "frame_timing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace {
+constexpr size_t kMaxStreams = 8;
+// Further behind than this is not a late copy any more but a sender restart.
+constexpr int kRestartDistance = 4 * RtpDiversityMerger::kWindow;
+} // namespace
+
+RtpDiversityMerger::RtpDiversityMerger(size_t inputs)
+    : stats_(std::min(inputs, kMaxInputs))
+{
+}
+
+RtpDiversityMerger::Stream &RtpDiversityMerger::stream_for(uint32_t ssrc)
+{
+    ++clock_;
+    for (auto &stream : streams_) {
+        if (stream.ssrc == ssrc) {
+            stream.last_used = clock_;
+            return stream;
+        }
+    }
+    if (streams_.size() < kMaxStreams) {
+        streams_.emplace_back();
+        streams_.back().ssrc = ssrc;
+        streams_.back().last_used = clock_;
+        return streams_.back();
+    }
+    auto oldest = std::min_element(streams_.begin(), streams_.end(),
+                                   [](const Stream &a, const Stream &b) { return a.last_used < b.last_used; });
+    *oldest = Stream{};
+    oldest->ssrc = ssrc;
+    oldest->last_used = clock_;
+    return *oldest;
+}
+
+void RtpDiversityMerger::retire(uint8_t &mask)
+{
+    // Slot leaves the window: if exactly one input had it, that input alone saved the packet.
+    if (mask != 0 && (mask & (mask - 1)) == 0) {
+        ++stats_[static_cast<size_t>(__builtin_ctz(mask))].exclusive;
+    }
+    mask = 0;
+}
+
+bool RtpDiversityMerger::accept(size_t input, const uint8_t *packet, size_t size)
+{
+    if (input >= stats_.size() || size < RTP_HEADER_LEN) {
+        return true;
+    }
+    // Muxed RTCP has no sequence number; every copy goes through.
+    if (packet[1] >= 192 && packet[1] <= 223) {
+        return true;
+    }
+    InputStats &in = stats_[input];
+    ++in.packets;
+
+    const uint16_t seq = static_cast<uint16_t>((packet[2] << 8) | packet[3]);
+    const uint32_t ssrc = (static_cast<uint32_t>(packet[8]) << 24) | (static_cast<uint32_t>(packet[9]) << 16) |
+                          (static_cast<uint32_t>(packet[10]) << 8) | packet[11];
+    Stream &st = stream_for(ssrc);
+
+    const auto ahead = static_cast<int16_t>(seq - st.highest);
+    if (!st.started || ahead <= -kRestartDistance) {
+        for (auto &mask : st.seen) {
+            retire(mask);
+        }
+        st.started = true;
+        st.highest = seq;
+    } else if (ahead > 0) {
+        if (ahead >= kWindow) {
+            for (auto &mask : st.seen) {
+                retire(mask);
+            }
+        } else {
+            for (uint16_t s = static_cast<uint16_t>(st.highest + 1); s != static_cast<uint16_t>(seq + 1); ++s) {
+                retire(st.seen[s % kWindow]);
+            }
+        }
+        st.highest = seq;
+    } else if (ahead <= -static_cast<int>(kWindow)) {
+        // Older than the window: some other input delivered it long ago, or nobody needs it now.
+        ++in.duplicates;
+        return false;
+    }
+
+    uint8_t &mask = st.seen[seq % kWindow];
+    const auto bit = static_cast<uint8_t>(1u << input);
+    if (mask != 0) {
+        mask |= bit;
+        ++in.duplicates;
+        return false;
+    }
+    mask = bit;
+    ++in.first;
+    return true;
+}
+
+std::vector<RtpDiversityMerger::InputStats> RtpDiversityMerger::take_stats()
+{
+    std::vector<InputStats> out(stats_.size());
+    std::swap(out, stats_);
+    return out;
+}
+
+DiversityReceiver::DiversityReceiver(std::vector<Input> inputs, int batch)
+    : inputs_(std::move(inputs)),
+      batch_(std::clamp(batch, 1, MAX_RECV_BATCH)),
+      merger_(inputs_.size()),
+      storage_(static_cast<size_t>(batch_) * MAX_PACKET_SIZE),
+      control_(static_cast<size_t>(batch_) * kRxTimestampControlLen)
+{
+}
+
+int DiversityReceiver::wait(int timeout_ms, const PacketHandler &handler)
+{
+    pollfd pfds[RtpDiversityMerger::kMaxInputs];
+    const size_t count = std::min(inputs_.size(), RtpDiversityMerger::kMaxInputs);
+    for (size_t i = 0; i < count; ++i) {
+        pfds[i] = {inputs_[i].fd, POLLIN, 0};
+    }
+    ++syscalls_;
+    const int ready = poll(pfds, count, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    iovec iovs[MAX_RECV_BATCH];
+    mmsghdr msgs[MAX_RECV_BATCH];
+    int delivered = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!(pfds[i].revents & POLLIN)) {
+            continue;
+        }
+        for (int j = 0; j < batch_; ++j) {
+            iovs[j].iov_base = storage_.data() + static_cast<size_t>(j) * MAX_PACKET_SIZE;
+            iovs[j].iov_len = MAX_PACKET_SIZE;
+            msgs[j] = {};
+            msgs[j].msg_hdr.msg_iov = &iovs[j];
+            msgs[j].msg_hdr.msg_iovlen = 1;
+            msgs[j].msg_hdr.msg_control = control_.data() + static_cast<size_t>(j) * kRxTimestampControlLen;
+            msgs[j].msg_hdr.msg_controllen = kRxTimestampControlLen;
+        }
+        ++syscalls_;
+        const int received = recvmmsg(inputs_[i].fd, msgs, batch_, MSG_DONTWAIT, nullptr);
+        for (int j = 0; j < received; ++j) {
+            const auto *data = static_cast<const uint8_t *>(iovs[j].iov_base);
+            if (merger_.accept(i, data, msgs[j].msg_len)) {
+                handler(data, msgs[j].msg_len, rx_timestamp_ns(msgs[j].msg_hdr));
+                ++delivered;
+            }
+        }
+    }
+    return delivered;
+}
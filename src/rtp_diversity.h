@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Diversity reception: the same RTP stream is forwarded by several ground radios to
+// different UDP ports. RtpDiversityMerger keeps the first copy of every (SSRC, sequence
+// number) in a sliding window and remembers which inputs delivered it, so each input's
+// contribution (first arrivals, and packets only that input delivered) can be reported.
+class RtpDiversityMerger {
+public:
+    static constexpr size_t kMaxInputs = 8;
+    static constexpr uint16_t kWindow = 1024;
+
+    struct InputStats {
+        uint64_t packets = 0;
+        uint64_t first = 0;      // copies that won the race and went downstream
+        uint64_t duplicates = 0;
+        uint64_t exclusive = 0;  // sequence numbers no other input delivered
+    };
+
+    explicit RtpDiversityMerger(size_t inputs);
+
+    // True when this is the first copy of the packet; non-RTP datagrams always pass.
+    bool accept(size_t input, const uint8_t *packet, size_t size);
+    size_t inputs() const { return stats_.size(); }
+    std::vector<InputStats> take_stats();
+
+private:
+    struct Stream {
+        uint32_t ssrc = 0;
+        bool started = false;
+        uint16_t highest = 0;
+        uint64_t last_used = 0;
+        std::array<uint8_t, kWindow> seen{}; // bit i: input i delivered this sequence number
+    };
+
+    Stream &stream_for(uint32_t ssrc);
+    void retire(uint8_t &mask);
+
+    std::vector<Stream> streams_;
+    std::vector<InputStats> stats_;
+    uint64_t clock_{0};
+};
+
+// Waits on all diversity sockets at once, drains the ready ones with recvmmsg() and hands
+// only deduplicated datagrams to the caller.
+class DiversityReceiver {
+public:
+    // rx_ns: kernel receive time (SO_TIMESTAMPNS), 0 when the socket does not stamp.
+    using PacketHandler = std::function<void(const uint8_t *data, size_t size, uint64_t rx_ns)>;
+
+    struct Input {
+        int fd;
+        int port; // for reporting only
+    };
+
+    // At most RtpDiversityMerger::kMaxInputs inputs are used.
+    DiversityReceiver(std::vector<Input> inputs, int batch);
+
+    // Returns the number of datagrams delivered, or -1 when poll() fails.
+    int wait(int timeout_ms, const PacketHandler &handler);
+
+    const std::vector<Input> &inputs() const { return inputs_; }
+    RtpDiversityMerger &merger() { return merger_; }
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    std::vector<Input> inputs_;
+    int batch_;
+    RtpDiversityMerger merger_;
+    std::vector<uint8_t> storage_;
+    std::vector<uint8_t> control_;
+    uint64_t syscalls_{0};
+};
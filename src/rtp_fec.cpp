@@ -0,0 +1,357 @@
+#include "rtp_fec.h"
+
+#include <algorithm>
+
+namespace {
+constexpr size_t kRtpHeaderLen = 12; // fixed header; media packets keep their CSRCs/extension in the payload part
+
+// Groups are kept this many packets past their last member for the other direction's
+// parity to help out.
+constexpr int kGroupSlack = 16;
+
+uint16_t read_u16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read_u32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void write_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+void write_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+} // namespace
+
+RtpFecEncoder::RtpFecEncoder(int columns, int rows, uint8_t payload_type, Output out)
+    : columns_(std::clamp(columns, 2, rtp_fec::kMaxBlock / 2)),
+      rows_(std::clamp(rows, 1, rtp_fec::kMaxBlock / columns_)),
+      pt_(payload_type), out_(std::move(out))
+{
+    if (rows_ > 1) {
+        columns_parity_.resize(static_cast<size_t>(columns_));
+    }
+}
+
+void RtpFecEncoder::on_media(const uint8_t *packet, size_t size)
+{
+    if (size <= kRtpHeaderLen) {
+        return;
+    }
+    const uint16_t seq = read_u16(packet + 2);
+    const uint32_t ssrc = read_u32(packet + 8);
+    if (!started_ || ssrc != media_ssrc_ || seq != static_cast<uint16_t>(base_ + position_)) {
+        // Start a fresh block; a partial one is simply not protected.
+        started_ = true;
+        media_ssrc_ = ssrc;
+        base_ = seq;
+        position_ = 0;
+        row_ = Parity{};
+        for (auto &column : columns_parity_) {
+            column = Parity{};
+        }
+    }
+    last_ts_ = read_u32(packet + 4);
+
+    const auto add = [&](Parity &parity) {
+        parity.used = true;
+        parity.length ^= static_cast<uint16_t>(size - kRtpHeaderLen);
+        parity.header[0] ^= packet[0];
+        parity.header[1] ^= packet[1];
+        for (int i = 0; i < 4; ++i) {
+            parity.ts[i] ^= packet[4 + i];
+        }
+        if (parity.payload.size() < size - kRtpHeaderLen) {
+            parity.payload.resize(size - kRtpHeaderLen, 0);
+        }
+        for (size_t i = kRtpHeaderLen; i < size; ++i) {
+            parity.payload[i - kRtpHeaderLen] ^= packet[i];
+        }
+    };
+    add(row_);
+    if (rows_ > 1) {
+        add(columns_parity_[static_cast<size_t>(position_ % columns_)]);
+    }
+
+    ++position_;
+    if (position_ % columns_ == 0) {
+        emit(row_, 0, static_cast<uint8_t>(position_ / columns_ - 1));
+    }
+    if (position_ == columns_ * rows_) {
+        if (rows_ > 1) {
+            for (int c = 0; c < columns_; ++c) {
+                emit(columns_parity_[static_cast<size_t>(c)], 1, static_cast<uint8_t>(c));
+            }
+        }
+        base_ = static_cast<uint16_t>(base_ + position_);
+        position_ = 0;
+    }
+}
+
+void RtpFecEncoder::emit(Parity &parity, uint8_t kind, uint8_t index)
+{
+    if (!parity.used) {
+        return;
+    }
+    packet_.assign(kRtpHeaderLen + rtp_fec::kHeaderLen + parity.payload.size(), 0);
+    uint8_t *p = packet_.data();
+    p[0] = 0x80;
+    p[1] = pt_;
+    write_u16(p + 2, seq_++);
+    write_u32(p + 4, last_ts_);
+    // Own stream next to the media one, so receivers deduplicating by (SSRC, seq) keep both.
+    write_u32(p + 8, media_ssrc_ + 1);
+
+    uint8_t *h = p + kRtpHeaderLen;
+    write_u32(h, media_ssrc_);
+    write_u16(h + 4, base_);
+    h[6] = static_cast<uint8_t>(columns_);
+    h[7] = static_cast<uint8_t>(rows_);
+    h[8] = kind;
+    h[9] = index;
+    write_u16(h + 10, parity.length);
+    h[12] = parity.header[0];
+    h[13] = parity.header[1];
+    std::copy(parity.ts, parity.ts + 4, h + 14);
+    std::copy(parity.payload.begin(), parity.payload.end(), h + rtp_fec::kHeaderLen);
+    out_(packet_.data(), packet_.size());
+
+    parity.used = false;
+    parity.length = 0;
+    parity.header[0] = parity.header[1] = 0;
+    std::fill(parity.ts, parity.ts + 4, 0);
+    parity.payload.clear();
+}
+
+RtpFecDecoder::RtpFecDecoder(Output out)
+    : out_(std::move(out)), slots_(kSlots)
+{
+}
+
+RtpFecDecoder::Stats RtpFecDecoder::take_stats()
+{
+    Stats out = stats_;
+    stats_ = Stats{};
+    return out;
+}
+
+bool RtpFecDecoder::have(uint16_t seq) const
+{
+    const Slot &slot = slots_[seq % kSlots];
+    return slot.seq == seq && slot.present;
+}
+
+RtpFecDecoder::Slot &RtpFecDecoder::store(uint16_t seq, const uint8_t *packet, size_t size)
+{
+    Slot &slot = slots_[seq % kSlots];
+    slot.seq = seq;
+    slot.present = true;
+    slot.recovered = false;
+    slot.given_up = false;
+    slot.data.assign(packet, packet + size);
+    return slot;
+}
+
+uint16_t RtpFecDecoder::member(const Group &group, int i) const
+{
+    if (group.kind == 0) {
+        return static_cast<uint16_t>(group.base + group.index * group.columns + i);
+    }
+    return static_cast<uint16_t>(group.base + group.index + i * group.columns);
+}
+
+int RtpFecDecoder::member_count(const Group &group) const
+{
+    return group.kind == 0 ? group.columns : group.rows;
+}
+
+uint16_t RtpFecDecoder::last_member(const Group &group) const
+{
+    return member(group, member_count(group) - 1);
+}
+
+bool RtpFecDecoder::on_media(const uint8_t *packet, size_t size)
+{
+    if (size <= kRtpHeaderLen) {
+        return true;
+    }
+    const uint16_t seq = read_u16(packet + 2);
+    const uint32_t ssrc = read_u32(packet + 8);
+    if (!started_ || ssrc != media_ssrc_) {
+        started_ = true;
+        media_ssrc_ = ssrc;
+        highest_ = seq;
+        groups_.clear();
+        for (auto &slot : slots_) {
+            slot.present = slot.recovered = slot.given_up = false;
+        }
+    }
+    ++stats_.media;
+
+    const Slot &slot = slots_[seq % kSlots];
+    if (slot.seq == seq && slot.recovered) {
+        ++stats_.duplicates;
+        return false;
+    }
+    if (static_cast<int16_t>(seq - highest_) > 0) {
+        highest_ = seq;
+    }
+    store(seq, packet, size);
+    if (!groups_.empty()) {
+        retry_groups();
+        expire_groups();
+    }
+    return true;
+}
+
+void RtpFecDecoder::on_parity(const uint8_t *packet, size_t size)
+{
+    // The encoder never adds CSRCs or extensions to parity packets.
+    if (size <= kRtpHeaderLen + rtp_fec::kHeaderLen || (packet[0] & 0x1f) != 0) {
+        return;
+    }
+    const uint8_t *h = packet + kRtpHeaderLen;
+    Group group;
+    group.base = read_u16(h + 4);
+    group.columns = h[6];
+    group.rows = h[7];
+    group.kind = h[8];
+    group.index = h[9];
+    if (!started_ || read_u32(h) != media_ssrc_ || group.columns == 0 || group.rows == 0 ||
+        group.columns * group.rows > rtp_fec::kMaxBlock || group.kind > 1 ||
+        group.index >= (group.kind == 0 ? group.rows : group.columns)) {
+        return;
+    }
+    ++stats_.parity;
+    // Its media packets have already left the store.
+    if (static_cast<int16_t>(highest_ - last_member(group)) >= kSlots / 2) {
+        return;
+    }
+    group.parity.assign(h, packet + size);
+    if (try_recover(group)) {
+        retry_groups();
+        return;
+    }
+    if (groups_.size() >= kMaxGroups) {
+        give_up(groups_.front());
+        groups_.erase(groups_.begin());
+    }
+    groups_.push_back(std::move(group));
+}
+
+bool RtpFecDecoder::try_recover(const Group &group)
+{
+    const int count = member_count(group);
+    int missing = 0;
+    uint16_t lost = 0;
+    for (int i = 0; i < count; ++i) {
+        const uint16_t seq = member(group, i);
+        if (!have(seq)) {
+            if (++missing > 1) {
+                return false;
+            }
+            lost = seq;
+        }
+    }
+    if (missing == 0) {
+        return true;
+    }
+
+    const uint8_t *h = group.parity.data();
+    uint16_t length = read_u16(h + 10);
+    uint8_t header[2] = {h[12], h[13]};
+    uint32_t ts = read_u32(h + 14);
+    scratch_.assign(h + rtp_fec::kHeaderLen, h + group.parity.size());
+    for (int i = 0; i < count; ++i) {
+        const uint16_t seq = member(group, i);
+        if (seq == lost) {
+            continue;
+        }
+        const std::vector<uint8_t> &data = slots_[seq % kSlots].data;
+        length ^= static_cast<uint16_t>(data.size() - kRtpHeaderLen);
+        header[0] ^= data[0];
+        header[1] ^= data[1];
+        ts ^= read_u32(data.data() + 4);
+        const size_t n = std::min(data.size() - kRtpHeaderLen, scratch_.size());
+        for (size_t j = 0; j < n; ++j) {
+            scratch_[j] ^= data[kRtpHeaderLen + j];
+        }
+    }
+    if (length == 0 || length > scratch_.size() || (header[0] & 0xc0) != 0x80) {
+        // Parity from a different block layout or a corrupt packet.
+        give_up(group);
+        return true;
+    }
+
+    uint8_t rtp[kRtpHeaderLen];
+    rtp[0] = header[0];
+    rtp[1] = header[1];
+    write_u16(rtp + 2, lost);
+    write_u32(rtp + 4, ts);
+    write_u32(rtp + 8, media_ssrc_);
+    Slot &slot = slots_[lost % kSlots];
+    slot.seq = lost;
+    slot.present = true;
+    slot.recovered = true;
+    slot.given_up = false;
+    slot.data.assign(rtp, rtp + kRtpHeaderLen);
+    slot.data.insert(slot.data.end(), scratch_.begin(), scratch_.begin() + length);
+    ++stats_.recovered;
+    out_(slot.data.data(), slot.data.size());
+    return true;
+}
+
+void RtpFecDecoder::retry_groups()
+{
+    for (size_t i = 0; i < groups_.size();) {
+        if (try_recover(groups_[i])) {
+            groups_.erase(groups_.begin() + static_cast<std::ptrdiff_t>(i));
+            // A recovered packet may be what an earlier group was waiting for.
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RtpFecDecoder::expire_groups()
+{
+    for (size_t i = 0; i < groups_.size();) {
+        const Group &group = groups_[i];
+        if (static_cast<int16_t>(highest_ - last_member(group)) > group.columns * group.rows + kGroupSlack) {
+            give_up(group);
+            groups_.erase(groups_.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RtpFecDecoder::give_up(const Group &group)
+{
+    const int count = member_count(group);
+    for (int i = 0; i < count; ++i) {
+        const uint16_t seq = member(group, i);
+        Slot &slot = slots_[seq % kSlots];
+        if (slot.seq == seq && (slot.present || slot.given_up)) {
+            continue;
+        }
+        slot.seq = seq;
+        slot.present = false;
+        slot.recovered = false;
+        slot.given_up = true;
+        ++stats_.unrecoverable;
+    }
+}
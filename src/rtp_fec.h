@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Packet-level FEC for the video RTP stream: XOR row/column parity in the spirit of
+// RFC 5109 / RFC 8627 (FlexFEC), carried on its own payload type.
+//
+// Media packets are grouped into blocks of L columns x D rows in sequence order. Every row
+// gets one parity packet; with D > 1 every column gets one too, so a burst of up to L
+// consecutive losses is still recoverable. A parity packet is an RTP packet (own SSRC and
+// sequence space) followed by this header and the XOR of the protected payloads:
+//
+//   0      protected (media) SSRC           u32
+//   4      sequence number base of the block u16
+//   6      L (columns), D (rows)            u8, u8
+//   8      kind (0 row, 1 column), index    u8, u8
+//   10     length recovery                  u16  XOR of (packet size - 12)
+//   12     header recovery                  u16  XOR of RTP bytes 0-1 (P, X, CC, M, PT)
+//   14     timestamp recovery               u32
+//   18     reserved                         u16
+//   20     payload recovery                 XOR of bytes 12.. of every protected packet
+//
+// All multi-byte fields are big-endian.
+namespace rtp_fec {
+constexpr size_t kHeaderLen = 20;
+constexpr int kMaxBlock = 256; // L * D
+} // namespace rtp_fec
+
+// Sender side, used by the test tools: feed it the media packets in order and it hands
+// back the parity packets as soon as a row or block is complete.
+class RtpFecEncoder {
+public:
+    using Output = std::function<void(const uint8_t *packet, size_t size)>;
+
+    // columns (L) >= 2; rows (D) >= 1, with 1 meaning row parity only.
+    RtpFecEncoder(int columns, int rows, uint8_t payload_type, Output out);
+
+    void on_media(const uint8_t *packet, size_t size);
+
+private:
+    struct Parity {
+        bool used = false;
+        uint16_t length = 0;
+        uint8_t header[2] = {0, 0};
+        uint8_t ts[4] = {0, 0, 0, 0};
+        std::vector<uint8_t> payload;
+    };
+
+    void emit(Parity &parity, uint8_t kind, uint8_t index);
+
+    int columns_;
+    int rows_;
+    uint8_t pt_;
+    Output out_;
+    bool started_{false};
+    uint32_t media_ssrc_{0};
+    uint16_t base_{0};
+    int position_{0};
+    uint16_t seq_{0};
+    uint32_t last_ts_{0};
+    Parity row_;
+    std::vector<Parity> columns_parity_;
+    std::vector<uint8_t> packet_;
+};
+
+// Receiver side: sees every media and parity packet of the stream and rebuilds a missing
+// media packet as soon as one of its parity groups lacks exactly that packet. Recovered
+// packets feed back into the other groups, so row and column parity decode iteratively.
+// Groups that cannot be completed are given up once the stream has moved a block past
+// them. Not thread-safe.
+class RtpFecDecoder {
+public:
+    // Recovered media packets, complete with RTP header; they arrive after their
+    // successors, so a reorder stage should sit behind the decoder.
+    using Output = std::function<void(const uint8_t *packet, size_t size)>;
+
+    struct Stats {
+        uint64_t media = 0;
+        uint64_t parity = 0;
+        uint64_t recovered = 0;
+        uint64_t unrecoverable = 0; // media packets of given-up groups that never showed up
+        uint64_t duplicates = 0;    // originals arriving after their recovered copy
+    };
+
+    explicit RtpFecDecoder(Output out);
+
+    // Returns false when the packet was already recovered; the caller drops it.
+    bool on_media(const uint8_t *packet, size_t size);
+    void on_parity(const uint8_t *packet, size_t size);
+
+    Stats take_stats();
+
+private:
+    static constexpr uint16_t kSlots = 1024;
+    static constexpr size_t kMaxGroups = 64;
+
+    struct Slot {
+        uint16_t seq = 0;
+        bool present = false;
+        bool recovered = false;
+        bool given_up = false;
+        std::vector<uint8_t> data;
+    };
+
+    struct Group {
+        uint16_t base = 0;
+        uint8_t columns = 0;
+        uint8_t rows = 0;
+        uint8_t kind = 0;
+        uint8_t index = 0;
+        std::vector<uint8_t> parity;
+    };
+
+    bool have(uint16_t seq) const;
+    Slot &store(uint16_t seq, const uint8_t *packet, size_t size);
+    uint16_t member(const Group &group, int i) const;
+    int member_count(const Group &group) const;
+    uint16_t last_member(const Group &group) const;
+    // true when the group is done with: everything present, or the one gap recovered.
+    bool try_recover(const Group &group);
+    void retry_groups();
+    void expire_groups();
+    void give_up(const Group &group);
+
+    Output out_;
+    std::vector<Slot> slots_;
+    std::vector<Group> groups_;
+    bool started_{false};
+    uint32_t media_ssrc_{0};
+    uint16_t highest_{0};
+    std::vector<uint8_t> scratch_;
+    Stats stats_;
+};
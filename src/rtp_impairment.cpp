@@ -0,0 +1,224 @@
+#include "rtp_impairment.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <utility>
+
+namespace {
+bool parse_numbers(const std::string &value, std::vector<double> &out)
+{
+    out.clear();
+    std::stringstream in(value);
+    std::string field;
+    while (std::getline(in, field, ':')) {
+        char *end = nullptr;
+        const double v = std::strtod(field.c_str(), &end);
+        if (field.empty() || *end != '\0' || v < 0.0) {
+            return false;
+        }
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+double percent(double v)
+{
+    return std::min(v, 100.0) / 100.0;
+}
+} // namespace
+
+bool ImpairmentConfig::parse(const std::string &spec, ImpairmentConfig &out)
+{
+    ImpairmentConfig config;
+    std::stringstream in(spec);
+    std::string item;
+    std::vector<double> v;
+    while (std::getline(in, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        const auto eq = item.find('=');
+        if (eq == std::string::npos || !parse_numbers(item.substr(eq + 1), v)) {
+            return false;
+        }
+        const std::string key = item.substr(0, eq);
+        if (key == "seed") {
+            config.seed = static_cast<uint32_t>(v[0]);
+        } else if (key == "loss") {
+            config.loss = percent(v[0]);
+        } else if (key == "ge" && (v.size() == 2 || v.size() == 4)) {
+            config.ge_p = percent(v[0]);
+            config.ge_r = percent(v[1]);
+            if (v.size() == 4) {
+                config.ge_loss_good = percent(v[2]);
+                config.ge_loss_bad = percent(v[3]);
+            }
+        } else if (key == "delay") {
+            config.delay_us = static_cast<uint32_t>(v[0]);
+        } else if (key == "jitter") {
+            config.jitter_us = static_cast<uint32_t>(v[0]);
+        } else if (key == "reorder" && v.size() <= 2) {
+            config.reorder = percent(v[0]);
+            if (v.size() == 2) {
+                config.reorder_us = static_cast<uint32_t>(v[1]);
+            }
+        } else if (key == "dup") {
+            config.duplicate = percent(v[0]);
+        } else if (key == "rate" && v.size() <= 2) {
+            config.rate_kbps = static_cast<uint32_t>(v[0]);
+            if (v.size() == 2) {
+                config.queue_ms = static_cast<uint32_t>(v[1]);
+            }
+        } else {
+            return false;
+        }
+    }
+    out = config;
+    return true;
+}
+
+std::string ImpairmentConfig::describe() const
+{
+    std::ostringstream s;
+    char buf[96];
+    if (loss > 0.0) {
+        std::snprintf(buf, sizeof(buf), " loss %.2f%%", loss * 100.0);
+        s << buf;
+    }
+    if (ge_p > 0.0) {
+        std::snprintf(buf, sizeof(buf), " gilbert-elliott p %.2f%% r %.2f%% loss %.0f%%/%.0f%%", ge_p * 100.0,
+                      ge_r * 100.0, ge_loss_good * 100.0, ge_loss_bad * 100.0);
+        s << buf;
+    }
+    if (delay_us) {
+        s << " delay " << delay_us << " us";
+    }
+    if (jitter_us) {
+        s << " jitter " << jitter_us << " us";
+    }
+    if (reorder > 0.0) {
+        std::snprintf(buf, sizeof(buf), " reorder %.2f%% by %u us", reorder * 100.0, reorder_us);
+        s << buf;
+    }
+    if (duplicate > 0.0) {
+        std::snprintf(buf, sizeof(buf), " duplicate %.2f%%", duplicate * 100.0);
+        s << buf;
+    }
+    if (rate_kbps) {
+        s << " rate " << rate_kbps << " kbit/s (" << queue_ms << " ms queue)";
+    }
+    s << " seed " << seed;
+    return s.str().substr(1);
+}
+
+RtpImpairment::RtpImpairment(const ImpairmentConfig &config, Output out)
+    : config_(config), out_(std::move(out)), rng_(config.seed)
+{
+}
+
+// mt19937's output sequence is fixed by the standard (the distributions are not), so
+// this keeps a seed meaning the same thing on every toolchain.
+double RtpImpairment::uniform()
+{
+    return static_cast<double>(rng_()) / 4294967296.0;
+}
+
+bool RtpImpairment::lose()
+{
+    bool lost = false;
+    if (config_.ge_p > 0.0) {
+        if (ge_bad_) {
+            if (uniform() < config_.ge_r) {
+                ge_bad_ = false;
+            }
+        } else if (uniform() < config_.ge_p) {
+            ge_bad_ = true;
+        }
+        lost = uniform() < (ge_bad_ ? config_.ge_loss_bad : config_.ge_loss_good);
+    }
+    if (!lost && config_.loss > 0.0) {
+        lost = uniform() < config_.loss;
+    }
+    return lost;
+}
+
+void RtpImpairment::push(const uint8_t *packet, size_t size, uint64_t rx_ns, uint64_t now_us)
+{
+    ++stats_.packets;
+    if (lose()) {
+        ++stats_.lost;
+        return;
+    }
+    uint64_t release = now_us + config_.delay_us;
+    if (config_.rate_kbps) {
+        // Serialization through the bottleneck: whatever is still queued goes first.
+        const uint64_t start = std::max(now_us, bottleneck_free_us_);
+        if (start - now_us > static_cast<uint64_t>(config_.queue_ms) * 1000) {
+            ++stats_.rate_dropped;
+            return;
+        }
+        bottleneck_free_us_ = start + static_cast<uint64_t>(size) * 8000 / config_.rate_kbps;
+        release += bottleneck_free_us_ - now_us;
+    }
+    if (config_.jitter_us) {
+        release += static_cast<uint64_t>(uniform() * config_.jitter_us);
+    }
+    // Jitter alone never reorders: nothing leaves before the packet ahead of it.
+    release = std::max(release, last_release_us_);
+    last_release_us_ = release;
+    if (config_.reorder > 0.0 && uniform() < config_.reorder) {
+        release += config_.reorder_us;
+        ++stats_.reordered;
+    }
+    const bool duplicate = config_.duplicate > 0.0 && uniform() < config_.duplicate;
+
+    schedule(packet, size, rx_ns, now_us, release - now_us);
+    if (duplicate) {
+        ++stats_.duplicated;
+        schedule(packet, size, rx_ns, now_us, release - now_us);
+    }
+}
+
+void RtpImpairment::schedule(const uint8_t *packet, size_t size, uint64_t rx_ns, uint64_t now_us, uint64_t delay_us)
+{
+    if (delay_us == 0) {
+        out_(packet, size, rx_ns);
+        return;
+    }
+    held_.emplace(now_us + delay_us, Held{std::vector<uint8_t>(packet, packet + size), rx_ns, delay_us});
+    stats_.held_max = std::max<uint64_t>(stats_.held_max, held_.size());
+}
+
+void RtpImpairment::poll(uint64_t now_us)
+{
+    while (!held_.empty() && held_.begin()->first <= now_us) {
+        auto node = held_.extract(held_.begin());
+        Held &pkt = node.mapped();
+        stats_.delay_us_sum += pkt.delay_us;
+        stats_.delay_us_max = std::max(stats_.delay_us_max, pkt.delay_us);
+        // As if the kernel had only seen it now.
+        out_(pkt.data.data(), pkt.data.size(), pkt.rx_ns ? pkt.rx_ns + pkt.delay_us * 1000 : 0);
+    }
+}
+
+int RtpImpairment::timeout_ms(uint64_t now_us, int cap_ms) const
+{
+    if (held_.empty()) {
+        return cap_ms;
+    }
+    const uint64_t due = held_.begin()->first;
+    if (due <= now_us) {
+        return 0;
+    }
+    return static_cast<int>(std::min<uint64_t>(static_cast<uint64_t>(cap_ms), (due - now_us + 999) / 1000));
+}
+
+RtpImpairment::Stats RtpImpairment::take_stats()
+{
+    Stats out = stats_;
+    stats_ = Stats{};
+    stats_.held_max = held_.size();
+    return out;
+}
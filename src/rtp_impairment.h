@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// What RtpImpairment does to the ingest stream. Probabilities are 0..1, times in us.
+struct ImpairmentConfig {
+    uint32_t seed = 1;
+    double loss = 0.0;            // Bernoulli, independent per packet
+    // Gilbert-Elliott: two-state Markov chain stepped once per packet, each state with
+    // its own loss probability. Mean burst length is 1 / ge_r.
+    double ge_p = 0.0;            // good -> bad
+    double ge_r = 0.0;            // bad -> good
+    double ge_loss_good = 0.0;
+    double ge_loss_bad = 1.0;
+    uint32_t delay_us = 0;        // fixed extra delay
+    uint32_t jitter_us = 0;       // uniform 0..jitter_us on top; order is kept
+    double reorder = 0.0;         // packets held back by reorder_us, landing behind later ones
+    uint32_t reorder_us = 10000;
+    double duplicate = 0.0;
+    uint32_t rate_kbps = 0;       // bottleneck rate, 0 = unlimited
+    uint32_t queue_ms = 50;       // bottleneck queue; tail drop beyond it
+
+    bool enabled() const
+    {
+        return loss > 0.0 || ge_p > 0.0 || delay_us || jitter_us || reorder > 0.0 || duplicate > 0.0 ||
+               rate_kbps;
+    }
+    bool delays() const { return delay_us || jitter_us || reorder > 0.0 || rate_kbps; }
+
+    // "loss=2,ge=1:30[:0:100],delay=5000,jitter=3000,reorder=1[:10000],dup=0.5,rate=8000[:50],seed=7"
+    // -- probabilities in percent, times in us, rate in kbit/s (queue in ms). False on
+    // anything it does not understand.
+    static bool parse(const std::string &spec, ImpairmentConfig &out);
+    std::string describe() const;
+};
+
+// Network impairment between socket receive and depacketization, for benchmarking the
+// reorder, FEC and loss-policy stages on the production code path without netem or
+// root. Every received datagram goes in through push(); what survives comes out of the
+// output callback, possibly later (poll()), reordered or twice, with its receive time
+// moved by the delay it was given. A fixed seed makes runs repeatable. Not thread-safe.
+class RtpImpairment {
+public:
+    using Output = std::function<void(const uint8_t *packet, size_t size, uint64_t rx_ns)>;
+
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t lost = 0;          // Bernoulli + Gilbert-Elliott
+        uint64_t rate_dropped = 0;  // bottleneck queue full
+        uint64_t reordered = 0;
+        uint64_t duplicated = 0;
+        uint64_t delay_us_sum = 0;  // over delivered packets
+        uint64_t delay_us_max = 0;
+        uint64_t held_max = 0;
+    };
+
+    RtpImpairment(const ImpairmentConfig &config, Output out);
+
+    void push(const uint8_t *packet, size_t size, uint64_t rx_ns, uint64_t now_us);
+    // Delivers the held packets that are due.
+    void poll(uint64_t now_us);
+    // How long the reader may block before the next held packet is due.
+    int timeout_ms(uint64_t now_us, int cap_ms) const;
+
+    Stats take_stats();
+
+private:
+    struct Held {
+        std::vector<uint8_t> data;
+        uint64_t rx_ns;
+        uint64_t delay_us;
+    };
+
+    double uniform();
+    bool lose();
+    void schedule(const uint8_t *packet, size_t size, uint64_t rx_ns, uint64_t now_us, uint64_t delay_us);
+
+    ImpairmentConfig config_;
+    Output out_;
+    std::mt19937 rng_;
+    bool ge_bad_{false};
+    uint64_t bottleneck_free_us_{0};
+    uint64_t last_release_us_{0};
+    std::multimap<uint64_t, Held> held_; // by release time; equal times keep push order
+    Stats stats_;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Puts RTP packets back into sequence order with a bounded hold time.
+//
+// Packets that arrive in order while nothing is held take the pass_through() fast path and
+// never get copied or stored. Once a gap opens, later packets are parked until the gap
+// fills (everything contiguous is released immediately) or until `window_us` has passed
+// since the first parked packet arrived; then the missing sequence numbers are counted as
+// lost and skipped. Packets behind the release point are "late" and rejected.
+//
+// `Packet` is any movable handle (owned bytes, a GstBuffer wrapper, ...). Not thread-safe.
+template <typename Packet>
+class RtpReorderBuffer {
+public:
+    using Output = std::function<void(Packet &&pkt)>;
+
+    struct Stats {
+        uint64_t reordered = 0; // released from the buffer after their gap filled
+        uint64_t late = 0;      // arrived after their slot was released or given up
+        uint64_t lost = 0;      // sequence numbers skipped when a gap expired
+        uint32_t held_max = 0;
+    };
+
+    static constexpr uint16_t kSlots = 512;
+
+    RtpReorderBuffer(uint32_t window_us, Output out)
+        : window_us_(window_us), out_(std::move(out)), slots_(kSlots) {}
+
+    uint32_t window_us() const { return window_us_; }
+
+    // True when `seq` is the next packet and nothing is held; the caller then delivers
+    // the packet itself and must not push() it.
+    bool pass_through(uint16_t seq)
+    {
+        const auto ahead = static_cast<int16_t>(seq - expected_);
+        if (!started_ || (held_ == 0 && (ahead >= static_cast<int>(kSlots) || ahead < -static_cast<int>(kSlots)))) {
+            // First packet, or the sender restarted its sequence.
+            started_ = true;
+            expected_ = seq;
+        }
+        if (held_ != 0 || seq != expected_) {
+            return false;
+        }
+        ++expected_;
+        return true;
+    }
+
+    // Takes ownership of an out-of-order packet. Returns false (packet untouched) when it
+    // is late or a duplicate; the caller drops it.
+    bool push(uint16_t seq, Packet &&pkt, uint64_t now_us)
+    {
+        const auto ahead = static_cast<int16_t>(seq - expected_);
+        if (ahead < 0) {
+            ++stats_.late;
+            return false;
+        }
+        if (ahead >= static_cast<int>(kSlots)) {
+            // Sender restarted or a huge burst was lost: release what we have and resync.
+            skip_to(static_cast<uint16_t>(seq - kSlots + 1));
+        }
+        Slot &slot = slots_[seq % kSlots];
+        if (slot.pkt) {
+            ++stats_.late;
+            return false;
+        }
+        slot.pkt.emplace(std::move(pkt));
+        slot.arrival_us = now_us;
+        if (held_++ == 0) {
+            deadline_us_ = now_us + window_us_;
+        }
+        if (held_ > stats_.held_max) {
+            stats_.held_max = static_cast<uint32_t>(held_);
+        }
+        if (seq == expected_) {
+            release_contiguous(true);
+        }
+        return true;
+    }
+
+    // Gives up on the oldest gap once its deadline has passed.
+    void poll(uint64_t now_us)
+    {
+        while (held_ != 0 && now_us >= deadline_us_) {
+            while (!slots_[expected_ % kSlots].pkt) {
+                ++stats_.lost;
+                ++expected_;
+            }
+            release_contiguous(false);
+        }
+    }
+
+    // How long a reader may sleep before poll() has work to do, capped at `cap_ms`.
+    int timeout_ms(uint64_t now_us, int cap_ms) const
+    {
+        if (held_ == 0) {
+            return cap_ms;
+        }
+        if (deadline_us_ <= now_us) {
+            return 0;
+        }
+        const uint64_t ms = (deadline_us_ - now_us + 999) / 1000;
+        return ms < static_cast<uint64_t>(cap_ms) ? static_cast<int>(ms) : cap_ms;
+    }
+
+    size_t held() const { return held_; }
+
+    // Releases everything still held, in order, e.g. before a teardown.
+    void drain()
+    {
+        while (held_ != 0) {
+            poll(deadline_us_);
+        }
+    }
+
+    Stats take_stats()
+    {
+        Stats out = stats_;
+        stats_ = Stats{};
+        return out;
+    }
+
+private:
+    struct Slot {
+        std::optional<Packet> pkt;
+        uint64_t arrival_us = 0;
+    };
+
+    void release_contiguous(bool gap_filled)
+    {
+        while (held_ != 0) {
+            Slot &slot = slots_[expected_ % kSlots];
+            if (!slot.pkt) {
+                break;
+            }
+            Packet pkt = std::move(*slot.pkt);
+            slot.pkt.reset();
+            --held_;
+            ++expected_;
+            if (gap_filled) {
+                ++stats_.reordered;
+            }
+            out_(std::move(pkt));
+        }
+        if (held_ != 0) {
+            // The next gap is timed from the first packet parked behind it.
+            for (uint16_t seq = expected_;; ++seq) {
+                const Slot &slot = slots_[seq % kSlots];
+                if (slot.pkt) {
+                    deadline_us_ = slot.arrival_us + window_us_;
+                    break;
+                }
+            }
+        }
+    }
+
+    void skip_to(uint16_t seq)
+    {
+        while (held_ != 0 && static_cast<int16_t>(seq - expected_) > 0) {
+            Slot &slot = slots_[expected_ % kSlots];
+            if (slot.pkt) {
+                Packet pkt = std::move(*slot.pkt);
+                slot.pkt.reset();
+                --held_;
+                out_(std::move(pkt));
+            } else {
+                ++stats_.lost;
+            }
+            ++expected_;
+        }
+        expected_ = seq;
+        release_contiguous(false);
+    }
+
+    uint32_t window_us_;
+    Output out_;
+    std::vector<Slot> slots_;
+    bool started_ = false;
+    uint16_t expected_ = 0;
+    size_t held_ = 0;
+    uint64_t deadline_us_ = 0;
+    Stats stats_;
+};
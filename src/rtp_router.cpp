@@ -0,0 +1,285 @@
+#include "rtp_router.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udp_target.h"
+
+RtpRouter::RtpRouter() : current_(std::make_unique<Table>())
+{
+    table_.store(current_.get());
+}
+
+RtpRouter::~RtpRouter()
+{
+    for (const auto &target : forward_fds_) {
+        close(target.second);
+    }
+}
+
+void RtpRouter::build_ssrc_slots(Table &table)
+{
+    table.by_ssrc.fill(SsrcSlot{});
+    for (const auto &entry : table.ssrc_list) {
+        size_t i = ssrc_slot(entry.first);
+        while (table.by_ssrc[i].used) {
+            i = (i + 1) % kSsrcSlots;
+        }
+        table.by_ssrc[i] = SsrcSlot{true, entry.first, entry.second};
+    }
+    table.ssrc_routes = table.ssrc_list.size();
+}
+
+int RtpRouter::forward_fd(const std::string &destination, std::string &error)
+{
+    for (const auto &target : forward_fds_) {
+        if (target.first == destination) {
+            return target.second;
+        }
+    }
+    const int fd = connect_udp_target(destination, "RTP forward");
+    if (fd < 0) {
+        error = "cannot forward to " + destination;
+        return -1;
+    }
+    forward_fds_.emplace_back(destination, fd);
+    return fd;
+}
+
+void RtpRouter::close_unused_forward_fds()
+{
+    const auto used = [](const Table *table, int fd) {
+        return table && std::find(table->forward_fds.begin(), table->forward_fds.begin() + table->forward_count, fd) !=
+                            table->forward_fds.begin() + table->forward_count;
+    };
+    auto it = forward_fds_.begin();
+    while (it != forward_fds_.end()) {
+        if (used(current_.get(), it->second)) {
+            ++it;
+            continue;
+        }
+        close(it->second);
+        it = forward_fds_.erase(it);
+    }
+}
+
+void RtpRouter::wait_for_readers()
+{
+    // A reader may have picked its counter from an epoch read before the last flip, so
+    // one flip is not enough: flip twice and drain both counters. Sections last one
+    // packet, the wait is microseconds.
+    for (int i = 0; i < 2; ++i) {
+        const uint32_t old = epoch_.fetch_add(1) & 1;
+        while (readers_[old].load() != 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+}
+
+bool RtpRouter::apply(const std::string &spec, std::string &error)
+{
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    auto table = std::make_unique<Table>(*current_);
+    if (build(spec, *table, error)) {
+        table_.store(table.get());
+        wait_for_readers();
+        current_ = std::move(table);
+        close_unused_forward_fds();
+        return true;
+    }
+    // Sockets opened for a spec that was rejected.
+    close_unused_forward_fds();
+    return false;
+}
+
+bool RtpRouter::build(const std::string &spec, Table &table, std::string &error)
+{
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        const auto eq = item.find('=');
+        if (eq == std::string::npos) {
+            error = "'" + item + "' is not key=handler";
+            return false;
+        }
+        const std::string key = item.substr(0, eq);
+        const std::string handler = item.substr(eq + 1);
+
+        bool by_ssrc = false;
+        uint32_t ssrc = 0;
+        long pt = -1;
+        char *end = nullptr;
+        if (key.compare(0, 5, "ssrc:") == 0) {
+            by_ssrc = true;
+            ssrc = static_cast<uint32_t>(std::strtoul(key.c_str() + 5, &end, 0));
+        } else {
+            pt = std::strtol(key.c_str(), &end, 10);
+        }
+        if (key.empty() || !end || *end != '\0' || (!by_ssrc && (pt < 0 || pt > 127))) {
+            error = "bad key '" + key + "' (payload type 0..127 or ssrc:<n>)";
+            return false;
+        }
+
+        Decision decision{RtpRoute::DROP, 0};
+        bool remove = false;
+        if (handler == "video") {
+            decision.route = RtpRoute::VIDEO;
+        } else if (handler == "audio") {
+            decision.route = RtpRoute::AUDIO;
+        } else if (handler == "telemetry") {
+            decision.route = RtpRoute::TELEMETRY;
+        } else if (handler == "drop") {
+            decision.route = RtpRoute::DROP;
+        } else if (handler == "default") {
+            remove = true;
+        } else if (handler.compare(0, 4, "fwd:") == 0) {
+            const int fd = forward_fd(handler.substr(4), error);
+            if (fd < 0) {
+                return false;
+            }
+            size_t index = 0;
+            while (index < table.forward_count && table.forward_fds[index] != fd) {
+                ++index;
+            }
+            if (index == table.forward_count) {
+                if (index == kMaxForwardTargets) {
+                    error = "too many forward targets";
+                    return false;
+                }
+                table.forward_fds[index] = fd;
+                table.forward_names[index] = handler.substr(4);
+                ++table.forward_count;
+            }
+            decision = Decision{RtpRoute::FORWARD, static_cast<uint8_t>(index), fd};
+        } else {
+            error = "unknown handler '" + handler + "' (video, audio, telemetry, drop, fwd:<host:port>, default)";
+            return false;
+        }
+
+        if (!by_ssrc && reserved_pt_ != 0 && pt == reserved_pt_ && !remove && decision.route != RtpRoute::DROP) {
+            error = "payload type " + std::to_string(pt) + " is reserved (FEC parity)";
+            return false;
+        }
+        if (!by_ssrc) {
+            table.by_pt[static_cast<size_t>(pt)] = remove ? Decision{RtpRoute::DROP, 0} : decision;
+            continue;
+        }
+        auto &list = table.ssrc_list;
+        list.erase(std::remove_if(list.begin(), list.end(), [ssrc](const auto &e) { return e.first == ssrc; }),
+                   list.end());
+        if (!remove) {
+            if (list.size() == kMaxSsrcRoutes) {
+                error = "too many ssrc routes";
+                return false;
+            }
+            list.emplace_back(ssrc, decision);
+        }
+    }
+
+    // Forward targets no route uses any more drop out, so their sockets can be closed.
+    std::array<int, kMaxForwardTargets> remap;
+    remap.fill(-1);
+    Table compact;
+    const auto keep = [&](Decision &d) {
+        if (d.route != RtpRoute::FORWARD) {
+            return;
+        }
+        if (remap[d.target] < 0) {
+            remap[d.target] = static_cast<int>(compact.forward_count);
+            compact.forward_fds[compact.forward_count] = table.forward_fds[d.target];
+            compact.forward_names[compact.forward_count] = table.forward_names[d.target];
+            ++compact.forward_count;
+        }
+        d.target = static_cast<uint8_t>(remap[d.target]);
+    };
+    for (auto &decision : table.by_pt) {
+        keep(decision);
+    }
+    for (auto &entry : table.ssrc_list) {
+        keep(entry.second);
+    }
+    table.forward_fds = compact.forward_fds;
+    table.forward_names = std::move(compact.forward_names);
+    table.forward_count = compact.forward_count;
+
+    build_ssrc_slots(table);
+    return true;
+}
+
+bool RtpRouter::deliver(Decision decision, const uint8_t *packet, size_t size) const
+{
+    if (decision.route == RtpRoute::FORWARD) {
+        // The fd travels in the decision: the table may have been swapped since route(),
+        // the ReadSection keeps the socket open until this returns.
+        if (decision.fd >= 0) {
+            send(decision.fd, packet, size, MSG_DONTWAIT);
+        }
+        return true;
+    }
+    if (decision.route != RtpRoute::TELEMETRY) {
+        return false;
+    }
+    size_t offset = 0, length = 0;
+    if (telemetry_cb_ && rtp_payload(packet, size, offset, length)) {
+        const uint32_t ssrc = static_cast<uint32_t>(packet[8]) << 24 | static_cast<uint32_t>(packet[9]) << 16 |
+                              static_cast<uint32_t>(packet[10]) << 8 | packet[11];
+        telemetry_cb_(static_cast<uint8_t>(packet[1] & 0x7f), ssrc, packet + offset, length);
+    }
+    return true;
+}
+
+std::vector<uint8_t> RtpRouter::payload_types() const
+{
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    const Table *table = current_.get();
+    std::vector<uint8_t> pts;
+    for (size_t pt = 0; pt < table->by_pt.size(); ++pt) {
+        if (table->by_pt[pt].route != RtpRoute::DROP) {
+            pts.push_back(static_cast<uint8_t>(pt));
+        }
+    }
+    return pts;
+}
+
+const char *RtpRouter::route_name(RtpRoute route)
+{
+    switch (route) {
+    case RtpRoute::VIDEO:
+        return "video";
+    case RtpRoute::AUDIO:
+        return "audio";
+    case RtpRoute::TELEMETRY:
+        return "telemetry";
+    case RtpRoute::FORWARD:
+        return "fwd";
+    default:
+        return "drop";
+    }
+}
+
+std::string RtpRouter::describe() const
+{
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    const Table *table = current_.get();
+    std::ostringstream s;
+    const auto name = [table](Decision d) {
+        return d.route == RtpRoute::FORWARD ? "fwd:" + table->forward_names[d.target] : std::string(route_name(d.route));
+    };
+    for (const auto &entry : table->ssrc_list) {
+        s << ",ssrc:0x" << std::hex << entry.first << std::dec << "=" << name(entry.second);
+    }
+    for (size_t pt = 0; pt < table->by_pt.size(); ++pt) {
+        if (table->by_pt[pt].route != RtpRoute::DROP) {
+            s << "," << pt << "=" << name(table->by_pt[pt]);
+        }
+    }
+    const std::string out = s.str();
+    return out.empty() ? "everything dropped" : out.substr(1);
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Payload of an RTP packet: skips CSRCs and the header extension, drops padding. False for
+// anything that is not RTP version 2 or is cut short.
+inline bool rtp_payload(const uint8_t *packet, size_t size, size_t &offset, size_t &length)
+{
+    if (size < 12 || (packet[0] & 0xc0) != 0x80) {
+        return false;
+    }
+    size_t header = 12 + static_cast<size_t>(packet[0] & 0x0f) * 4;
+    if (packet[0] & 0x10) {
+        if (size < header + 4) {
+            return false;
+        }
+        header += 4 + static_cast<size_t>(packet[header + 2] << 8 | packet[header + 3]) * 4;
+    }
+    size_t end = size;
+    if (packet[0] & 0x20) {
+        end -= std::min<size_t>(packet[size - 1], size);
+    }
+    if (end <= header) {
+        return false;
+    }
+    offset = header;
+    length = end - header;
+    return true;
+}
+
+enum class RtpRoute : uint8_t {
+    DROP = 0,
+    VIDEO,     // depayloader (appsrc or RtpDepacketizer)
+    AUDIO,     // payload to the audio callback
+    TELEMETRY, // payload to the telemetry callback
+    FORWARD    // whole packet, unchanged, to a UDP target
+};
+
+// Which handler each incoming RTP packet goes to, looked up by SSRC first, then by payload
+// type: one table load and one array index (plus a short hash probe when SSRC routes
+// exist) per packet. The table is immutable once published; apply() builds a new one and
+// swaps it in atomically, so routes change while the readers run. Readers route() and
+// deliver() a packet inside a ReadSection; after the swap apply() waits until every
+// section that may have seen the old table has ended, then frees it and closes the
+// forward sockets the new one does not use.
+class RtpRouter {
+public:
+    // Two counters by epoch, as in SRCU: entering costs one atomic add on the counter of
+    // the current epoch, and apply() flips the epoch and waits for the other to drain.
+    class ReadSection {
+    public:
+        explicit ReadSection(const RtpRouter &router)
+            : readers_(router.readers_[router.epoch_.load() & 1])
+        {
+            readers_.fetch_add(1);
+        }
+        ~ReadSection() { readers_.fetch_sub(1); }
+        ReadSection(const ReadSection &) = delete;
+        ReadSection &operator=(const ReadSection &) = delete;
+
+    private:
+        std::atomic<uint32_t> &readers_;
+    };
+
+    struct Decision {
+        RtpRoute route;
+        uint8_t target; // FORWARD: index into the table's forward targets
+        int fd = -1;    // FORWARD: that target's socket, so delivery needs no second table load
+    };
+    using TelemetryCallback = std::function<void(uint8_t pt, uint32_t ssrc, const uint8_t *payload, size_t size)>;
+
+    static constexpr size_t kMaxForwardTargets = 16;
+    static constexpr size_t kMaxSsrcRoutes = 32;
+
+    RtpRouter();
+    ~RtpRouter();
+    RtpRouter(const RtpRouter &) = delete;
+    RtpRouter &operator=(const RtpRouter &) = delete;
+
+    // Comma separated "<key>=<handler>" on top of the current table. key: payload type
+    // 0..127 or ssrc:<n> (decimal or 0x hex); handler: video, audio, telemetry, drop,
+    // fwd:<host:port> or default (ssrc keys: remove, fall back to the payload type). All
+    // or nothing: false with `error` set leaves the table as it was.
+    bool apply(const std::string &spec, std::string &error);
+    // Payload type apply() refuses to route anywhere but drop, for a stage that takes its
+    // packets before routing (FEC parity); 0 = none.
+    void reserve_payload_type(uint8_t pt)
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        reserved_pt_ = pt & 0x7f;
+    }
+    // Before the readers start.
+    void set_telemetry_callback(TelemetryCallback cb) { telemetry_cb_ = std::move(cb); }
+
+    // route() and deliver() of one packet run inside one ReadSection.
+    Decision route(const uint8_t *packet, size_t size) const
+    {
+        const Table *table = table_.load();
+        if (table->ssrc_routes && size >= 12) {
+            const uint32_t ssrc = static_cast<uint32_t>(packet[8]) << 24 | static_cast<uint32_t>(packet[9]) << 16 |
+                                  static_cast<uint32_t>(packet[10]) << 8 | packet[11];
+            for (size_t i = ssrc_slot(ssrc);; i = (i + 1) % kSsrcSlots) {
+                const SsrcSlot &slot = table->by_ssrc[i];
+                if (!slot.used) {
+                    break;
+                }
+                if (slot.ssrc == ssrc) {
+                    return slot.decision;
+                }
+            }
+        }
+        return size >= 2 ? table->by_pt[packet[1] & 0x7f] : Decision{RtpRoute::DROP, 0};
+    }
+    // TELEMETRY and FORWARD; false for the routes the caller handles (VIDEO, AUDIO) and DROP.
+    bool deliver(Decision decision, const uint8_t *packet, size_t size) const;
+
+    // Control side: read the current table under the update lock, outside any ReadSection.
+    // Payload types any route can match, for the kernel socket filter; with SSRC routes
+    // the payload type alone does not decide, see has_ssrc_routes().
+    std::vector<uint8_t> payload_types() const;
+    RtpRoute pt_route(uint8_t pt) const
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        return current_->by_pt[pt & 0x7f].route;
+    }
+    bool has_ssrc_routes() const
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        return current_->ssrc_routes != 0;
+    }
+    std::string describe() const;
+
+    static const char *route_name(RtpRoute route);
+
+private:
+    static constexpr size_t kSsrcSlots = 2 * kMaxSsrcRoutes;
+
+    struct SsrcSlot {
+        bool used = false;
+        uint32_t ssrc = 0;
+        Decision decision{RtpRoute::DROP, 0};
+    };
+    struct Table {
+        std::array<Decision, 128> by_pt{};
+        std::array<SsrcSlot, kSsrcSlots> by_ssrc{};
+        size_t ssrc_routes = 0;
+        std::vector<std::pair<uint32_t, Decision>> ssrc_list; // what by_ssrc is built from
+        std::array<int, kMaxForwardTargets> forward_fds{};
+        std::array<std::string, kMaxForwardTargets> forward_names;
+        size_t forward_count = 0;
+    };
+
+    static size_t ssrc_slot(uint32_t ssrc) { return (ssrc * 0x9e3779b1u) >> 26; }
+    static void build_ssrc_slots(Table &table);
+    bool build(const std::string &spec, Table &table, std::string &error);
+    int forward_fd(const std::string &destination, std::string &error);
+    void close_unused_forward_fds();
+    void wait_for_readers();
+
+    std::atomic<const Table *> table_;
+    std::atomic<uint32_t> epoch_{0};
+    mutable std::array<std::atomic<uint32_t>, 2> readers_{};
+    mutable std::mutex update_mutex_;
+    std::unique_ptr<Table> current_; // what table_ points to
+    uint8_t reserved_pt_{0};
+    std::vector<std::pair<std::string, int>> forward_fds_; // owned, by destination
+    TelemetryCallback telemetry_cb_;
+};
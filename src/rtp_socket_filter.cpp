@@ -0,0 +1,260 @@
+#include "rtp_socket_filter.h"
+#include "spdlog/spdlog.h"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SO_ATTACH_BPF
+#define SO_ATTACH_BPF 50
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+#ifndef BPF_XADD
+#define BPF_XADD 0xc0
+#endif
+
+namespace {
+// A UDP socket filter sees the UDP header at offset 0; the reuseport program sees the payload.
+constexpr uint32_t kUdpHeader = 8;
+constexpr uint32_t kRtpHeader = 12;
+
+// Verdict slots in the eBPF counter map.
+enum Verdict : int32_t { kAccepted = 0, kShort, kBadVersion, kUnknownPt, kVerdictCount };
+
+long sys_bpf(int cmd, bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+{
+    bpf_insn i{};
+    i.code = code;
+    i.dst_reg = dst;
+    i.src_reg = src;
+    i.off = off;
+    i.imm = imm;
+    return i;
+}
+
+uint64_t socket_drops(int fd)
+{
+    uint32_t meminfo[SK_MEMINFO_VARS] = {};
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) != 0 || len <= SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+        return 0;
+    }
+    return meminfo[SK_MEMINFO_DROPS];
+}
+} // namespace
+
+RtpSocketFilter::~RtpSocketFilter()
+{
+    if (map_fd_ >= 0) {
+        close(map_fd_);
+    }
+}
+
+bool RtpSocketFilter::attach(int sock_fd, const std::vector<uint8_t> &payload_types)
+{
+    // A new filter replaces the socket's previous one, and with it the old counters.
+    if (map_fd_ >= 0) {
+        close(map_fd_);
+        map_fd_ = -1;
+    }
+    sock_fd_ = sock_fd;
+    if (attach_ebpf(payload_types)) {
+        spdlog::info("RTP socket filter (eBPF) attached, {} payload types", payload_types.size());
+        return true;
+    }
+    if (attach_classic(payload_types)) {
+        spdlog::info("RTP socket filter (classic BPF) attached, {} payload types", payload_types.size());
+        return true;
+    }
+    sock_fd_ = -1;
+    return false;
+}
+
+bool RtpSocketFilter::attach_ebpf(const std::vector<uint8_t> &payload_types)
+{
+    bpf_attr map_attr{};
+    map_attr.map_type = BPF_MAP_TYPE_ARRAY;
+    map_attr.key_size = sizeof(uint32_t);
+    map_attr.value_size = sizeof(uint64_t);
+    map_attr.max_entries = kVerdictCount;
+    const int map_fd = static_cast<int>(sys_bpf(BPF_MAP_CREATE, &map_attr));
+    if (map_fd < 0) {
+        spdlog::debug("BPF_MAP_CREATE failed: {}", strerror(errno));
+        return false;
+    }
+
+    // r6 = ctx (needed by LD_ABS), r7 = skb->len, r8 = verdict.
+    std::vector<bpf_insn> prog;
+    std::vector<size_t> to_count;
+    std::vector<size_t> to_accept;
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));
+    prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_7, BPF_REG_6, offsetof(__sk_buff, len), 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_8, 0, 0, kShort));
+    prog.push_back(insn(BPF_JMP | BPF_JGE | BPF_K, BPF_REG_7, 0, 1, kUdpHeader + kRtpHeader + 1));
+    to_count.push_back(prog.size());
+    prog.push_back(insn(BPF_JMP | BPF_JA, 0, 0, 0, 0));
+    prog.push_back(insn(BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, kUdpHeader));
+    prog.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0xc0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_8, 0, 0, kBadVersion));
+    to_count.push_back(prog.size());
+    prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 0, 0x80));
+    prog.push_back(insn(BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, kUdpHeader + 1));
+    prog.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0x7f));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_8, 0, 0, kUnknownPt));
+    for (uint8_t pt : payload_types) {
+        to_accept.push_back(prog.size());
+        prog.push_back(insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, pt));
+    }
+    to_count.push_back(prog.size());
+    prog.push_back(insn(BPF_JMP | BPF_JA, 0, 0, 0, 0));
+    const size_t accept = prog.size();
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_8, 0, 0, kAccepted));
+    const size_t count = prog.size();
+    // counters[r8] += 1
+    prog.push_back(insn(BPF_STX | BPF_W | BPF_MEM, BPF_REG_10, BPF_REG_8, -4, 0));
+    prog.push_back(insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd));
+    prog.push_back(insn(0, 0, 0, 0, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -4));
+    prog.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem));
+    prog.push_back(insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 2, 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_1, 0, 0, 1));
+    prog.push_back(insn(BPF_STX | BPF_DW | BPF_XADD, BPF_REG_0, BPF_REG_1, 0, 0));
+    // return verdict == accepted ? skb->len : 0
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0));
+    prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_8, 0, 1, kAccepted));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_0, BPF_REG_7, 0, 0));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    for (size_t at : to_count) {
+        prog[at].off = static_cast<int16_t>(count - at - 1);
+    }
+    for (size_t at : to_accept) {
+        prog[at].off = static_cast<int16_t>(accept - at - 1);
+    }
+
+    static const char kLicense[] = "GPL";
+    char log[4096] = {};
+    bpf_attr prog_attr{};
+    prog_attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    prog_attr.insns = reinterpret_cast<uint64_t>(prog.data());
+    prog_attr.insn_cnt = static_cast<uint32_t>(prog.size());
+    prog_attr.license = reinterpret_cast<uint64_t>(kLicense);
+    prog_attr.log_buf = reinterpret_cast<uint64_t>(log);
+    prog_attr.log_size = sizeof(log);
+    prog_attr.log_level = 1;
+    const int prog_fd = static_cast<int>(sys_bpf(BPF_PROG_LOAD, &prog_attr));
+    if (prog_fd < 0) {
+        spdlog::debug("BPF_PROG_LOAD failed: {} {}", strerror(errno), log);
+        close(map_fd);
+        return false;
+    }
+
+    const int ret = setsockopt(sock_fd_, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd));
+    // The socket keeps its own reference on the program.
+    close(prog_fd);
+    if (ret < 0) {
+        spdlog::debug("SO_ATTACH_BPF failed: {}", strerror(errno));
+        close(map_fd);
+        return false;
+    }
+    map_fd_ = map_fd;
+    return true;
+}
+
+bool RtpSocketFilter::attach_classic(const std::vector<uint8_t> &payload_types)
+{
+    const auto n_pt = static_cast<uint8_t>(payload_types.size());
+    std::vector<sock_filter> code;
+    // len >= UDP + RTP header + 1, else drop
+    code.push_back({BPF_LD | BPF_W | BPF_LEN, 0, 0, 0});
+    code.push_back({BPF_JMP | BPF_JGE | BPF_K, 0, 0, kUdpHeader + kRtpHeader + 1});
+    // version == 2, else drop
+    code.push_back({BPF_LD | BPF_B | BPF_ABS, 0, 0, kUdpHeader});
+    code.push_back({BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xc0});
+    code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 0x80});
+    // payload type in the list, else drop
+    code.push_back({BPF_LD | BPF_B | BPF_ABS, 0, 0, kUdpHeader + 1});
+    code.push_back({BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x7f});
+    for (uint8_t i = 0; i < n_pt; ++i) {
+        code.push_back({BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint8_t>(n_pt - i), 0, payload_types[i]});
+    }
+    code.push_back({BPF_RET | BPF_K, 0, 0, 0});
+    code.push_back({BPF_RET | BPF_K, 0, 0, 0x40000});
+    // Point the failure edges of the length and version checks at the drop.
+    const size_t drop = code.size() - 2;
+    code[1].jf = static_cast<uint8_t>(drop - 1 - 1);
+    code[4].jf = static_cast<uint8_t>(drop - 4 - 1);
+
+    sock_fprog prog{};
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        spdlog::warn("SO_ATTACH_FILTER failed: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+RtpSocketFilter::Counters RtpSocketFilter::counters() const
+{
+    Counters out;
+    if (sock_fd_ < 0) {
+        return out;
+    }
+    out.dropped = socket_drops(sock_fd_);
+    if (map_fd_ < 0) {
+        return out;
+    }
+
+    uint64_t values[kVerdictCount] = {};
+    for (uint32_t key = 0; key < kVerdictCount; ++key) {
+        bpf_attr attr{};
+        attr.map_fd = static_cast<uint32_t>(map_fd_);
+        attr.key = reinterpret_cast<uint64_t>(&key);
+        attr.value = reinterpret_cast<uint64_t>(&values[key]);
+        if (sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr) != 0) {
+            return out;
+        }
+    }
+    out.exact = true;
+    out.accepted = values[kAccepted];
+    out.short_packets = values[kShort];
+    out.bad_version = values[kBadVersion];
+    out.unknown_pt = values[kUnknownPt];
+    return out;
+}
+
+bool RtpSocketFilter::attach_reuseport_split(int sock_fd, uint8_t audio_pt)
+{
+    sock_filter code[] = {
+        {BPF_LD | BPF_B | BPF_ABS, 0, 0, 1},
+        {BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x7f},
+        {BPF_JMP | BPF_JEQ | BPF_K, 0, 1, audio_pt},
+        {BPF_RET | BPF_K, 0, 0, 1},
+        {BPF_RET | BPF_K, 0, 0, 0},
+    };
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        spdlog::warn("SO_ATTACH_REUSEPORT_CBPF failed: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
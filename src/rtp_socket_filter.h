@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// In-kernel RTP filtering for the UDP ingest sockets: packets that are too short, not
+// RTP version 2, or carry a payload type nobody consumes are dropped before they are
+// queued on the socket, so user space never copies them.
+//
+// attach() prefers an eBPF socket filter whose array map counts every verdict per reason;
+// when eBPF is not available (old kernel, unprivileged) it falls back to classic BPF and
+// only the socket's aggregate drop counter (SO_MEMINFO, filter + overflow) is known.
+class RtpSocketFilter {
+public:
+    struct Counters {
+        bool exact = false;          // false: only `dropped` is meaningful
+        uint64_t accepted = 0;
+        uint64_t short_packets = 0;  // <= RTP header
+        uint64_t bad_version = 0;
+        uint64_t unknown_pt = 0;
+        uint64_t dropped = 0;        // everything the kernel discarded for this socket
+    };
+
+    RtpSocketFilter() = default;
+    ~RtpSocketFilter();
+    RtpSocketFilter(const RtpSocketFilter &) = delete;
+    RtpSocketFilter &operator=(const RtpSocketFilter &) = delete;
+
+    bool attach(int sock_fd, const std::vector<uint8_t> &payload_types);
+    bool attached() const { return sock_fd_ >= 0; }
+    bool is_ebpf() const { return map_fd_ >= 0; }
+    Counters counters() const;
+
+    // For two sockets bound to the same port with SO_REUSEPORT (video first, audio second):
+    // steers `audio_pt` datagrams to the second socket and everything else to the first.
+    static bool attach_reuseport_split(int sock_fd, uint8_t audio_pt);
+
+private:
+    bool attach_ebpf(const std::vector<uint8_t> &payload_types);
+    bool attach_classic(const std::vector<uint8_t> &payload_types);
+
+    int sock_fd_{-1};
+    int map_fd_{-1};
+};
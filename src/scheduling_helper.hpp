@@ -56,6 +56,19 @@ static void set_thread_params_other(const std::string &tag, int nice_value = 5)
     }
 }
 
+static void set_thread_affinity(const std::string &tag, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        spdlog::warn("Cannot pin {} to CPU {}: {}", tag, cpu, result);
+    } else {
+        spdlog::info("Pinned {} to CPU {}", tag, cpu);
+    }
+}
+
 }  // namespace SchedulingHelper
 
 #endif //FPVUE_SCHEDULINGHELPER_H
@@ -0,0 +1,393 @@
+#include "shm_packet_ring.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct ShmPacketRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> sleeping;
+    std::atomic<uint64_t> dropped;
+};
+
+namespace {
+// Abstract socket name: sun_path starts with a null byte and is not null-terminated.
+socklen_t abstract_address(const std::string &name, sockaddr_un &addr)
+{
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    const size_t len = std::min(name.size(), sizeof(addr.sun_path) - 1);
+    std::memcpy(addr.sun_path + 1, name.data(), len);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + len);
+}
+
+void close_fd(int &fd)
+{
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+} // namespace
+
+ShmPacketRing::~ShmPacketRing()
+{
+    if (map_) {
+        munmap(map_, map_size_);
+    }
+    close_fd(mem_fd_);
+    close_fd(event_fd_);
+    close_fd(link_fd_);
+}
+
+bool ShmPacketRing::map(size_t size)
+{
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd_, 0);
+    if (map == MAP_FAILED) {
+        spdlog::error("shm ring: mmap failed: {}", strerror(errno));
+        return false;
+    }
+    map_ = static_cast<uint8_t *>(map);
+    map_size_ = size;
+    header_ = reinterpret_cast<Header *>(map_);
+    return true;
+}
+
+uint8_t *ShmPacketRing::slot(uint64_t index) const
+{
+    return map_ + kHeaderSize + static_cast<size_t>(index & (slot_count_ - 1)) * slot_size_;
+}
+
+std::unique_ptr<ShmPacketRing> ShmPacketRing::create(unsigned slot_count, unsigned max_packet)
+{
+    static_assert(offsetof(Header, head) == 64 && offsetof(Header, tail) == 128, "shared layout");
+    static_assert(offsetof(Header, sleeping) == 192 && offsetof(Header, dropped) == 200, "shared layout");
+    static_assert(sizeof(Header) == kHeaderSize, "shared layout");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomics must work across processes");
+
+    std::unique_ptr<ShmPacketRing> ring(new ShmPacketRing());
+    unsigned count = 1;
+    while (count < std::max(slot_count, 2u)) {
+        count <<= 1;
+    }
+    ring->slot_count_ = count;
+    ring->slot_size_ = static_cast<unsigned>((kSlotHeaderSize + max_packet + 7) & ~size_t{7});
+    const size_t size = kHeaderSize + static_cast<size_t>(count) * ring->slot_size_;
+
+    ring->mem_fd_ = memfd_create("amldigitalfpv-rtp-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ring->mem_fd_ < 0) {
+        spdlog::error("shm ring: memfd_create failed: {}", strerror(errno));
+        return nullptr;
+    }
+    if (ftruncate(ring->mem_fd_, static_cast<off_t>(size)) < 0) {
+        spdlog::error("shm ring: ftruncate failed: {}", strerror(errno));
+        return nullptr;
+    }
+    // A producer must not be able to shrink the file under us (SIGBUS on access).
+    fcntl(ring->mem_fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    ring->event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->event_fd_ < 0) {
+        spdlog::error("shm ring: eventfd failed: {}", strerror(errno));
+        return nullptr;
+    }
+    if (!ring->map(size)) {
+        return nullptr;
+    }
+    // Fresh memfd pages are zero: head, tail, sleeping and dropped start out at 0.
+    ring->header_->version = kVersion;
+    ring->header_->slot_size = ring->slot_size_;
+    ring->header_->slot_count = count;
+    ring->header_->magic = kMagic;
+    return ring;
+}
+
+std::unique_ptr<ShmPacketRing> ShmPacketRing::attach(int mem_fd, int event_fd, int link_fd)
+{
+    std::unique_ptr<ShmPacketRing> ring(new ShmPacketRing());
+    ring->mem_fd_ = mem_fd;
+    ring->event_fd_ = event_fd;
+    ring->link_fd_ = link_fd;
+
+    struct stat st{};
+    if (fstat(mem_fd, &st) < 0 || static_cast<size_t>(st.st_size) < kHeaderSize) {
+        spdlog::error("shm ring: shared memory too small");
+        return nullptr;
+    }
+    if (!ring->map(static_cast<size_t>(st.st_size))) {
+        return nullptr;
+    }
+    const Header &h = *ring->header_;
+    const bool pow2 = h.slot_count != 0 && (h.slot_count & (h.slot_count - 1)) == 0;
+    if (h.magic != kMagic || h.version != kVersion || !pow2 || h.slot_size <= kSlotHeaderSize ||
+        h.slot_size % 8 != 0 ||
+        kHeaderSize + static_cast<size_t>(h.slot_count) * h.slot_size > ring->map_size_) {
+        spdlog::error("shm ring: incompatible ring (magic {:#x} version {})", h.magic, h.version);
+        return nullptr;
+    }
+    ring->slot_size_ = h.slot_size;
+    ring->slot_count_ = h.slot_count;
+    return ring;
+}
+
+bool ShmPacketRing::push(const uint8_t *data, size_t size, uint64_t rx_ns)
+{
+    // Only this end writes head, so our own last store is the current value.
+    const uint64_t head = header_->head.load(std::memory_order_relaxed);
+    if (size > max_packet() || head - header_->tail.load(std::memory_order_acquire) >= slot_count_) {
+        header_->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint8_t *s = slot(head);
+    const uint32_t length = static_cast<uint32_t>(size);
+    std::memcpy(s, &length, sizeof(length));
+    std::memcpy(s + 8, &rx_ns, sizeof(rx_ns));
+    std::memcpy(s + kSlotHeaderSize, data, size);
+    header_->head.store(head + 1, std::memory_order_release);
+
+    // Pairs with the fence in begin_sleep(): either we see `sleeping` here or the consumer
+    // sees the new head before it blocks.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->sleeping.load(std::memory_order_relaxed) &&
+        header_->sleeping.exchange(0, std::memory_order_relaxed)) {
+        const uint64_t one = 1;
+        ++syscalls_;
+        if (write(event_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            spdlog::warn("shm ring: eventfd write failed: {}", strerror(errno));
+        }
+    }
+    return true;
+}
+
+int ShmPacketRing::consume(const PacketHandler &handler)
+{
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    const uint64_t head = header_->head.load(std::memory_order_acquire);
+    if (head - tail > slot_count_) {
+        // Only a broken producer gets here; skip whatever it claims to have written.
+        spdlog::warn("shm ring: producer head {} is {} slots ahead, resyncing", head, head - tail);
+        header_->tail.store(head, std::memory_order_release);
+        return 0;
+    }
+    int delivered = 0;
+    for (; tail != head; ++tail) {
+        const uint8_t *s = slot(tail);
+        uint32_t length = 0;
+        uint64_t rx_ns = 0;
+        std::memcpy(&length, s, sizeof(length));
+        std::memcpy(&rx_ns, s + 8, sizeof(rx_ns));
+        handler(s + kSlotHeaderSize, std::min<size_t>(length, max_packet()), rx_ns);
+        ++delivered;
+    }
+    if (delivered) {
+        header_->tail.store(tail, std::memory_order_release);
+    }
+    return delivered;
+}
+
+bool ShmPacketRing::begin_sleep()
+{
+    header_->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->head.load(std::memory_order_relaxed) != header_->tail.load(std::memory_order_relaxed)) {
+        header_->sleeping.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void ShmPacketRing::end_sleep(bool event_ready)
+{
+    header_->sleeping.store(0, std::memory_order_relaxed);
+    if (event_ready) {
+        uint64_t count = 0;
+        ++syscalls_;
+        if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            spdlog::warn("shm ring: eventfd read failed: {}", strerror(errno));
+        }
+    }
+}
+
+uint64_t ShmPacketRing::dropped() const
+{
+    return header_->dropped.load(std::memory_order_relaxed);
+}
+
+bool ShmPacketRing::peer_closed() const
+{
+    if (link_fd_ < 0) {
+        return false;
+    }
+    pollfd pfd{link_fd_, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0 && pfd.revents != 0;
+}
+
+ShmRingConsumer::~ShmRingConsumer()
+{
+    stop();
+}
+
+bool ShmRingConsumer::start(const std::string &name, unsigned slot_count, unsigned max_packet)
+{
+    stop();
+    ring_ = ShmPacketRing::create(slot_count, max_packet);
+    if (!ring_) {
+        return false;
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_fd_ < 0) {
+        spdlog::error("shm ring: socket failed: {}", strerror(errno));
+        stop();
+        return false;
+    }
+    sockaddr_un addr{};
+    const socklen_t len = abstract_address(name, addr);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), len) < 0 || listen(listen_fd_, 2) < 0) {
+        spdlog::error("shm ring: cannot listen on @{}: {}", name, strerror(errno));
+        stop();
+        return false;
+    }
+    name_ = name;
+    dropped_reported_ = 0;
+    spdlog::info("shm ring: waiting for a producer on @{} ({} slots x {} bytes)", name,
+                 slot_count, ring_->max_packet());
+    return true;
+}
+
+void ShmRingConsumer::stop()
+{
+    close_fd(conn_fd_);
+    close_fd(listen_fd_);
+    ring_.reset();
+    stats_ = {};
+}
+
+void ShmRingConsumer::accept_producer()
+{
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (conn_fd_ >= 0) {
+        spdlog::warn("shm ring: refusing a second producer on @{}", name_);
+        close(fd);
+        return;
+    }
+
+    const int fds[2] = {ring_->mem_fd(), ring_->event_fd()};
+    char tag = 'R';
+    iovec iov{&tag, sizeof(tag)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+        spdlog::warn("shm ring: handing the ring to a producer failed: {}", strerror(errno));
+        close(fd);
+        return;
+    }
+    conn_fd_ = fd;
+    spdlog::info("shm ring: producer attached on @{}", name_);
+}
+
+int ShmRingConsumer::wait(int timeout_ms, const ShmPacketRing::PacketHandler &handler)
+{
+    int delivered = ring_->consume(handler);
+    if (delivered == 0 && ring_->begin_sleep()) {
+        pollfd fds[3] = {{ring_->event_fd(), POLLIN, 0}, {listen_fd_, POLLIN, 0}, {conn_fd_, POLLIN, 0}};
+        const nfds_t nfds = conn_fd_ >= 0 ? 3 : 2;
+        ++syscalls_;
+        ++stats_.sleeps;
+        const int ready = poll(fds, nfds, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            ring_->end_sleep(false);
+            return -1;
+        }
+        const bool event = ready > 0 && (fds[0].revents & POLLIN);
+        if (event) {
+            ++stats_.wakeups;
+        }
+        ring_->end_sleep(event);
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            accept_producer();
+        }
+        // The producer never sends anything: readable or hung up means it went away.
+        if (ready > 0 && nfds == 3 && fds[2].revents) {
+            close_fd(conn_fd_);
+            spdlog::info("shm ring: producer detached from @{}", name_);
+        }
+        delivered = ring_->consume(handler);
+    }
+    stats_.packets += static_cast<uint64_t>(delivered);
+    return delivered;
+}
+
+ShmRingConsumer::Stats ShmRingConsumer::take_stats()
+{
+    Stats out = stats_;
+    if (ring_) {
+        const uint64_t dropped = ring_->dropped();
+        out.dropped = dropped - dropped_reported_;
+        dropped_reported_ = dropped;
+    }
+    stats_ = {};
+    return out;
+}
+
+std::unique_ptr<ShmPacketRing> shm_ring_connect(const std::string &name)
+{
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return nullptr;
+    }
+    sockaddr_un addr{};
+    const socklen_t len = abstract_address(name, addr);
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), len) < 0) {
+        close(sock);
+        return nullptr;
+    }
+
+    char tag = 0;
+    iovec iov{&tag, sizeof(tag)};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    // A refused producer sees the connection closed instead (recvmsg() returns 0).
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        close(sock);
+        return nullptr;
+    }
+    const cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        close(sock);
+        return nullptr;
+    }
+    int fds[2];
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    return ShmPacketRing::attach(fds[0], fds[1], sock);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Single-producer / single-consumer packet ring in a memfd shared between two processes on
+// the same box, so a co-located radio receiver (wfb-ng style) can hand RTP packets to us
+// without a syscall per packet. Replaces the abstract AF_UNIX datagram socket, where every
+// packet crossed the kernel twice.
+//
+// Shared layout (native endianness, offsets in bytes from the start of the mapping):
+//
+//     0  magic "AMLR", version, slot_size, slot_count     written once by the consumer
+//    64  head      uint64  next slot the producer fills   written by the producer only
+//   128  tail      uint64  next slot the consumer reads   written by the consumer only
+//   192  sleeping  uint32  consumer is blocked on the eventfd (or about to be)
+//   200  dropped   uint64  packets the producer dropped because the ring was full
+//   256  slot_count slots of slot_size bytes:
+//          uint32 length, uint32 reserved, uint64 rx_ns (CLOCK_REALTIME, 0 = unknown), payload
+//
+// head and tail count slots forever; the slot of index i is i % slot_count. The producer
+// fills its slot and then publishes head + 1 (release); the consumer reads up to head
+// (acquire) and publishes tail the same way. A full ring drops the new packet.
+//
+// Wakeups: before blocking on the eventfd the consumer sets `sleeping` and re-checks head;
+// the producer writes the eventfd only when it finds `sleeping` set after publishing, so
+// packets that arrive while the consumer is busy cost no syscall on either side.
+//
+// Handshake: the consumer listens on an abstract AF_UNIX SOCK_SEQPACKET socket. A producer
+// connects and receives the memfd and the eventfd via SCM_RIGHTS. The ring outlives producer
+// restarts; a second producer is refused while one is attached.
+class ShmPacketRing {
+public:
+    static constexpr uint32_t kMagic = 0x524c4d41; // "AMLR"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 256;
+    static constexpr size_t kSlotHeaderSize = 16;
+
+    // rx_ns: receive time the producer stamped, 0 when it did not.
+    using PacketHandler = std::function<void(const uint8_t *data, size_t size, uint64_t rx_ns)>;
+
+    ~ShmPacketRing();
+    ShmPacketRing(const ShmPacketRing &) = delete;
+    ShmPacketRing &operator=(const ShmPacketRing &) = delete;
+
+    // Consumer: fresh ring; slot_count is rounded up to a power of two, max_packet bounds
+    // one payload. nullptr when memfd/eventfd/mmap fail.
+    static std::unique_ptr<ShmPacketRing> create(unsigned slot_count, unsigned max_packet);
+    // Producer: maps a ring received from the consumer and takes ownership of the fds.
+    // link_fd is the connection to the consumer, held open so it notices when we go away.
+    static std::unique_ptr<ShmPacketRing> attach(int mem_fd, int event_fd, int link_fd = -1);
+
+    // Producer side. false when the packet does not fit a slot or the ring is full
+    // (both counted in the shared `dropped` counter).
+    bool push(const uint8_t *data, size_t size, uint64_t rx_ns);
+
+    // Consumer side: hands every published packet to `handler` without blocking.
+    int consume(const PacketHandler &handler);
+    // Consumer side: true when the caller may block on event_fd(); false when packets came
+    // in meanwhile. Every true must be followed by end_sleep().
+    bool begin_sleep();
+    // Clears `sleeping` and resets the eventfd counter if it fired (one read() then).
+    void end_sleep(bool event_ready);
+
+    int mem_fd() const { return mem_fd_; }
+    int event_fd() const { return event_fd_; }
+    unsigned max_packet() const { return slot_size_ - kSlotHeaderSize; }
+    uint64_t dropped() const;
+    // Producer side: true once the consumer closed the connection (ring is orphaned).
+    bool peer_closed() const;
+    // eventfd writes (producer) or reads (consumer) made by this end.
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    struct Header;
+    ShmPacketRing() = default;
+    bool map(size_t size);
+    uint8_t *slot(uint64_t index) const;
+
+    int mem_fd_{-1};
+    int event_fd_{-1};
+    int link_fd_{-1};
+    uint8_t *map_{nullptr};
+    size_t map_size_{0};
+    Header *header_{nullptr};
+    unsigned slot_size_{0};
+    unsigned slot_count_{0};
+    uint64_t syscalls_{0};
+};
+
+// Consumer end as the receiver uses it: owns the ring and the abstract socket producers
+// connect to, and serves (re)connecting producers from inside wait().
+class ShmRingConsumer {
+public:
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t sleeps = 0;   // times the consumer blocked on the eventfd
+        uint64_t wakeups = 0;  // sleeps ended by the producer (not by the timeout)
+        uint64_t dropped = 0;  // packets the producer dropped on a full ring
+    };
+
+    ShmRingConsumer() = default;
+    ~ShmRingConsumer();
+    ShmRingConsumer(const ShmRingConsumer &) = delete;
+    ShmRingConsumer &operator=(const ShmRingConsumer &) = delete;
+
+    bool start(const std::string &name, unsigned slot_count, unsigned max_packet);
+    void stop();
+
+    // Delivers queued packets, blocking up to timeout_ms when there are none.
+    // Returns the number of packets delivered, or -1 when poll() fails.
+    int wait(int timeout_ms, const ShmPacketRing::PacketHandler &handler);
+
+    const std::string &name() const { return name_; }
+    bool producer_attached() const { return conn_fd_ >= 0; }
+    // poll() plus eventfd reads.
+    uint64_t syscalls() const { return syscalls_ + (ring_ ? ring_->syscalls() : 0); }
+    Stats take_stats();
+
+private:
+    void accept_producer();
+
+    std::unique_ptr<ShmPacketRing> ring_;
+    std::string name_;
+    int listen_fd_{-1};
+    int conn_fd_{-1};
+    uint64_t syscalls_{0};
+    Stats stats_;
+    uint64_t dropped_reported_{0};
+};
+
+// Producer end: connects to the consumer listening on `name` and maps its ring.
+// nullptr when nobody listens there (or the ring is refused / incompatible).
+std::unique_ptr<ShmPacketRing> shm_ring_connect(const std::string &name);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+// Non-blocking UDP socket connect()ed to "host:port", so every message is a plain send()
+// and only that peer's replies are queued on it. `what` names the channel in errors.
+// Returns the fd, or -1.
+inline int connect_udp_target(const std::string &destination, const char *what)
+{
+    const auto colon = destination.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        spdlog::error("{} target '{}' is not host:port", what, destination);
+        return -1;
+    }
+    const std::string host = destination.substr(0, colon);
+    const std::string port = destination.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+        spdlog::error("{} target {} does not resolve", what, destination);
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        spdlog::error("{} socket to {} failed: {}", what, destination, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
@@ -0,0 +1,435 @@
+#include "uring_receiver.h"
+#include "frame_timing.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT) && defined(IORING_ENTER_EXT_ARG)
+#define HAVE_URING_MULTISHOT 1
+#endif
+
+#ifdef HAVE_URING_MULTISHOT
+
+namespace {
+constexpr uint16_t kBufferGroup = 0;
+constexpr uint64_t kRecvUserData = 1;
+constexpr uint64_t kCancelUserData = 2;
+constexpr unsigned kSqEntries = 8;
+constexpr unsigned kCqEntries = 4096;
+
+int sys_io_uring_setup(unsigned entries, io_uring_params *p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                       const void *arg, size_t argsz)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+unsigned load_acquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *p, unsigned v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+unsigned round_up_pow2(unsigned v)
+{
+    unsigned p = 1;
+    while (p < v && p < 32768)
+        p <<= 1;
+    return p;
+}
+
+// Indexes the provided-buffer ring by hand: in C++ the uapi __DECLARE_FLEX_ARRAY wrapper
+// gives io_uring_buf_ring::bufs an 8-byte offset, while the kernel expects entry 0 at the
+// start of the ring (its tail overlaying entry 0's resv field).
+io_uring_buf *buf_entry(void *ring, unsigned idx)
+{
+    return static_cast<io_uring_buf *>(ring) + idx;
+}
+
+uint16_t *buf_ring_tail(void *ring)
+{
+    return &static_cast<io_uring_buf *>(ring)->resv;
+}
+
+void *map_ring(int fd, size_t size, off_t offset)
+{
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+}
+} // namespace
+
+bool UringReceiver::supported()
+{
+    io_uring_params params{};
+    const int fd = sys_io_uring_setup(2, &params);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return (params.features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+UringReceiver::~UringReceiver()
+{
+    stop();
+}
+
+bool UringReceiver::start(int sock_fd, unsigned buf_count, unsigned buf_size)
+{
+    stop();
+    sock_fd_ = sock_fd;
+
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCqEntries;
+    ring_fd_ = sys_io_uring_setup(kSqEntries, &params);
+    if (ring_fd_ < 0) {
+        spdlog::warn("io_uring_setup failed: {}", strerror(errno));
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        spdlog::warn("io_uring: kernel lacks IORING_FEAT_EXT_ARG");
+        stop();
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring_
+                                                            : map_ring(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = map_ring(ring_fd_, sqes_size_, IORING_OFF_SQES);
+    if (!sq_ring_ || !cq_ring_ || !sqes_) {
+        spdlog::warn("io_uring: ring mmap failed: {}", strerror(errno));
+        stop();
+        return false;
+    }
+
+    auto *sq = static_cast<uint8_t *>(sq_ring_);
+    auto *cq = static_cast<uint8_t *>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+
+    // Provided buffer ring: the ring of descriptors and the packet memory it points to.
+    buf_count_ = round_up_pow2(buf_count);
+    buf_size_ = buf_size + sizeof(io_uring_recvmsg_out);
+    buf_ring_size_ = buf_count_ * sizeof(io_uring_buf);
+    buf_ring_ = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffers_size_ = static_cast<size_t>(buf_count_) * buf_size_;
+    void *buffers = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (buf_ring_ == MAP_FAILED || buffers == MAP_FAILED) {
+        buf_ring_ = buf_ring_ == MAP_FAILED ? nullptr : buf_ring_;
+        buffers_ = buffers == MAP_FAILED ? nullptr : static_cast<uint8_t *>(buffers);
+        spdlog::warn("io_uring: buffer allocation failed");
+        stop();
+        return false;
+    }
+    buffers_ = static_cast<uint8_t *>(buffers);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = buf_count_;
+    reg.bgid = kBufferGroup;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        spdlog::warn("io_uring: provided buffer ring not supported: {}", strerror(errno));
+        stop();
+        return false;
+    }
+
+    for (unsigned i = 0; i < buf_count_; ++i) {
+        io_uring_buf &buf = *buf_entry(buf_ring_, i);
+        buf.addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(i) * buf_size_);
+        buf.len = buf_size_;
+        buf.bid = static_cast<uint16_t>(i);
+    }
+    buf_tail_ = static_cast<uint16_t>(buf_count_);
+    __atomic_store_n(buf_ring_tail(buf_ring_), buf_tail_, __ATOMIC_RELEASE);
+
+    if (!arm_recv() || enter(pending_submit_, 0, -1) < 0) {
+        stop();
+        return false;
+    }
+
+    // Kernels without multishot recvmsg reject the SQE synchronously, so an immediate
+    // -EINVAL completion here means "fall back".
+    const unsigned head = *cq_head_;
+    if (head != load_acquire(cq_tail_)) {
+        const auto *cqe = static_cast<io_uring_cqe *>(cqes_) + (head & cq_mask_);
+        if (cqe->res == -EINVAL) {
+            spdlog::warn("io_uring: multishot recvmsg not supported by this kernel");
+            stop();
+            return false;
+        }
+    }
+
+    spdlog::info("io_uring receiver ready: {} buffers x {} bytes", buf_count_, buf_size_);
+    return true;
+}
+
+void UringReceiver::stop()
+{
+    if (ring_fd_ >= 0 && armed_) {
+        cancel_recv();
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (buf_ring_) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+    }
+    if (buffers_) {
+        munmap(buffers_, buffers_size_);
+        buffers_ = nullptr;
+    }
+    armed_ = false;
+    pending_submit_ = 0;
+}
+
+void *UringReceiver::next_sqe()
+{
+    const unsigned tail = *sq_tail_;
+    if (tail - load_acquire(sq_head_) > sq_mask_) {
+        return nullptr;
+    }
+    const unsigned idx = tail & sq_mask_;
+    auto *sqe = static_cast<io_uring_sqe *>(sqes_) + idx;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    return sqe;
+}
+
+void UringReceiver::commit_sqe()
+{
+    store_release(sq_tail_, *sq_tail_ + 1);
+    ++pending_submit_;
+}
+
+bool UringReceiver::arm_recv()
+{
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    if (!sqe) {
+        return false;
+    }
+
+    // Multishot recvmsg only reads msg_namelen/msg_controllen: no name, room for the
+    // SO_TIMESTAMPNS cmsg, so each provided buffer holds an io_uring_recvmsg_out header,
+    // the control area and the payload.
+    msg_ = {};
+    msg_.msg_controllen = kRxTimestampControlLen;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&msg_);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = kRecvUserData;
+    commit_sqe();
+    armed_ = true;
+    return true;
+}
+
+void UringReceiver::cancel_recv()
+{
+    // The armed request holds a reference on the socket, and closing the ring tears it
+    // down asynchronously: cancel and reap it first so the port can be re-bound at once.
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = kRecvUserData;
+    sqe->user_data = kCancelUserData;
+    commit_sqe();
+
+    for (int attempt = 0; attempt < 10 && armed_; ++attempt) {
+        if (enter(pending_submit_, 1, 10) < 0) {
+            break;
+        }
+        unsigned head = *cq_head_;
+        const unsigned tail = load_acquire(cq_tail_);
+        for (; head != tail; ++head) {
+            const auto *cqe = static_cast<io_uring_cqe *>(cqes_) + (head & cq_mask_);
+            if (cqe->user_data == kRecvUserData && !(cqe->flags & IORING_CQE_F_MORE)) {
+                armed_ = false;
+            }
+        }
+        store_release(cq_head_, head);
+    }
+}
+
+int UringReceiver::enter(unsigned to_submit, unsigned min_complete, int timeout_ms)
+{
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    unsigned flags = 0;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000LL;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    ++syscalls_;
+    const int ret = sys_io_uring_enter(ring_fd_, to_submit, min_complete, flags,
+                                       min_complete > 0 ? &arg : nullptr,
+                                       min_complete > 0 ? sizeof(arg) : 0);
+    if (ret >= 0) {
+        pending_submit_ -= std::min<unsigned>(pending_submit_, static_cast<unsigned>(ret));
+        return ret;
+    }
+    if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+        return 0;
+    }
+    spdlog::warn("io_uring_enter failed: {}", strerror(errno));
+    return -1;
+}
+
+void UringReceiver::recycle(uint16_t bid)
+{
+    io_uring_buf &buf = *buf_entry(buf_ring_, buf_tail_ & (buf_count_ - 1));
+    buf.addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(bid) * buf_size_);
+    buf.len = buf_size_;
+    buf.bid = bid;
+    ++buf_tail_;
+    __atomic_store_n(buf_ring_tail(buf_ring_), buf_tail_, __ATOMIC_RELEASE);
+}
+
+int UringReceiver::wait(int timeout_ms, const PacketHandler &handler)
+{
+    if (ring_fd_ < 0) {
+        return -1;
+    }
+
+    unsigned head = *cq_head_;
+    if (head == load_acquire(cq_tail_) || pending_submit_ > 0) {
+        if (enter(pending_submit_, head == load_acquire(cq_tail_) ? 1 : 0, timeout_ms) < 0) {
+            return -1;
+        }
+    }
+
+    int delivered = 0;
+    const unsigned tail = load_acquire(cq_tail_);
+    for (; head != tail; ++head) {
+        const auto *cqe = static_cast<io_uring_cqe *>(cqes_) + (head & cq_mask_);
+        if (cqe->user_data != kRecvUserData) {
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            // The kernel disarmed the multishot request (e.g. -ENOBUFS when every buffer
+            // was in flight); re-arm on the next wait.
+            armed_ = false;
+        }
+        if (cqe->res < 0) {
+            // -ENOBUFS only means the buffers ran out: re-arm. Anything else ending the
+            // request (a bad fd, an unsupported op) would fail again on every re-arm.
+            if (cqe->res != -ENOBUFS && !(cqe->flags & IORING_CQE_F_MORE)) {
+                spdlog::error("io_uring recvmsg failed: {}", strerror(-cqe->res));
+                armed_ = false;
+                stop();
+                return -1;
+            }
+            if (cqe->res != -ENOBUFS) {
+                spdlog::warn("io_uring recvmsg completion error: {}", strerror(-cqe->res));
+            }
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+
+        const auto bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        const uint8_t *buf = buffers_ + static_cast<size_t>(bid) * buf_size_;
+        const auto *out = reinterpret_cast<const io_uring_recvmsg_out *>(buf);
+        const size_t header = sizeof(io_uring_recvmsg_out) + msg_.msg_controllen;
+        const size_t available = static_cast<size_t>(cqe->res) - std::min<size_t>(header, cqe->res);
+        if (out->flags & MSG_TRUNC) {
+            ++truncated_;
+        }
+        msghdr control{};
+        control.msg_control = const_cast<uint8_t *>(buf + sizeof(io_uring_recvmsg_out));
+        control.msg_controllen = out->controllen;
+        handler(buf + header, std::min<size_t>(out->payloadlen, available), rx_timestamp_ns(control));
+        recycle(bid);
+        ++delivered;
+    }
+    store_release(cq_head_, head);
+
+    if (!armed_ && !arm_recv()) {
+        return -1;
+    }
+    return delivered;
+}
+
+#else // !HAVE_URING_MULTISHOT
+
+bool UringReceiver::supported()
+{
+    return false;
+}
+
+UringReceiver::~UringReceiver() = default;
+
+bool UringReceiver::start(int, unsigned, unsigned)
+{
+    spdlog::warn("io_uring receiver not available in this build");
+    return false;
+}
+
+void UringReceiver::stop() {}
+
+int UringReceiver::wait(int, const PacketHandler &)
+{
+    return -1;
+}
+
+#endif
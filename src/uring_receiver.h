@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/socket.h>
+
+// Datagram receiver on top of io_uring: one multishot IORING_OP_RECVMSG stays armed on
+// the socket and the kernel writes each datagram into a registered provided-buffer ring,
+// so a burst of packets costs one io_uring_enter() instead of a syscall per packet.
+// Talks to the kernel through raw syscalls (no liburing); needs Linux 6.0+ at runtime.
+class UringReceiver {
+public:
+    // rx_ns: kernel receive time (SO_TIMESTAMPNS), 0 when the socket does not stamp.
+    using PacketHandler = std::function<void(const uint8_t *data, size_t size, uint64_t rx_ns)>;
+
+    UringReceiver() = default;
+    ~UringReceiver();
+    UringReceiver(const UringReceiver &) = delete;
+    UringReceiver &operator=(const UringReceiver &) = delete;
+
+    // Cheap probe: true when this build and the running kernel can set up a ring
+    // with provided buffers. start() can still fail on kernels without multishot recvmsg.
+    static bool supported();
+
+    // buf_count is rounded up to a power of two; buf_size bounds a single datagram.
+    bool start(int sock_fd, unsigned buf_count, unsigned buf_size);
+    void stop();
+
+    // Hands every completed datagram to `handler`, blocking up to timeout_ms when none
+    // are pending. Buffers are recycled as soon as the handler returns.
+    // Returns the number of datagrams delivered, or -1 on a fatal ring error.
+    int wait(int timeout_ms, const PacketHandler &handler);
+
+    uint64_t syscalls() const { return syscalls_; }
+    uint64_t truncated() const { return truncated_; }
+
+private:
+    void *next_sqe();
+    void commit_sqe();
+    bool arm_recv();
+    void cancel_recv();
+    int enter(unsigned to_submit, unsigned min_complete, int timeout_ms);
+    void recycle(uint16_t bid);
+
+    int ring_fd_{-1};
+    int sock_fd_{-1};
+
+    void *sq_ring_{nullptr};
+    size_t sq_ring_size_{0};
+    void *cq_ring_{nullptr};
+    size_t cq_ring_size_{0};
+    void *sqes_{nullptr};
+    size_t sqes_size_{0};
+
+    unsigned *sq_head_{nullptr};
+    unsigned *sq_tail_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned *sq_array_{nullptr};
+    unsigned *cq_head_{nullptr};
+    unsigned *cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    void *cqes_{nullptr};
+
+    void *buf_ring_{nullptr};
+    size_t buf_ring_size_{0};
+    uint8_t *buffers_{nullptr};
+    size_t buffers_size_{0};
+    unsigned buf_count_{0};
+    unsigned buf_size_{0};
+    uint16_t buf_tail_{0};
+
+    msghdr msg_{};
+    bool armed_{false};
+    unsigned pending_submit_{0};
+    uint64_t syscalls_{0};
+    uint64_t truncated_{0};
+};
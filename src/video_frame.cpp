@@ -0,0 +1,118 @@
+#include "video_frame.h"
+
+#include <cstring>
+
+std::atomic<uint64_t> VideoFrame::bytes_copied_{0};
+
+void NalSummary::add(VideoCodec codec, const uint8_t *header)
+{
+    uint8_t type;
+    bool vcl, irap_type, reference_type;
+    uint8_t tid = 0;
+    if (codec == VideoCodec::H264) {
+        type = header[0] & 0x1f;
+        vcl = type >= 1 && type <= 5;
+        irap_type = type == 5;
+        reference_type = (header[0] & 0x60) != 0;
+    } else if (codec == VideoCodec::H265) {
+        type = (header[0] >> 1) & 0x3f;
+        vcl = type < 32;
+        irap_type = type >= 16 && type <= 21;
+        // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N, RSV_VCL_N10/12/14
+        reference_type = !(type <= 14 && type % 2 == 0);
+        tid = (header[1] & 0x07) ? static_cast<uint8_t>((header[1] & 0x07) - 1) : 0;
+    } else {
+        return;
+    }
+    types |= 1ull << type;
+    if (!vcl) {
+        return;
+    }
+    irap = irap || irap_type;
+    if (!slice) {
+        slice = true;
+        reference = reference_type;
+        temporal_id = tid;
+    }
+}
+
+NalSummary NalSummary::scan(VideoCodec codec, const uint8_t *data, size_t size)
+{
+    NalSummary out;
+    if (codec == VideoCodec::UNKNOWN) {
+        return out;
+    }
+    const size_t header_size = codec == VideoCodec::H265 ? 2 : 1;
+    // A start code ends in 0x01, which is rare enough in slice data for memchr to skip it.
+    size_t pos = 2;
+    while (pos + header_size < size) {
+        const auto *one = static_cast<const uint8_t *>(std::memchr(data + pos, 1, size - header_size - pos));
+        if (!one) {
+            break;
+        }
+        pos = static_cast<size_t>(one - data);
+        if (data[pos - 1] == 0 && data[pos - 2] == 0) {
+            out.add(codec, data + pos + 1);
+            pos += header_size;
+        }
+        ++pos;
+    }
+    return out;
+}
+
+std::shared_ptr<const VideoFrame> VideoFrame::wrap(GstBuffer *buffer, VideoCodec codec, const FrameTiming &timing)
+{
+    std::shared_ptr<VideoFrame> frame(new VideoFrame());
+    if (!gst_buffer_map(buffer, &frame->map_, GST_MAP_READ)) {
+        return nullptr;
+    }
+    frame->buffer_ = gst_buffer_ref(buffer);
+    frame->data_ = frame->map_.data;
+    frame->size_ = frame->map_.size;
+    frame->meta_.timing = timing;
+    frame->meta_.nals = NalSummary::scan(codec, frame->data_, frame->size_);
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) || frame->meta_.nals.irap) {
+        frame->meta_.flags |= KEYFRAME;
+    }
+    if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT) ||
+        GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_CORRUPTED)) {
+        frame->meta_.flags |= INCOMPLETE;
+    }
+    return frame;
+}
+
+std::shared_ptr<const VideoFrame> VideoFrame::wrap(std::shared_ptr<std::vector<uint8_t>> data, const FrameMeta &meta)
+{
+    std::shared_ptr<VideoFrame> frame(new VideoFrame());
+    frame->vector_ = std::move(data);
+    frame->data_ = frame->vector_->data();
+    frame->size_ = frame->vector_->size();
+    frame->meta_ = meta;
+    return frame;
+}
+
+VideoFrame::~VideoFrame()
+{
+    if (buffer_) {
+        gst_buffer_unmap(buffer_, &map_);
+        gst_buffer_unref(buffer_);
+    }
+}
+
+void VideoFrame::mark(Stage stage) const
+{
+    // Once per stage; marking it again keeps the first time.
+    uint64_t unset = 0;
+    stages_[static_cast<size_t>(stage)].compare_exchange_strong(unset, realtime_ns(), std::memory_order_relaxed);
+}
+
+std::shared_ptr<std::vector<uint8_t>> VideoFrame::to_vector() const
+{
+    if (vector_) {
+        return vector_;
+    }
+    auto copy = std::make_shared<std::vector<uint8_t>>(size_);
+    std::memcpy(copy->data(), data_, size_);
+    bytes_copied_.fetch_add(size_, std::memory_order_relaxed);
+    return copy;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include "frame_timing.h"
+
+enum class VideoCodec {
+    UNKNOWN = 0,
+    H264,
+    H265
+};
+
+// What an access unit is made of, from its NAL unit headers.
+struct NalSummary {
+    uint64_t types = 0;      // bit n set: a NAL unit of type n is present
+    bool irap = false;       // IRAP (H.265) / IDR (H.264) slice present
+    bool slice = false;      // any VCL NAL unit; reference/temporal_id come from the first
+    bool reference = true;   // false: non-reference picture (H.264 nal_ref_idc 0, H.265 *_N types)
+    uint8_t temporal_id = 0; // H.265 TemporalId; 0 for H.264
+
+    void add(VideoCodec codec, const uint8_t *header);
+    bool has(uint8_t type) const { return type < 64 && (types >> type & 1); }
+    // Every NAL unit header behind an Annex-B start code in `data`.
+    static NalSummary scan(VideoCodec codec, const uint8_t *data, size_t size);
+};
+
+// Everything the receiver knows about an access unit besides its bytes.
+struct FrameMeta {
+    FrameTiming timing;
+    uint32_t flags = 0; // VideoFrame::Flags
+    NalSummary nals;
+    // RTP timestamp and the sequence numbers of the first and last packet; only the
+    // native depacketizer sees them (rtp_valid), GStreamer's depayloader keeps them.
+    bool rtp_valid = false;
+    uint32_t rtp_timestamp = 0;
+    uint16_t first_seq = 0;
+    uint16_t last_seq = 0;
+};
+
+// One encoded access unit on its way from the receiver to the decoder and the DVR.
+// Shared read-only between them; the bytes stay valid until the last reference is gone.
+// Frames pulled from the appsink keep their GstBuffer mapped instead of being copied,
+// frames from the native depacketizer own the vector they were assembled in. The
+// metadata is filled in once where the frame is made, so consumers decide on it
+// without looking at the bitstream again.
+class VideoFrame {
+public:
+    enum Flags : uint32_t {
+        KEYFRAME = 1u << 0,   // IRAP (H.265) / IDR (H.264) access unit
+        INCOMPLETE = 1u << 1, // packets of this access unit were lost on the way in
+    };
+
+    // Where the frame is after it left the receiver, CLOCK_REALTIME like FrameTiming;
+    // each stage is stamped by the thread that reaches it (mark()), 0 until then.
+    enum class Stage : uint8_t {
+        QUEUED = 0,    // handed to the decode queue (and the DVR)
+        DECODE_SUBMIT, // codec_write() called
+        DECODED,       // codec_write() returned
+        RECORDED,      // written to the DVR file
+        COUNT
+    };
+
+    // Takes its own reference on `buffer` and maps it read-only; nullptr if mapping fails.
+    // NAL metadata comes from one scan of the mapped bytes. Flags come from the buffer as
+    // well: no DELTA_UNIT = keyframe, DISCONT/CORRUPTED = incomplete (the depayloader
+    // marks the first output after a sequence gap DISCONT).
+    static std::shared_ptr<const VideoFrame> wrap(GstBuffer *buffer, VideoCodec codec, const FrameTiming &timing);
+    static std::shared_ptr<const VideoFrame> wrap(std::shared_ptr<std::vector<uint8_t>> data, const FrameMeta &meta);
+
+    ~VideoFrame();
+    VideoFrame(const VideoFrame &) = delete;
+    VideoFrame &operator=(const VideoFrame &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    const FrameMeta &meta() const { return meta_; }
+    const FrameTiming &timing() const { return meta_.timing; }
+    const NalSummary &nals() const { return meta_.nals; }
+    bool keyframe() const { return meta_.flags & KEYFRAME; }
+    bool incomplete() const { return meta_.flags & INCOMPLETE; }
+    bool reference() const { return meta_.nals.reference; }
+
+    void mark(Stage stage) const;
+    uint64_t stage_ns(Stage stage) const { return stages_[static_cast<size_t>(stage)].load(std::memory_order_relaxed); }
+
+    // Vector for consumers of the old shared_ptr<vector> callback; copies only when the
+    // frame is backed by a GstBuffer, otherwise hands out the frame's own vector.
+    std::shared_ptr<std::vector<uint8_t>> to_vector() const;
+    // Total bytes copied by to_vector(), for the per-second receiver stats.
+    static uint64_t bytes_copied() { return bytes_copied_.load(std::memory_order_relaxed); }
+
+private:
+    VideoFrame() = default;
+
+    const uint8_t *data_{nullptr};
+    size_t size_{0};
+    FrameMeta meta_;
+    mutable std::atomic<uint64_t> stages_[static_cast<size_t>(Stage::COUNT)]{};
+
+    GstBuffer *buffer_{nullptr};
+    GstMapInfo map_{};
+    std::shared_ptr<std::vector<uint8_t>> vector_;
+
+    static std::atomic<uint64_t> bytes_copied_;
+};
+
+using VideoFramePtr = std::shared_ptr<const VideoFrame>;
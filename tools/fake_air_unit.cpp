@@ -0,0 +1,348 @@
+//
+// Stand-in transmitter for testing keyframe requests (-K): sends a synthetic H.265 RTP
+// stream (VPS/SPS/PPS + IDR every GOP, TRAIL_R in between, FU-fragmented at 1200 bytes)
+// and answers requests on a UDP port -- RTCP PLI or the text datagram "keyframe" -- by
+// making the next frame an IDR, like an encoder would. Simulated packet loss (-x, -b)
+// gives the receiver something to ask about. The payload is noise, so the stream only
+// makes sense to the receiver's RTP/loss handling, not to a real decoder.
+// It also stands in for the air side of glass-to-glass latency measurement: -c answers
+// the receiver's clock sync requests (-S) and -e puts each frame's capture time into an
+// RTP header extension (-E), both in a simulated air clock that is off from ours by
+// -O ms and runs -d ppm fast (see src/clock_sync.h).
+//
+//   fake_air_unit [-o host:port] [-k request_port] [-f fps] [-g gop_frames]
+//                 [-s p_frame_bytes] [-x loss_percent] [-b burst]
+//                 [-c clock_port] [-e ext_id] [-O offset_ms] [-d drift_ppm]
+//
+// e.g. fake_air_unit -o 127.0.0.1:5600 -k 5611 -g 600 -x 0.5 -b 4
+//      AMLDigitalFPV ... -n 1 -K 127.0.0.1:5611 -v debug
+//      fake_air_unit -c 5613 -e 3 -O 5000 -d 40
+//      AMLDigitalFPV ... -S 127.0.0.1:5613 -E 3 -v debug
+//
+
+#include "clock_sync.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kMaxPayload = 1200;
+constexpr uint8_t kVideoPt = 97;
+
+uint64_t now_us()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+uint64_t monotonic_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// The air unit's clock: ours, shifted and running fast or slow.
+struct AirClock {
+    int64_t offset_ns = 0;
+    double drift = 0.0;
+
+    uint64_t now() const
+    {
+        const uint64_t mono = monotonic_ns();
+        return mono + static_cast<uint64_t>(offset_ns + static_cast<int64_t>(drift * static_cast<double>(mono)));
+    }
+};
+
+// Answers clock sync requests on `fd` forever; t2 right after the receive, t3 right
+// before the send.
+void answer_clock_requests(int fd, AirClock clock)
+{
+    uint8_t request[64];
+    uint8_t reply[clock_sync::kReplySize];
+    for (;;) {
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        const ssize_t n = recvfrom(fd, request, sizeof(request), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+        const uint64_t t2 = clock.now();
+        if (n <= 0 || !clock_sync::answer_request(request, static_cast<size_t>(n), t2, clock.now(), reply)) {
+            continue;
+        }
+        sendto(fd, reply, sizeof(reply), 0, reinterpret_cast<const sockaddr *>(&from), from_len);
+    }
+}
+
+bool parse_destination(const std::string &dest, sockaddr_in &addr)
+{
+    const auto colon = dest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(std::atoi(dest.c_str() + colon + 1)));
+    return inet_pton(AF_INET, dest.substr(0, colon).c_str(), &addr.sin_addr) == 1;
+}
+
+class RtpSender {
+public:
+    RtpSender(int fd, const sockaddr_in &addr, double loss, int burst, uint8_t capture_ext_id)
+        : fd_(fd), addr_(addr), loss_(loss), burst_(burst), capture_ext_id_(capture_ext_id),
+          rng_(std::random_device{}()) {}
+
+    // Air clock time the following packets carry in the capture time extension.
+    void set_capture_time(uint64_t air_ns) { capture_ns_ = air_ns; }
+
+    // One NAL unit (no start code), as a single packet or FU fragments.
+    void send_nal(const std::vector<uint8_t> &nal, uint32_t ts, bool last_in_au)
+    {
+        if (nal.size() <= kMaxPayload) {
+            send_packet(nal.data(), nal.size(), ts, last_in_au);
+            return;
+        }
+        const uint8_t type = (nal[0] >> 1) & 0x3f;
+        std::vector<uint8_t> fu;
+        for (size_t pos = 2; pos < nal.size(); pos += kMaxPayload) {
+            const size_t n = std::min(kMaxPayload, nal.size() - pos);
+            const bool start = pos == 2;
+            const bool end = pos + n == nal.size();
+            fu.assign({static_cast<uint8_t>((nal[0] & 0x81) | (49 << 1)), nal[1],
+                       static_cast<uint8_t>((start ? 0x80 : 0) | (end ? 0x40 : 0) | type)});
+            fu.insert(fu.end(), nal.begin() + static_cast<std::ptrdiff_t>(pos),
+                      nal.begin() + static_cast<std::ptrdiff_t>(pos + n));
+            send_packet(fu.data(), fu.size(), ts, last_in_au && end);
+        }
+    }
+
+    uint64_t sent() const { return sent_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    void send_packet(const uint8_t *payload, size_t size, uint32_t ts, bool marker)
+    {
+        uint8_t header[12] = {static_cast<uint8_t>(capture_ext_id_ ? 0x90 : 0x80),
+                              static_cast<uint8_t>((marker ? 0x80 : 0) | kVideoPt),
+                              static_cast<uint8_t>(seq_ >> 8), static_cast<uint8_t>(seq_),
+                              static_cast<uint8_t>(ts >> 24), static_cast<uint8_t>(ts >> 16),
+                              static_cast<uint8_t>(ts >> 8), static_cast<uint8_t>(ts),
+                              0x12, 0x34, 0x56, 0x78};
+        ++seq_;
+        if (dropping_ == 0 && loss_ > 0.0 && uniform_(rng_) < loss_) {
+            dropping_ = burst_;
+        }
+        if (dropping_ > 0) {
+            --dropping_;
+            ++dropped_;
+            return;
+        }
+        packet_.assign(header, header + sizeof(header));
+        if (capture_ext_id_) {
+            uint8_t extension[16];
+            clock_sync::write_capture_extension(extension, capture_ext_id_, capture_ns_);
+            packet_.insert(packet_.end(), extension, extension + sizeof(extension));
+        }
+        packet_.insert(packet_.end(), payload, payload + size);
+        sendto(fd_, packet_.data(), packet_.size(), 0, reinterpret_cast<const sockaddr *>(&addr_), sizeof(addr_));
+        ++sent_;
+    }
+
+    int fd_;
+    sockaddr_in addr_;
+    double loss_;
+    int burst_;
+    uint8_t capture_ext_id_;
+    uint64_t capture_ns_ = 0;
+    int dropping_ = 0;
+    uint16_t seq_ = 0;
+    uint64_t sent_ = 0;
+    uint64_t dropped_ = 0;
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    std::vector<uint8_t> packet_;
+};
+
+// Type + random body; the body never contains a start code pattern that matters here.
+std::vector<uint8_t> make_nal(uint8_t type, size_t size, std::mt19937 &rng)
+{
+    std::vector<uint8_t> nal(std::max<size_t>(size, 3));
+    for (auto &b : nal) {
+        b = static_cast<uint8_t>(rng() | 0x04);
+    }
+    nal[0] = static_cast<uint8_t>(type << 1);
+    nal[1] = 1;
+    return nal;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string dest = "127.0.0.1:5600";
+    int request_port = 5611;
+    int fps = 60;
+    int gop = 600;
+    int p_bytes = 12000;
+    double loss = 0.0;
+    int burst = 1;
+    int clock_port = 0;
+    int capture_ext_id = 0;
+    AirClock air_clock;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:k:f:g:s:x:b:c:e:O:d:")) != -1) {
+        switch (opt) {
+        case 'o':
+            dest = optarg;
+            break;
+        case 'k':
+            request_port = std::atoi(optarg);
+            break;
+        case 'f':
+            fps = std::clamp(std::atoi(optarg), 1, 240);
+            break;
+        case 'g':
+            gop = std::max(1, std::atoi(optarg));
+            break;
+        case 's':
+            p_bytes = std::clamp(std::atoi(optarg), 100, 1000000);
+            break;
+        case 'x':
+            loss = std::clamp(std::atof(optarg), 0.0, 100.0) / 100.0;
+            break;
+        case 'b':
+            burst = std::max(1, std::atoi(optarg));
+            break;
+        case 'c':
+            clock_port = std::atoi(optarg);
+            break;
+        case 'e':
+            capture_ext_id = std::clamp(std::atoi(optarg), 0, 14);
+            break;
+        case 'O':
+            air_clock.offset_ns = static_cast<int64_t>(std::atof(optarg) * 1e6);
+            break;
+        case 'd':
+            air_clock.drift = std::atof(optarg) * 1e-6;
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-o host:port] [-k request_port] [-f fps] [-g gop_frames] "
+                                 "[-s p_frame_bytes] [-x loss_percent] [-b burst] "
+                                 "[-c clock_port] [-e ext_id] [-O offset_ms] [-d drift_ppm]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sockaddr_in out_addr{};
+    if (!parse_destination(dest, out_addr)) {
+        std::fprintf(stderr, "bad destination %s, expected host:port\n", dest.c_str());
+        return 1;
+    }
+    const int out_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    const int req_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    sockaddr_in req_addr{};
+    req_addr.sin_family = AF_INET;
+    req_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    req_addr.sin_port = htons(static_cast<uint16_t>(request_port));
+    if (bind(req_fd, reinterpret_cast<sockaddr *>(&req_addr), sizeof(req_addr)) < 0) {
+        std::fprintf(stderr, "bind UDP %d failed: %s\n", request_port, strerror(errno));
+        return 1;
+    }
+
+    std::printf("H.265 %d fps, IDR every %d frames -> %s, keyframe requests on UDP %d, loss %.1f%% (burst %d)\n",
+                fps, gop, dest.c_str(), request_port, loss * 100.0, burst);
+
+    if (clock_port > 0) {
+        const int clock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in clock_addr = req_addr;
+        clock_addr.sin_port = htons(static_cast<uint16_t>(clock_port));
+        if (bind(clock_fd, reinterpret_cast<sockaddr *>(&clock_addr), sizeof(clock_addr)) < 0) {
+            std::fprintf(stderr, "bind UDP %d failed: %s\n", clock_port, strerror(errno));
+            return 1;
+        }
+        std::thread(answer_clock_requests, clock_fd, air_clock).detach();
+        std::printf("clock sync on UDP %d, air clock %+.3f ms, %+.1f ppm\n", clock_port, air_clock.offset_ns / 1e6,
+                    air_clock.drift * 1e6);
+    }
+    if (capture_ext_id) {
+        std::printf("capture times in header extension %d\n", capture_ext_id);
+    }
+    std::mt19937 rng(std::random_device{}());
+    RtpSender sender(out_fd, out_addr, loss, burst, static_cast<uint8_t>(capture_ext_id));
+    const auto vps = make_nal(32, 24, rng);
+    const auto sps = make_nal(33, 40, rng);
+    const auto pps = make_nal(34, 8, rng);
+
+    const uint64_t frame_us = 1000000 / static_cast<uint64_t>(fps);
+    uint64_t next_frame = now_us();
+    uint64_t request_us = 0; // first request not answered yet
+    uint64_t requests = 0, forced = 0, periodic = 0;
+    uint64_t last_sent = 0, last_dropped = 0;
+    uint64_t window_start = now_us();
+    for (uint64_t frame = 0;; ++frame) {
+        // Requests that came in since the last frame.
+        uint8_t buf[256];
+        ssize_t n;
+        while ((n = recv(req_fd, buf, sizeof(buf), 0)) > 0) {
+            const bool pli = n >= 12 && (buf[0] & 0xc0) == 0x80 && buf[1] == 206 && (buf[0] & 0x1f) == 1;
+            const bool text = n >= 8 && std::memcmp(buf, "keyframe", 8) == 0;
+            if (pli || text) {
+                ++requests;
+                if (!request_us) {
+                    request_us = now_us();
+                }
+            }
+        }
+
+        // The "camera" captures the frame now.
+        sender.set_capture_time(air_clock.now());
+        const bool periodic_idr = frame % static_cast<uint64_t>(gop) == 0;
+        const bool idr = periodic_idr || request_us;
+        const uint32_t ts = static_cast<uint32_t>(frame * 90000 / static_cast<uint64_t>(fps));
+        if (idr) {
+            if (request_us) {
+                std::printf("request -> IDR sent in %.1f ms\n", static_cast<double>(now_us() - request_us) / 1000.0);
+                request_us = 0;
+                ++forced;
+            } else {
+                ++periodic;
+            }
+            sender.send_nal(vps, ts, false);
+            sender.send_nal(sps, ts, false);
+            sender.send_nal(pps, ts, false);
+            sender.send_nal(make_nal(19, static_cast<size_t>(p_bytes) * 5, rng), ts, true);
+        } else {
+            sender.send_nal(make_nal(1, static_cast<size_t>(p_bytes), rng), ts, true);
+        }
+
+        const uint64_t now = now_us();
+        if (now - window_start >= 1000000) {
+            std::printf("pkts %llu dropped %llu requests %llu IDR forced %llu periodic %llu\n",
+                        static_cast<unsigned long long>(sender.sent() - last_sent),
+                        static_cast<unsigned long long>(sender.dropped() - last_dropped),
+                        static_cast<unsigned long long>(requests), static_cast<unsigned long long>(forced),
+                        static_cast<unsigned long long>(periodic));
+            std::fflush(stdout);
+            last_sent = sender.sent();
+            last_dropped = sender.dropped();
+            requests = forced = periodic = 0;
+            window_start = now;
+        }
+        next_frame += frame_us;
+        if (next_frame > now) {
+            std::this_thread::sleep_for(std::chrono::microseconds(next_frame - now));
+        }
+    }
+}
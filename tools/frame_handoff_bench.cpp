@@ -0,0 +1,129 @@
+//
+// appsink → decoder/DVR handoff benchmark: the old gst_copy_buffer() path (new vector +
+// memcpy per access unit) against VideoFrame handles that keep the GstBuffer mapped, and
+// the NEW_FRAME_CALLBACK compatibility shim on top of them.
+//
+// Frames are cycled through a set of GstBuffers larger than the L2 cache so the copies
+// see the same memory traffic they do on the device. Each handed-off frame is held by two
+// consumers (decode queue and DVR) before being released, like in main.cpp.
+//
+//   frame_handoff_bench [-s bytes] [-n frames]
+//
+
+#include "video_frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr int kBufferSet = 64;
+
+// Consumers read the first and last byte so the handoff cannot be optimized away.
+volatile uint64_t g_sink = 0;
+
+struct Result {
+    uint64_t bytes_copied = 0;
+    double us_per_frame = 0.0;
+};
+
+// What loop_pull_appsink_samples() did per sample before VideoFrame.
+std::shared_ptr<std::vector<uint8_t>> gst_copy_buffer(GstBuffer *buffer)
+{
+    const auto size = gst_buffer_get_size(buffer);
+    auto ret = std::make_shared<std::vector<uint8_t>>(size);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_READ);
+    std::memcpy(ret->data(), map.data, size);
+    gst_buffer_unmap(buffer, &map);
+    return ret;
+}
+
+template <typename Handoff>
+Result run(const std::vector<GstBuffer *> &buffers, int frames, Handoff handoff)
+{
+    Result res;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        res.bytes_copied += handoff(buffers[static_cast<size_t>(i) % buffers.size()]);
+    }
+    const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+    res.us_per_frame = elapsed.count() / frames;
+    return res;
+}
+
+void print(const char *name, const Result &res, int frames)
+{
+    std::printf("%-28s copied %10.0f bytes/frame  %8.2f us/frame\n", name,
+                static_cast<double>(res.bytes_copied) / frames, res.us_per_frame);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t frame_size = 150000; // a 4K HEVC P-frame at ~18 Mbit/s / 120 fps
+    int frames = 5000;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            frame_size = static_cast<size_t>(std::atol(optarg));
+            break;
+        case 'n':
+            frames = std::max(1, std::atoi(optarg));
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-s bytes] [-n frames]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    gst_init(&argc, &argv);
+    std::vector<GstBuffer *> buffers;
+    for (int i = 0; i < kBufferSet; ++i) {
+        GstBuffer *buffer = gst_buffer_new_allocate(nullptr, frame_size, nullptr);
+        gst_buffer_memset(buffer, 0, static_cast<guint8>(i), frame_size);
+        buffers.push_back(buffer);
+    }
+    std::printf("%zu byte frames x %d\n", frame_size, frames);
+
+    const auto copy = run(buffers, frames, [](GstBuffer *buffer) -> uint64_t {
+        auto frame = gst_copy_buffer(buffer);
+        auto decode_ref = frame;
+        auto dvr_ref = frame;
+        g_sink += (*decode_ref)[0] + (*dvr_ref)[frame->size() - 1];
+        return frame->size();
+    });
+    print("gst_copy_buffer", copy, frames);
+
+    const auto handle = run(buffers, frames, [](GstBuffer *buffer) -> uint64_t {
+        const uint64_t before = VideoFrame::bytes_copied();
+        VideoFramePtr frame = VideoFrame::wrap(buffer, VideoCodec::H265, FrameTiming{});
+        VideoFramePtr decode_ref = frame;
+        VideoFramePtr dvr_ref = frame;
+        g_sink += decode_ref->data()[0] + dvr_ref->data()[frame->size() - 1];
+        return VideoFrame::bytes_copied() - before;
+    });
+    print("VideoFrame handle", handle, frames);
+
+    const auto shim = run(buffers, frames, [](GstBuffer *buffer) -> uint64_t {
+        const uint64_t before = VideoFrame::bytes_copied();
+        VideoFramePtr frame = VideoFrame::wrap(buffer, VideoCodec::H265, FrameTiming{});
+        auto legacy = frame->to_vector();
+        g_sink += (*legacy)[0];
+        return VideoFrame::bytes_copied() - before;
+    });
+    print("NEW_FRAME_CALLBACK shim", shim, frames);
+
+    for (GstBuffer *buffer : buffers) {
+        gst_buffer_unref(buffer);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+// Replays a recorded link trace through LinkEstimator and prints the bitrate it would
+// have asked for, window by window, plus a summary. Traces are the "[link] sample ..."
+// debug lines the receiver logs with -H (a whole log file works, other lines are
+// skipped) or bare CSV lines: duration_s,loss,jitter_ms,queue_depth,decoder_eagain.
+// Same trace and config, same output, so estimator changes can be compared on
+// recordings from real flights.
+//
+//   link_estimator_replay [-m min_kbps] [-M max_kbps] [-s start_kbps] [-q] [trace|-]
+//
+// e.g. AMLDigitalFPV ... -H 127.0.0.1:5621 -v debug 2>&1 | tee flight.log
+//      link_estimator_replay -m 2000 -M 16000 flight.log
+//
+// -q prints the summary only.
+//
+
+#include "link_estimator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+    LinkEstimator::Config config;
+    bool start_set = false;
+    bool quiet = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:M:s:q")) != -1) {
+        switch (opt) {
+        case 'm':
+            config.min_kbps = static_cast<uint32_t>(std::max(1, std::atoi(optarg)));
+            break;
+        case 'M':
+            config.max_kbps = static_cast<uint32_t>(std::max(1, std::atoi(optarg)));
+            break;
+        case 's':
+            config.start_kbps = static_cast<uint32_t>(std::max(1, std::atoi(optarg)));
+            start_set = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-m min_kbps] [-M max_kbps] [-s start_kbps] [-q] [trace|-]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!start_set) {
+        config.start_kbps = config.min_kbps + (std::max(config.max_kbps, config.min_kbps) - config.min_kbps) / 2;
+    }
+
+    std::ifstream file;
+    std::istream *in = &std::cin;
+    if (optind < argc && std::string(argv[optind]) != "-") {
+        file.open(argv[optind]);
+        if (!file) {
+            std::fprintf(stderr, "cannot open %s\n", argv[optind]);
+            return 1;
+        }
+        in = &file;
+    }
+
+    LinkEstimator estimator(config);
+    const std::string marker = "[link] sample ";
+    std::string line;
+    double t = 0.0;
+    double kbit_sum = 0.0;
+    uint64_t windows = 0, decreases = 0, queued = 0;
+    uint32_t min_target = UINT32_MAX, max_target = 0;
+    if (!quiet) {
+        std::printf("%8s %6s %9s %5s %6s %8s %-8s %s\n", "t_s", "loss%", "jitter_ms", "queue", "eagain",
+                    "kbps", "state", "reason");
+    }
+    while (std::getline(*in, line)) {
+        const auto pos = line.find(marker);
+        LinkSample sample;
+        if (!link_sample_from_trace(pos == std::string::npos ? line : line.substr(pos + marker.size()), sample)) {
+            continue;
+        }
+        const LinkEstimate &e = estimator.update(sample);
+        t += sample.duration_s;
+        kbit_sum += e.target_kbps * sample.duration_s;
+        ++windows;
+        if (e.state == LinkState::DECREASE) {
+            ++decreases;
+        }
+        if (sample.queue_depth > config.queue_limit || sample.decoder_eagain > 0) {
+            ++queued;
+        }
+        min_target = std::min(min_target, e.target_kbps);
+        max_target = std::max(max_target, e.target_kbps);
+        if (!quiet) {
+            std::printf("%8.1f %6.2f %9.2f %5u %6u %8u %-8s %s\n", t, sample.loss * 100.0, sample.jitter_ms,
+                        sample.queue_depth, sample.decoder_eagain, e.target_kbps, LinkEstimator::state_name(e.state),
+                        e.reason);
+        }
+    }
+    if (!windows) {
+        std::fprintf(stderr, "no samples in the trace\n");
+        return 1;
+    }
+    std::printf("%llu windows over %.1f s: target avg %.0f kbps min %u max %u, %llu decreases, decoder queuing in %llu windows\n",
+                static_cast<unsigned long long>(windows), t, t > 0.0 ? kbit_sum / t : 0.0, min_target, max_target,
+                static_cast<unsigned long long>(decreases), static_cast<unsigned long long>(queued));
+    return 0;
+}
@@ -0,0 +1,159 @@
+//
+// FEC encoder for loopback testing of -e: receives the air unit's RTP on a UDP port,
+// forwards it to the receiver and adds XOR row/column parity packets (RtpFecEncoder) for
+// the video payload type. Optional random / burst loss on the forwarded stream shows what
+// the receiver recovers; compare its "[...] fec:" debug lines with the counters here.
+//
+//   rtp_fec_encoder [-p listen_port] [-o host:port] [-t video_pt] [-e fec_pt]
+//                   [-l columns] [-d rows] [-x loss_percent] [-b burst]
+//
+// e.g. rtp_fec_encoder -p 5610 -o 127.0.0.1:5600 -l 8 -d 4 -x 2 -b 3
+//      AMLDigitalFPV ... -e 100 -j 20000 -v debug
+//
+
+#include "rtp_fec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kMaxDatagram = 4096;
+
+bool parse_destination(const std::string &dest, sockaddr_in &addr)
+{
+    const auto colon = dest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(std::atoi(dest.c_str() + colon + 1)));
+    return inet_pton(AF_INET, dest.substr(0, colon).c_str(), &addr.sin_addr) == 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int port = 5610;
+    std::string dest = "127.0.0.1:5600";
+    int video_pt = 97;
+    int fec_pt = 100;
+    int columns = 8;
+    int rows = 4;
+    double loss = 0.0;
+    int burst = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:o:t:e:l:d:x:b:")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = std::atoi(optarg);
+            break;
+        case 'o':
+            dest = optarg;
+            break;
+        case 't':
+            video_pt = std::atoi(optarg);
+            break;
+        case 'e':
+            fec_pt = std::atoi(optarg);
+            break;
+        case 'l':
+            columns = std::atoi(optarg);
+            break;
+        case 'd':
+            rows = std::atoi(optarg);
+            break;
+        case 'x':
+            loss = std::clamp(std::atof(optarg), 0.0, 100.0) / 100.0;
+            break;
+        case 'b':
+            burst = std::max(1, std::atoi(optarg));
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-p listen_port] [-o host:port] [-t video_pt] [-e fec_pt] "
+                                 "[-l columns] [-d rows] [-x loss_percent] [-b burst]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sockaddr_in out_addr{};
+    if (!parse_destination(dest, out_addr)) {
+        std::fprintf(stderr, "bad destination %s, expected host:port\n", dest.c_str());
+        return 1;
+    }
+    const int in_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    const int out_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 5 * 1024 * 1024;
+    setsockopt(in_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in in_addr{};
+    in_addr.sin_family = AF_INET;
+    in_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    in_addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(in_fd, reinterpret_cast<sockaddr *>(&in_addr), sizeof(in_addr)) < 0) {
+        std::fprintf(stderr, "bind UDP %d failed: %s\n", port, strerror(errno));
+        return 1;
+    }
+    timeval tv{1, 0};
+    setsockopt(in_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    int dropping = 0;
+    uint64_t media = 0, parity = 0, media_dropped = 0, parity_dropped = 0;
+
+    // Loss hits media and parity alike, in bursts of `burst` packets.
+    const auto send = [&](const uint8_t *packet, size_t size, bool is_parity) {
+        if (dropping == 0 && loss > 0.0 && uniform(rng) < loss) {
+            dropping = burst;
+        }
+        if (dropping > 0) {
+            --dropping;
+            ++(is_parity ? parity_dropped : media_dropped);
+            return;
+        }
+        sendto(out_fd, packet, size, 0, reinterpret_cast<sockaddr *>(&out_addr), sizeof(out_addr));
+    };
+    RtpFecEncoder encoder(columns, rows, static_cast<uint8_t>(fec_pt), [&](const uint8_t *packet, size_t size) {
+        ++parity;
+        send(packet, size, true);
+    });
+
+    std::printf("UDP %d -> %s, video PT %d protected by PT %d, %d x %d block, loss %.1f%% (burst %d)\n",
+                port, dest.c_str(), video_pt, fec_pt, columns, rows, loss * 100.0, burst);
+    std::vector<uint8_t> buf(kMaxDatagram);
+    auto window_start = std::chrono::steady_clock::now();
+    for (;;) {
+        const ssize_t n = recv(in_fd, buf.data(), buf.size(), 0);
+        if (n > 12 && (buf[1] & 0x7f) == video_pt) {
+            ++media;
+            send(buf.data(), static_cast<size_t>(n), false);
+            encoder.on_media(buf.data(), static_cast<size_t>(n));
+        } else if (n > 0) {
+            sendto(out_fd, buf.data(), static_cast<size_t>(n), 0, reinterpret_cast<sockaddr *>(&out_addr),
+                   sizeof(out_addr));
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - window_start >= std::chrono::seconds(1)) {
+            std::printf("media %llu (dropped %llu) parity %llu (dropped %llu) overhead %.1f%%\n",
+                        static_cast<unsigned long long>(media), static_cast<unsigned long long>(media_dropped),
+                        static_cast<unsigned long long>(parity), static_cast<unsigned long long>(parity_dropped),
+                        media ? 100.0 * static_cast<double>(parity) / static_cast<double>(media) : 0.0);
+            std::fflush(stdout);
+            media = parity = media_dropped = parity_dropped = 0;
+            window_start = now;
+        }
+    }
+}
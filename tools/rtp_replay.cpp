@@ -0,0 +1,159 @@
+//
+// Replays the UDP datagrams of a pcap (a -W capture dump, or tcpdump/Wireshark from the
+// ground station) to the receiver over UDP with their original inter-arrival times,
+// scaled by -s, or as fast as the socket takes them (-s 0). Same file, same traffic:
+// repeatable latency and throughput runs of real flight recordings on a dev box. The
+// receiver can also read the pcap itself (-Y), without the loopback hop.
+//
+//   rtp_replay [-o host:port] [-s speed] [-l loops] [-p dst_port] [-q] capture.pcap
+//
+// e.g. rtp_replay -o 127.0.0.1:5600 -p 5600 /storage/rtp_capture_crash.pcap
+//      AMLDigitalFPV ... -n 1 -v debug
+//
+// -p keeps only datagrams to that port (default: all UDP). -l 0 loops forever.
+// Prints packets, Mbit/s and how far sends fell behind the schedule once a second
+// (-q: summary only).
+//
+
+#include "pcap_replay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t now_us()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+bool parse_destination(const std::string &dest, sockaddr_in &addr)
+{
+    const auto colon = dest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(std::atoi(dest.c_str() + colon + 1)));
+    return inet_pton(AF_INET, dest.substr(0, colon).c_str(), &addr.sin_addr) == 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string destination = "127.0.0.1:5600";
+    double speed = 1.0;
+    uint32_t loops = 1;
+    uint16_t dst_port = 0;
+    bool quiet = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:s:l:p:q")) != -1) {
+        switch (opt) {
+        case 'o':
+            destination = optarg;
+            break;
+        case 's':
+            speed = std::max(0.0, std::atof(optarg));
+            break;
+        case 'l':
+            loops = static_cast<uint32_t>(std::max(0, std::atoi(optarg)));
+            break;
+        case 'p':
+            dst_port = static_cast<uint16_t>(std::atoi(optarg));
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-o host:port] [-s speed] [-l loops] [-p dst_port] [-q] capture.pcap\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        std::fprintf(stderr, "usage: %s [-o host:port] [-s speed] [-l loops] [-p dst_port] [-q] capture.pcap\n",
+                     argv[0]);
+        return 1;
+    }
+
+    PcapCapture capture;
+    std::string error;
+    if (!capture.load(argv[optind], dst_port, error)) {
+        std::fprintf(stderr, "%s: %s\n", argv[optind], error.c_str());
+        return 1;
+    }
+    sockaddr_in addr{};
+    if (!parse_destination(destination, addr)) {
+        std::fprintf(stderr, "bad destination %s\n", destination.c_str());
+        return 1;
+    }
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0) {
+        std::fprintf(stderr, "socket: %s\n", std::strerror(errno));
+        return 1;
+    }
+    const int sndbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    char pace[32] = "full speed";
+    if (speed > 0.0) {
+        std::snprintf(pace, sizeof(pace), "%gx", speed);
+    }
+    std::printf("%zu packets, %.1f s of traffic -> %s at %s\n", capture.packets.size(), capture.duration_s(),
+                destination.c_str(), pace);
+
+    PcapReplaySource replay(std::move(capture), speed, loops);
+    uint64_t send_errors = 0;
+    const auto send_packet = [&](const uint8_t *data, size_t size, uint64_t) {
+        if (send(fd, data, size, 0) < 0) {
+            ++send_errors;
+        }
+    };
+
+    const uint64_t start = now_us();
+    uint64_t window_start = start;
+    PcapReplaySource::Stats window, total;
+    const auto add = [](PcapReplaySource::Stats &to, const PcapReplaySource::Stats &from) {
+        to.packets += from.packets;
+        to.bytes += from.bytes;
+        to.late_us_sum += from.late_us_sum;
+        to.late_us_max = std::max(to.late_us_max, from.late_us_max);
+    };
+    while (replay.wait(100, send_packet) >= 0) {
+        const uint64_t now = now_us();
+        if (now - window_start < 1000000) {
+            continue;
+        }
+        window = replay.take_stats();
+        add(total, window);
+        if (!quiet) {
+            const double s = (now - window_start) / 1e6;
+            std::printf("%8.1f s %7llu pkt/s %7.2f Mbit/s late avg %llu us max %llu us\n", (now - start) / 1e6,
+                        static_cast<unsigned long long>(window.packets / s), window.bytes * 8 / s / 1e6,
+                        static_cast<unsigned long long>(window.packets ? window.late_us_sum / window.packets : 0),
+                        static_cast<unsigned long long>(window.late_us_max));
+        }
+        window_start = now;
+    }
+    add(total, replay.take_stats());
+    const double s = std::max(1e-6, (now_us() - start) / 1e6);
+    std::printf("%llu packets in %.2f s (%u loops): %.2f Mbit/s, late avg %llu us max %llu us, %llu send errors\n",
+                static_cast<unsigned long long>(total.packets), s, replay.loops_done(), total.bytes * 8 / s / 1e6,
+                static_cast<unsigned long long>(total.packets ? total.late_us_sum / total.packets : 0),
+                static_cast<unsigned long long>(total.late_us_max), static_cast<unsigned long long>(send_errors));
+    close(fd);
+    return 0;
+}
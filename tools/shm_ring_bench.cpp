@@ -0,0 +1,249 @@
+//
+// Co-located ingest benchmark: the abstract AF_UNIX datagram socket the receiver used to
+// take packets from a local producer on, against the shared-memory ring (ShmPacketRing).
+//
+// A producer thread sends timestamped packets for a fixed time, either paced (-r pps) or as
+// fast as the consumer takes them (-r 0; the socket sender blocks, the ring producer spins
+// on a full ring). The consumer reports packet rate, throughput, syscalls per packet on
+// both ends and producer -> consumer latency. The ring goes through the real handshake.
+//
+//   shm_ring_bench [-r pps] [-s bytes] [-d seconds]
+//
+
+#include "shm_packet_ring.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct BenchResult {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t rx_syscalls = 0;
+    uint64_t tx_syscalls = 0;
+    uint64_t tx_full = 0; // ring full: dropped (paced) or retried (unpaced)
+    std::vector<uint32_t> latency_us;
+};
+
+uint64_t now_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+socklen_t abstract_address(const std::string &name, sockaddr_un &addr)
+{
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path + 1, name.data(), std::min(name.size(), sizeof(addr.sun_path) - 2));
+    return static_cast<socklen_t>(sizeof(addr.sun_family) + 1 + name.size());
+}
+
+// Calls send(packet) for every packet due, in 1 ms ticks when paced; stops after `seconds`.
+template <typename Send>
+void produce(int pps, int size, int seconds, Send send)
+{
+    std::vector<uint8_t> pkt(std::max<int>(size, sizeof(uint64_t)), 0);
+    const uint64_t start = now_ns();
+    const uint64_t end = start + static_cast<uint64_t>(seconds) * 1000000000ULL;
+    uint64_t sent = 0;
+    for (uint64_t tick = start; now_ns() < end; tick += 1000000ULL) {
+        uint64_t due = ~0ULL;
+        if (pps > 0) {
+            while (now_ns() < tick) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            due = (tick - start + 1000000ULL) * static_cast<uint64_t>(pps) / 1000000000ULL;
+        }
+        for (; sent < due; ++sent) {
+            const uint64_t ts = now_ns();
+            std::memcpy(pkt.data(), &ts, sizeof(ts));
+            send(pkt.data(), pkt.size());
+            if (pps == 0 && (sent & 1023) == 0 && now_ns() >= end) {
+                break;
+            }
+        }
+        if (pps == 0 && now_ns() >= end) {
+            break;
+        }
+    }
+}
+
+void record(BenchResult &res, const uint8_t *data, size_t size)
+{
+    if (size < sizeof(uint64_t)) {
+        return;
+    }
+    uint64_t ts = 0;
+    std::memcpy(&ts, data, sizeof(ts));
+    ++res.packets;
+    res.bytes += size;
+    // Keep the memory bounded when running unpaced at millions of packets per second.
+    if ((res.packets & 15) == 0 || res.latency_us.size() < 100000) {
+        res.latency_us.push_back(static_cast<uint32_t>((now_ns() - ts) / 1000));
+    }
+}
+
+BenchResult run_unix(int pps, int size, int seconds)
+{
+    BenchResult res;
+    const std::string name = "amldigitalfpv-bench-" + std::to_string(getpid());
+    sockaddr_un addr{};
+    const socklen_t len = abstract_address(name, addr);
+    int rx = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (bind(rx, reinterpret_cast<sockaddr *>(&addr), len) < 0) {
+        std::fprintf(stderr, "bind @%s failed: %s\n", name.c_str(), strerror(errno));
+        close(rx);
+        return res;
+    }
+    int rcvbuf = 5 * 1024 * 1024;
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    std::atomic<bool> done{false};
+    std::thread producer([&]() {
+        int tx = socket(AF_UNIX, SOCK_DGRAM, 0);
+        produce(pps, size, seconds, [&](const uint8_t *data, size_t n) {
+            ++res.tx_syscalls;
+            sendto(tx, data, n, 0, reinterpret_cast<sockaddr *>(&addr), len);
+        });
+        close(tx);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        done = true;
+    });
+
+    // The receiver's old unix socket reader: wait for readability, then one recv() per packet.
+    std::vector<uint8_t> buf(65536);
+    while (!done) {
+        pollfd pfd{rx, POLLIN, 0};
+        ++res.rx_syscalls;
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        ++res.rx_syscalls;
+        const ssize_t n = recv(rx, buf.data(), buf.size(), 0);
+        if (n > 0) {
+            record(res, buf.data(), static_cast<size_t>(n));
+        }
+    }
+    producer.join();
+    close(rx);
+    return res;
+}
+
+BenchResult run_shm(int pps, int size, int seconds, bool &ok)
+{
+    BenchResult res;
+    const std::string name = "amldigitalfpv-bench-" + std::to_string(getpid());
+    ShmRingConsumer consumer;
+    ok = consumer.start(name, 1024, static_cast<unsigned>(std::max<int>(size, sizeof(uint64_t))));
+    if (!ok) {
+        return res;
+    }
+
+    std::atomic<bool> done{false};
+    std::thread producer([&]() {
+        std::unique_ptr<ShmPacketRing> ring;
+        while (!ring) {
+            ring = shm_ring_connect(name);
+        }
+        produce(pps, size, seconds, [&](const uint8_t *data, size_t n) {
+            while (!ring->push(data, n, 0)) {
+                ++res.tx_full;
+                if (pps > 0) {
+                    return;
+                }
+                sched_yield();
+            }
+        });
+        res.tx_syscalls = ring->syscalls();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        done = true;
+    });
+
+    while (!done) {
+        if (consumer.wait(100, [&](const uint8_t *data, size_t n, uint64_t) { record(res, data, n); }) < 0) {
+            break;
+        }
+    }
+    producer.join();
+    res.rx_syscalls = consumer.syscalls();
+    return res;
+}
+
+void print_result(const char *name, BenchResult &res, int seconds)
+{
+    auto &lat = res.latency_us;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) -> uint32_t {
+        return lat.empty() ? 0 : lat[std::min(lat.size() - 1, static_cast<size_t>(p * lat.size()))];
+    };
+    const double pkts = res.packets ? static_cast<double>(res.packets) : 1.0;
+    std::printf("%-10s pkts=%-10llu rate=%-10.0f pps %7.1f MB/s  syscalls/pkt rx=%-6.3f tx=%-6.3f"
+                "  ring full=%llu  latency p50=%uus p99=%uus\n",
+                name,
+                static_cast<unsigned long long>(res.packets),
+                static_cast<double>(res.packets) / seconds,
+                static_cast<double>(res.bytes) / seconds / 1e6,
+                res.rx_syscalls / pkts, res.tx_syscalls / pkts,
+                static_cast<unsigned long long>(res.tx_full),
+                pct(0.50), pct(0.99));
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int pps = 0;
+    int size = 1400;
+    int seconds = 3;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:d:")) != -1) {
+        switch (opt) {
+        case 'r':
+            pps = std::max(0, std::atoi(optarg));
+            break;
+        case 's':
+            size = std::clamp(std::atoi(optarg), 8, 4096);
+            break;
+        case 'd':
+            seconds = std::max(1, std::atoi(optarg));
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-r pps] [-s bytes] [-d seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    spdlog::set_level(spdlog::level::warn);
+    if (pps > 0) {
+        std::printf("co-located ingest, %d pps x %d bytes for %d s\n", pps, size, seconds);
+    } else {
+        std::printf("co-located ingest, unpaced x %d bytes for %d s\n", size, seconds);
+    }
+
+    auto unix_res = run_unix(pps, size, seconds);
+    print_result("unix dgram", unix_res, seconds);
+
+    bool ok = true;
+    auto shm_res = run_shm(pps, size, seconds, ok);
+    if (!ok) {
+        std::printf("shm ring not available here, skipped\n");
+        return 0;
+    }
+    print_result("shm ring", shm_res, seconds);
+    return 0;
+}
@@ -0,0 +1,152 @@
+//
+// Reference producer for the shared-memory ring ingest (-i 4): receives RTP on a UDP port
+// and writes every datagram, with its kernel receive time, into the ring of the receiver
+// listening on @name. It is both a drop-in shim (point wfb-ng's video output at -p) and the
+// template for pushing packets straight from a radio receiver process:
+//
+//   auto ring = shm_ring_connect("amldigitalfpv");
+//   ring->push(packet, size, rx_ns);   // no syscall unless the consumer is asleep
+//
+// Reconnects when the receiver restarts. Per-second counters go to stdout.
+//
+//   shm_ring_producer [-n name] [-p udp_port]
+//
+
+#include "shm_packet_ring.h"
+#include "frame_timing.h"
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kBatch = 32;
+constexpr size_t kMaxDatagram = 4096;
+
+int open_udp(int port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 5 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        std::fprintf(stderr, "bind UDP %d failed: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    enable_rx_timestamps(fd);
+    // Wake up now and then to notice a receiver restart even when no video arrives.
+    timeval tv{0, 200 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string name = "amldigitalfpv";
+    int port = 5620;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'p':
+            port = std::atoi(optarg);
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-n name] [-p udp_port]\n", argv[0]);
+            return 1;
+        }
+    }
+    spdlog::set_level(spdlog::level::warn);
+
+    const int fd = open_udp(port);
+    if (fd < 0) {
+        return 1;
+    }
+
+    std::vector<uint8_t> storage(static_cast<size_t>(kBatch) * kMaxDatagram);
+    std::vector<uint8_t> control(static_cast<size_t>(kBatch) * kRxTimestampControlLen);
+    iovec iovs[kBatch];
+    mmsghdr msgs[kBatch];
+    for (int i = 0; i < kBatch; ++i) {
+        iovs[i].iov_base = storage.data() + static_cast<size_t>(i) * kMaxDatagram;
+        iovs[i].iov_len = kMaxDatagram;
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control.data() + static_cast<size_t>(i) * kRxTimestampControlLen;
+    }
+
+    std::unique_ptr<ShmPacketRing> ring;
+    bool waiting_logged = false;
+    uint64_t pushed = 0;
+    uint64_t dropped = 0;
+    uint64_t last_syscalls = 0;
+    auto window_start = std::chrono::steady_clock::now();
+    for (;;) {
+        if (!ring || ring->peer_closed()) {
+            if (ring) {
+                std::printf("receiver went away, reconnecting\n");
+                ring.reset();
+                last_syscalls = 0;
+            }
+            ring = shm_ring_connect(name);
+            if (!ring) {
+                if (!waiting_logged) {
+                    std::printf("waiting for a receiver on @%s\n", name.c_str());
+                    waiting_logged = true;
+                }
+                // Drain the socket meanwhile so the receiver starts with fresh packets.
+                while (recv(fd, storage.data(), kMaxDatagram, MSG_DONTWAIT) > 0) {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                continue;
+            }
+            waiting_logged = false;
+            std::printf("attached to @%s (%u bytes per packet max), forwarding UDP %d\n",
+                        name.c_str(), ring->max_packet(), port);
+        }
+
+        for (int i = 0; i < kBatch; ++i) {
+            msgs[i].msg_hdr.msg_controllen = kRxTimestampControlLen;
+        }
+        const int received = recvmmsg(fd, msgs, kBatch, MSG_WAITFORONE, nullptr);
+        for (int i = 0; i < received; ++i) {
+            if (ring->push(static_cast<const uint8_t *>(iovs[i].iov_base), msgs[i].msg_len,
+                           rx_timestamp_ns(msgs[i].msg_hdr))) {
+                ++pushed;
+            } else {
+                ++dropped;
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - window_start >= std::chrono::seconds(1)) {
+            std::printf("pkts/s %llu ring full %llu eventfd wakeups %llu\n",
+                        static_cast<unsigned long long>(pushed), static_cast<unsigned long long>(dropped),
+                        static_cast<unsigned long long>(ring->syscalls() - last_syscalls));
+            std::fflush(stdout);
+            last_syscalls = ring->syscalls();
+            pushed = 0;
+            dropped = 0;
+            window_start = now;
+        }
+    }
+}